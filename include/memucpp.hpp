@@ -4,15 +4,32 @@
 
 #include <array>
 #include <charconv>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <format>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <ranges>
 #include <span>
 #include <spanstream>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
+#include "memucpp/adb.hpp"
+#include "memucpp/async.hpp"
+#include "memucpp/diff.hpp"
+#include "memucpp/export.hpp"
+#include "memucpp/frame.hpp"
+#include "memucpp/gesture.hpp"
+#include "memucpp/match.hpp"
+#include "memucpp/metrics.hpp"
+#include "memucpp/monitor.hpp"
+#include "memucpp/state.hpp"
+
 namespace memucpp
 {
     namespace internal
@@ -28,6 +45,8 @@ namespace memucpp
             }
             return out;
         }
+
+        class CaptureWorker;
     } // namespace internal
 
     class error : public std::exception
@@ -37,7 +56,7 @@ namespace memucpp
         {
         }
 
-        auto what() const -> char const* override
+        auto what() const noexcept -> char const* override
         {
             return message.c_str();
         }
@@ -65,6 +84,12 @@ namespace memucpp
     struct ProcessInfo
     {
         std::string name;
+        int32_t pid;
+        int32_t ppid;
+        // Resident set size in KiB
+        uint64_t rss;
+        // State of ps (R running, S sleeping, D waiting, Z zombie, T stopped)
+        char state;
     };
 
     struct VMConfig
@@ -79,16 +104,129 @@ namespace memucpp
         }
     };
 
+    struct ProvisionOptions
+    {
+        // Reuses the running VM, it is rebooted only when its config has changed
+        bool attach;
+        // Stops the VM started by this instance on destruction (the attached VM keeps running)
+        bool stop_on_exit;
+        // Maximum time to wait for the guest boot (0 does not wait)
+        std::chrono::milliseconds boot_timeout;
+        // Interval between the checks of the guest boot
+        std::chrono::milliseconds poll_interval;
+        // Number of the VMs booted at once by Memuc::Provision (0 is all)
+        uint32_t concurrency;
+
+        static auto Default() -> ProvisionOptions
+        {
+            return ProvisionOptions{.attach = true,
+                                    .stop_on_exit = false,
+                                    .boot_timeout = std::chrono::minutes(2),
+                                    .poll_interval = std::chrono::milliseconds(200),
+                                    .concurrency = 4};
+        }
+    };
+
+    struct ProcessResult
+    {
+        int32_t exit_code;
+        bool timed_out;
+        size_t size;
+    };
+
+    /*!
+        \brief Runs the MEmuc processes and collects their output
+    */
+    class ProcessBackend
+    {
+      public:
+        virtual ~ProcessBackend() = default;
+
+        /*!
+            \brief Executes the process and reads its standard output
+            \param arguments executable path followed by its arguments (passed without shell quoting)
+            \param output the reusable output buffer (grows when needed, never shrinks)
+            \param timeout maximum execution time (milliseconds::max() waits forever)
+            \return exit status, timeout flag and number of bytes written into the output
+        */
+        virtual auto execute(std::span<std::string const> const arguments, std::vector<uint8_t>& output,
+                             std::chrono::milliseconds const timeout) -> ProcessResult = 0;
+    };
+
+    /*!
+        \brief Spawns the processes with pipes (posix_spawn on POSIX, CreateProcess on Windows)
+    */
+    class SpawnBackend : public ProcessBackend
+    {
+      public:
+        auto execute(std::span<std::string const> const arguments, std::vector<uint8_t>& output,
+                     std::chrono::milliseconds const timeout) -> ProcessResult override;
+    };
+
+    struct CaptureOptions
+    {
+        double target_fps;
+        uint32_t max_unconsumed;
+
+        static auto Default() -> CaptureOptions
+        {
+            return CaptureOptions{.target_fps = 30.0, .max_unconsumed = 2};
+        }
+    };
+
+    struct CapturedFrame
+    {
+        Frame frame;
+        uint64_t sequence;
+        std::chrono::steady_clock::time_point timestamp;
+    };
+
+    struct CaptureStats
+    {
+        uint64_t captured;
+        uint64_t consumed;
+        uint64_t dropped;
+        uint64_t failures;
+    };
+
     /*!
         \brief MEmuc executable path (C:/Program Files is default)
     */
     inline std::filesystem::path memuc_path = "C:/Program Files/Microvirt/MEmu/memuc.exe";
 
+    /*!
+        \brief Backend used to execute MEmuc (SpawnBackend is default)
+    */
+    inline std::shared_ptr<ProcessBackend> process_backend = std::make_shared<SpawnBackend>();
+
+    /*!
+        \brief Maximum execution time of the MEmuc command (no limit is default)
+    */
+    inline std::chrono::milliseconds process_timeout = std::chrono::milliseconds::max();
+
+    /*!
+        \brief Number of threads converting the screen capture (1 is default)
+    */
+    inline uint32_t capture_threads = 1;
+
+    class ShellSession;
+
+    class FrameRecorder;
+
     class Memuc
     {
       public:
+        /*!
+            \brief Writes the whole config and starts the VM, the VM is stopped on destruction
+        */
         Memuc(uint16_t const vm_index, VMConfig const& config);
 
+        /*!
+            \brief Provisions the VM writing only the changed config values
+            \param options attach to the running VM, stop on destruction and wait for the guest boot
+        */
+        Memuc(uint16_t const vm_index, VMConfig const& config, ProvisionOptions const& options);
+
         ~Memuc();
 
         Memuc(Memuc const&) = delete;
@@ -99,11 +237,36 @@ namespace memucpp
 
         auto operator=(Memuc&& other) -> Memuc&;
 
+        /*!
+            \brief Provisions the VMs in parallel (options.concurrency at once)
+            \return instances in the order of vm_indices (the first error is rethrown after all VMs finish)
+        */
+        static auto Provision(std::span<uint16_t const> const vm_indices, VMConfig const& config,
+                              ProvisionOptions const& options = ProvisionOptions::Default()) -> std::vector<Memuc>;
+
+        /*!
+            \brief Waits until the guest reports sys.boot_completed
+            \param timeout maximum time to wait
+            \param poll_interval interval between the checks
+        */
+        auto wait_boot(std::chrono::milliseconds const timeout,
+                       std::chrono::milliseconds const poll_interval = std::chrono::milliseconds(200)) -> void;
+
+        /*!
+            \brief Returns true if the VM is stopped on destruction
+        */
+        auto owns_vm() const -> bool;
+
         /*!
             \brief Returns list of the VMs
         */
         auto list_vms() const -> std::vector<VMInfo>;
 
+        /*!
+            \brief Returns list of the VMs into the reusable container (the names keep their storage)
+        */
+        auto list_vms(std::vector<VMInfo>& out) const -> void;
+
         /*!
             \brief Reboots the VM
         */
@@ -143,18 +306,270 @@ namespace memucpp
         auto trigger_click(std::tuple<uint32_t, uint32_t> const position) -> void;
 
         /*!
-            \brief Returns list of the running VM's processes
+            \brief Returns the touch screen of the VM (found by getevent once, then cached)
+        */
+        auto touch_device() -> TouchDevice const&;
+
+        /*!
+            \brief Plays the gesture script as one device command
+            \param script the script compiled for the touch screen of the VM
+        */
+        auto play_gesture(GestureScript const& script) -> void;
+
+        /*!
+            \brief Plays the compiled gesture (the VMs with the same touch screen share it)
+        */
+        auto play_gesture(CompiledGesture const& gesture) -> void;
+
+        /*!
+            \brief Enables the persistent adb shell session for the input commands
+            \param enabled true keeps one adb shell open, false runs memuc per command
+        */
+        auto enable_shell_session(bool const enabled) -> void;
+
+        /*!
+            \brief Sends the adb traffic straight to the adb server instead of memuc
+            \param enabled true connects to the adb server, false runs memuc per command
+            \param options the address of the adb server and the connection pool
+        */
+        auto enable_adb_transport(bool const enabled, AdbOptions const& options = AdbOptions::Default()) -> void;
+
+        /*!
+            \brief Returns list of the running VM's processes (from the app monitor table when it is started)
+            \details The table keeps the parent, memory and state of the ps snapshot of the monitor, the processes
+                     started after it have ppid -1, rss 0 and state '?'.
         */
         auto list_process() const -> std::vector<ProcessInfo>;
 
+        /*!
+            \brief Returns list of the running VM's processes into the reusable container
+        */
+        auto list_process(std::vector<ProcessInfo>& out) const -> void;
+
+        /*!
+            \brief Starts following the process events of the VM through one adb shell channel
+            \return the monitor to subscribe to the app start, crash, ANR and death events
+        */
+        auto start_app_monitor(AppMonitorOptions const& options = AppMonitorOptions::Default()) -> AppMonitor&;
+
+        /*!
+            \brief Stops the app monitor, list_process runs ps again
+        */
+        auto stop_app_monitor() -> void;
+
+        /*!
+            \brief Returns the started app monitor
+        */
+        auto app_monitor() -> AppMonitor&;
+
         /*!
             \brief Returns the screen capture screenshot
             \return span of the bitmap image (BMP format)
         */
         auto screen_cap() -> std::span<uint8_t const>;
 
+        /*!
+            \brief Returns the raw screen capture without conversion
+            \return frame holding the pooled device pixels
+        */
+        auto capture() -> Frame;
+
+        /*!
+            \brief Captures the part of the screen, the device sends only the rows of the region
+            \param region the rectangle of the screen (clipped to the screen)
+            \param factor the integer downscale factor (1 keeps the pixels without conversion)
+            \return frame of the region with the mapping to the screen positions
+        */
+        auto capture_region(Rect const& region, uint32_t const factor = 1) -> RegionFrame;
+
+        /*!
+            \brief Captures the screen and finds its state in the index
+        */
+        auto classify_screen(ScreenStateIndex const& index) -> std::optional<StateMatch>;
+
+        /*!
+            \brief Waits until the screen is in the state
+            \param index the index with the references of the state
+            \param label the state to wait for
+            \param timeout maximum time to wait
+            \param options the capture interval (adapts to the changes of the screen)
+            \return the match of the state
+        */
+        auto wait_state(ScreenStateIndex const& index, std::string_view const label,
+                        std::chrono::milliseconds const timeout,
+                        StateWaitOptions const& options = StateWaitOptions::Default()) -> StateMatch;
+
+        /*!
+            \brief Waits until the screen is in any of the states
+            \return the match of the first state reached
+        */
+        auto wait_state(ScreenStateIndex const& index, std::span<std::string_view const> const labels,
+                        std::chrono::milliseconds const timeout,
+                        StateWaitOptions const& options = StateWaitOptions::Default()) -> StateMatch;
+
+        /*!
+            \brief Changes the pool of the capture buffers (FramePool::Shared() is default)
+        */
+        auto set_frame_pool(std::shared_ptr<FramePool> pool) -> void;
+
+        /*!
+            \brief Appends every full screen capture and input command of the VM to the recording (nullptr stops)
+        */
+        auto set_recorder(std::shared_ptr<FrameRecorder> recorder) -> void;
+
+        /*!
+            \brief Publishes every full screen capture into the shared memory ring FrameExporter::vm_name(vm_index)
+            \param options number of the slots of the ring (each slot fits the configured resolution)
+        */
+        auto start_frame_export(FrameExportOptions const& options = FrameExportOptions::Default()) -> void;
+
+        /*!
+            \brief Stops publishing the captures and removes the name of the ring
+        */
+        auto stop_frame_export() -> void;
+
+        /*!
+            \brief Starts capturing the screen continuously on the background thread
+            \param options target frame rate (0 is unlimited) and number of the unconsumed frames
+                           after which the capture pauses (0 never pauses)
+        */
+        auto start_capture(CaptureOptions const& options = CaptureOptions::Default()) -> void;
+
+        /*!
+            \brief Stops the background capture
+        */
+        auto stop_capture() -> void;
+
+        /*!
+            \brief Returns the newest complete frame of the background capture without waiting
+            \return frame with its sequence number and capture time or std::nullopt before the first frame
+        */
+        auto latest_frame() -> std::optional<CapturedFrame>;
+
+        /*!
+            \brief Returns the counters of the background capture
+        */
+        auto capture_stats() const -> CaptureStats;
+
+        /*!
+            \brief Changes the event loop of the asynchronous commands (EventLoop::Shared() is default)
+        */
+        auto set_event_loop(std::shared_ptr<EventLoop> loop) -> void;
+
+        /*!
+            \brief Returns list of the VMs without blocking
+            \param timeout time after which the memuc process is killed
+        */
+        auto list_vms_async(std::chrono::milliseconds const timeout = process_timeout) const
+            -> AsyncResult<std::vector<VMInfo>>;
+
+        /*!
+            \brief Reboots the VM without blocking
+        */
+        auto reboot_async(std::chrono::milliseconds const timeout = process_timeout) -> AsyncResult<void>;
+
+        /*!
+            \brief Starts the new application without blocking
+            \param package_name the application package
+        */
+        auto start_app_async(std::string_view const package_name,
+                             std::chrono::milliseconds const timeout = process_timeout) -> AsyncResult<void>;
+
+        /*!
+            \brief Stops the application without blocking
+            \param package_name the application package
+        */
+        auto stop_app_async(std::string_view const package_name,
+                            std::chrono::milliseconds const timeout = process_timeout) -> AsyncResult<void>;
+
+        /*!
+            \brief Triggers the device key without blocking (the shell session is not used)
+        */
+        auto trigger_key_async(KeyCode const key_code, std::chrono::milliseconds const timeout = process_timeout)
+            -> AsyncResult<void>;
+
+        /*!
+            \brief Triggers the device swipe without blocking (the shell session is not used)
+        */
+        auto trigger_swipe_async(std::tuple<uint32_t, uint32_t> const start_position,
+                                 std::tuple<uint32_t, uint32_t> const end_position, uint32_t const speed,
+                                 std::chrono::milliseconds const timeout = process_timeout) -> AsyncResult<void>;
+
+        /*!
+            \brief Triggers the device click without blocking (the shell session is not used)
+        */
+        auto trigger_click_async(std::tuple<uint32_t, uint32_t> const position,
+                                 std::chrono::milliseconds const timeout = process_timeout) -> AsyncResult<void>;
+
+        /*!
+            \brief Returns list of the running VM's processes without blocking
+        */
+        auto list_process_async(std::chrono::milliseconds const timeout = process_timeout) const
+            -> AsyncResult<std::vector<ProcessInfo>>;
+
+        /*!
+            \brief Captures the screen without blocking
+            \return frame holding the pooled device pixels
+        */
+        auto capture_async(std::chrono::milliseconds const timeout = process_timeout) -> AsyncResult<Frame>;
+
       private:
+        struct ScreenLayout
+        {
+            size_t header;
+            uint32_t width;
+            uint32_t height;
+            PixelFormat format;
+        };
+
         uint16_t vm_index;
-        std::vector<uint8_t> image_buffer;
+        VMConfig config;
+        bool stop_on_exit;
+        std::shared_ptr<FramePool> frame_pool;
+        FrameBuffer image_buffer;
+        std::unique_ptr<ShellSession> shell_session;
+        std::unique_ptr<AdbClient> adb_client;
+        std::unique_ptr<internal::CaptureWorker> capture_worker;
+        std::unique_ptr<AppMonitor> monitor;
+        std::optional<ScreenLayout> screen_layout;
+        std::optional<TouchDevice> touch_screen;
+        std::shared_ptr<FrameRecorder> frame_recorder;
+        std::unique_ptr<FrameExporter> frame_exporter;
+        // Serializes the recorder and the exporter (single writer of the ring) of the worker and caller captures
+        std::mutex hook_mutex;
+        mutable std::shared_ptr<EventLoop> event_loop;
+
+        // Initial size of the output buffer of the asynchronous text commands
+        static size_t constexpr text_output_size = 4096;
+
+        auto loop() const -> EventLoop&;
+
+        /*!
+            \brief Returns the config values of the VM that differ from the config (read in parallel)
+        */
+        auto changed_config() -> std::vector<std::pair<std::string, std::string>>;
+
+        auto set_config(std::string_view const key, std::string_view const value) -> void;
+
+        auto shell_input(std::string_view const command) -> void;
+
+        /*!
+            \brief Runs the input command through the shell session, the adb server or memuc
+        */
+        auto send_input(std::vector<std::string> const& arguments) -> void;
+
+        /*!
+            \brief Runs the device command through the shell session, the adb server or memuc
+            \return output of the device (without the memuc banner)
+        */
+        auto shell_output(std::vector<std::string> const& arguments) -> std::string;
+
+        /*!
+            \brief Runs the binary device command through the adb server or memuc
+            \return output of the device (without the memuc banner)
+        */
+        auto exec_out(std::vector<std::string> const& arguments, FrameBuffer& buffer) const -> std::span<uint8_t const>;
+
+        auto read_screen() -> std::tuple<Frame, ScreenLayout>;
     };
 } // namespace memucpp
\ No newline at end of file
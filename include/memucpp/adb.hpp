@@ -0,0 +1,98 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        class Socket;
+    } // namespace internal
+
+    struct AdbOptions
+    {
+        std::string host;
+        uint16_t port;
+        // Number of the idle connections kept with the transport already selected
+        uint32_t connections;
+        std::chrono::milliseconds timeout;
+
+        static auto Default() -> AdbOptions
+        {
+            return AdbOptions{
+                .host = "127.0.0.1", .port = 5037, .connections = 2, .timeout = std::chrono::seconds(10)};
+        }
+    };
+
+    struct AdbStats
+    {
+        uint64_t requests;
+        uint64_t connections;
+        uint64_t reuses;
+    };
+
+    /*!
+        \brief Client of the adb server smart socket protocol, talks to the device without memuc and adb processes
+
+        Every request is sent over the connection that already selected the device with host:transport,
+        the pool opens the replacement connection right after the request.
+    */
+    class AdbClient
+    {
+      public:
+        /*!
+            \param serial the device serial (e.g. 127.0.0.1:21503)
+            \param options the address of the adb server, pool size and request timeout
+        */
+        AdbClient(std::string serial, AdbOptions const& options = AdbOptions::Default());
+
+        ~AdbClient();
+
+        AdbClient(AdbClient const&) = delete;
+
+        auto operator=(AdbClient const&) -> AdbClient& = delete;
+
+        /*!
+            \brief Returns the serial of the MEmu VM (the adb port grows by 10 with the VM index)
+        */
+        static auto vm_serial(uint16_t const vm_index) -> std::string;
+
+        /*!
+            \brief Runs the command with the shell: service
+            \return output of the command
+        */
+        auto shell(std::string_view const command) -> std::string;
+
+        /*!
+            \brief Runs the command with the exec: service (binary output, no terminal)
+            \param output the reusable output buffer (grows when needed, never shrinks)
+            \return number of bytes written into the output
+        */
+        auto exec(std::string_view const command, std::vector<uint8_t>& output) -> size_t;
+
+        auto serial() const -> std::string_view;
+
+        auto stats() const -> AdbStats;
+
+      private:
+        std::string device_serial;
+        AdbOptions options;
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<internal::Socket>> idle;
+        AdbStats counters;
+
+        auto connect() -> std::unique_ptr<internal::Socket>;
+
+        auto open(std::string_view const service) -> std::unique_ptr<internal::Socket>;
+
+        auto refill() -> void;
+    };
+} // namespace memucpp
@@ -0,0 +1,246 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "pool.hpp"
+
+namespace memucpp
+{
+    class EventLoop;
+
+    namespace internal
+    {
+        class EventLoopThread;
+
+        /*!
+            \brief Shared state of the asynchronous command (completed on the event loop thread)
+        */
+        template <typename Type>
+        class AsyncState
+        {
+          public:
+            using Value = std::conditional_t<std::is_void_v<Type>, std::monostate, Type>;
+
+            std::weak_ptr<EventLoop> loop;
+            uint64_t command_id = 0;
+
+            auto set_value(Value&& value) -> void
+            {
+                std::unique_lock lock(mutex);
+                result.emplace(std::move(value));
+                complete(lock);
+            }
+
+            auto set_exception(std::exception_ptr const exception) -> void
+            {
+                std::unique_lock lock(mutex);
+                failure = exception;
+                complete(lock);
+            }
+
+            auto ready() const -> bool
+            {
+                std::lock_guard lock(mutex);
+                return done;
+            }
+
+            auto wait() -> void
+            {
+                std::unique_lock lock(mutex);
+                finished.wait(lock, [&]() { return done; });
+            }
+
+            template <typename Rep, typename Period>
+            auto wait_for(std::chrono::duration<Rep, Period> const timeout) -> bool
+            {
+                std::unique_lock lock(mutex);
+                return finished.wait_for(lock, timeout, [&]() { return done; });
+            }
+
+            /*!
+                \brief Stores the coroutine to resume on completion
+                \return false if the command is already completed (the coroutine continues at once)
+            */
+            auto suspend(std::coroutine_handle<> const handle) -> bool
+            {
+                std::lock_guard lock(mutex);
+                if (done)
+                {
+                    return false;
+                }
+                continuation = handle;
+                return true;
+            }
+
+            auto take() -> Type
+            {
+                wait();
+                if (failure)
+                {
+                    std::rethrow_exception(failure);
+                }
+                if constexpr (!std::is_void_v<Type>)
+                {
+                    return std::move(*result);
+                }
+            }
+
+          private:
+            mutable std::mutex mutex;
+            std::condition_variable finished;
+            bool done = false;
+            std::optional<Value> result;
+            std::exception_ptr failure;
+            std::coroutine_handle<> continuation;
+
+            auto complete(std::unique_lock<std::mutex>& lock) -> void
+            {
+                done = true;
+                auto const handle = std::exchange(continuation, nullptr);
+                lock.unlock();
+
+                finished.notify_all();
+                if (handle)
+                {
+                    handle.resume();
+                }
+            }
+        };
+    } // namespace internal
+
+    /*!
+        \brief Result of the asynchronous command, can be waited like the future or awaited in the coroutine
+        \details The awaiting coroutine resumes on the thread of the event loop
+    */
+    template <typename Type>
+    class AsyncResult
+    {
+      public:
+        AsyncResult(std::shared_ptr<internal::AsyncState<Type>> state) : state(std::move(state))
+        {
+        }
+
+        /*!
+            \brief Waits for the result (rethrows the exception of the command)
+        */
+        auto get() -> Type
+        {
+            return state->take();
+        }
+
+        auto ready() const -> bool
+        {
+            return state->ready();
+        }
+
+        template <typename Rep, typename Period>
+        auto wait_for(std::chrono::duration<Rep, Period> const timeout) const -> bool
+        {
+            return state->wait_for(timeout);
+        }
+
+        /*!
+            \brief Kills the process of the command, the result gets the error
+        */
+        auto cancel() -> void;
+
+        auto await_ready() const -> bool
+        {
+            return state->ready();
+        }
+
+        auto await_suspend(std::coroutine_handle<> const handle) -> bool
+        {
+            return state->suspend(handle);
+        }
+
+        auto await_resume() -> Type
+        {
+            return state->take();
+        }
+
+      private:
+        std::shared_ptr<internal::AsyncState<Type>> state;
+    };
+
+    struct EventLoopStats
+    {
+        size_t in_flight;
+        uint64_t started;
+        uint64_t completed;
+        uint64_t timed_out;
+        uint64_t cancelled;
+    };
+
+    /*!
+        \brief Thread that runs many child processes at once, watching their pipes (epoll on Linux)
+    */
+    class EventLoop : public std::enable_shared_from_this<EventLoop>
+    {
+      public:
+        /*!
+            \brief Called on the loop thread with the exit code and the size of the output, or with the exception
+        */
+        using Completion = std::move_only_function<void(std::exception_ptr, int32_t exit_code, size_t size)>;
+
+        static auto Create() -> std::shared_ptr<EventLoop>;
+
+        /*!
+            \brief Returns the loop used by default by every Memuc
+        */
+        static auto Shared() -> std::shared_ptr<EventLoop>;
+
+        ~EventLoop();
+
+        EventLoop(EventLoop const&) = delete;
+
+        auto operator=(EventLoop const&) -> EventLoop& = delete;
+
+        /*!
+            \brief Starts the process without waiting for it
+            \param arguments executable path followed by its arguments
+            \param output the buffer that receives the standard output (grown when full)
+            \param timeout time after which the process is killed (milliseconds::max() never kills)
+            \param completion the function to call when the process exits
+            \return the identifier of the command for cancel()
+        */
+        auto start(std::vector<std::string> arguments, FrameBuffer output, std::chrono::milliseconds const timeout,
+                   Completion completion) -> uint64_t;
+
+        /*!
+            \brief Kills the process of the command (no-op if it is already completed)
+        */
+        auto cancel(uint64_t const command_id) -> void;
+
+        auto stats() const -> EventLoopStats;
+
+      private:
+        std::unique_ptr<internal::EventLoopThread> thread;
+
+        EventLoop();
+    };
+
+    template <typename Type>
+    auto AsyncResult<Type>::cancel() -> void
+    {
+        if (auto loop = state->loop.lock())
+        {
+            loop->cancel(state->command_id);
+        }
+    }
+} // namespace memucpp
@@ -0,0 +1,86 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "frame.hpp"
+
+namespace memucpp
+{
+    struct DiffOptions
+    {
+        uint32_t tile_size;
+
+        static auto Default() -> DiffOptions
+        {
+            return {.tile_size = 32};
+        }
+    };
+
+    /*!
+        \brief Changes of the frame since the previous one
+    */
+    struct FrameDiff
+    {
+        bool changed;
+        std::vector<Rect> regions;
+        uint32_t changed_tiles;
+        uint32_t tiles;
+
+        /*!
+            \brief Returns true if any changed region overlaps the rectangle
+        */
+        auto changed_in(Rect const& rect) const -> bool
+        {
+            for (auto const& region : regions)
+            {
+                if (region.intersects(rect))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    /*!
+        \brief Finds the changed tiles of the successive frames by comparing the hashes of the tiles
+    */
+    class FrameDiffer
+    {
+      public:
+        FrameDiffer(DiffOptions const& options = DiffOptions::Default());
+
+        /*!
+            \brief Hashes the tiles of the frame and compares them with the previous frame
+            \param frame the frame of any format (the first frame and the resized frames are changed entirely)
+            \return changed regions (adjacent changed tiles are merged into rectangles)
+        */
+        auto update(Frame const& frame) -> FrameDiff const&;
+
+        /*!
+            \brief Forgets the previous frame
+        */
+        auto reset() -> void;
+
+        /*!
+            \brief Returns the hashes of the tiles of the last frame (row by row)
+        */
+        auto hashes() const -> std::span<uint64_t const>;
+
+      private:
+        DiffOptions options;
+        uint32_t width;
+        uint32_t height;
+        PixelFormat format;
+        std::vector<uint64_t> tile_hashes;
+        std::vector<std::array<uint64_t, 4>> lanes;
+        std::vector<size_t> previous_runs;
+        std::vector<size_t> runs;
+        FrameDiff diff;
+    };
+} // namespace memucpp
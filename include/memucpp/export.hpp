@@ -0,0 +1,132 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "frame.hpp"
+
+namespace memucpp
+{
+    namespace internal
+    {
+        class MappedFile;
+    } // namespace internal
+
+    struct FrameExportOptions
+    {
+        // Number of the frames kept in the ring (a reader has slots - 1 newer frames of time to use its frame)
+        uint32_t slots;
+
+        static auto Default() -> FrameExportOptions
+        {
+            return FrameExportOptions{.slots = 4};
+        }
+    };
+
+    /*!
+        \brief Frame mapped from the shared memory ring
+    */
+    struct SharedFrame
+    {
+        uint64_t sequence;
+        std::chrono::steady_clock::time_point timestamp;
+        // Pixels view the slot of the ring, FrameReader::valid tells whether the slot was reused since
+        Frame frame;
+    };
+
+    /*!
+        \brief Publishes the frames into the named shared memory ring (single producer)
+
+        Every slot carries a sequence number that is odd while the slot is written, so the readers detect
+        the torn and the reused slots without locks and the writer never waits for them.
+    */
+    class FrameExporter
+    {
+      public:
+        /*!
+            \brief Creates the shared memory (the ring of the previous exporter of the name is replaced)
+            \param name the name of the shared memory (FrameExporter::vm_name for the VM)
+            \param frame_size maximum size of the frame pixels
+        */
+        FrameExporter(std::string_view const name, size_t const frame_size,
+                      FrameExportOptions const& options = FrameExportOptions::Default());
+
+        /*!
+            \brief Removes the name of the shared memory (the readers keep their mappings)
+        */
+        ~FrameExporter();
+
+        FrameExporter(FrameExporter const&) = delete;
+
+        auto operator=(FrameExporter const&) -> FrameExporter& = delete;
+
+        /*!
+            \brief Copies the frame into the next slot and publishes it (the rows are packed)
+            \return sequence number of the frame
+        */
+        auto publish(Frame const& frame) -> uint64_t;
+
+        /*!
+            \brief Returns the name of the shared memory ring of the VM
+        */
+        static auto vm_name(uint16_t const vm_index) -> std::string;
+
+      private:
+        std::string name;
+        std::unique_ptr<internal::MappedFile> memory;
+        uint64_t next_sequence;
+    };
+
+    /*!
+        \brief Maps the frames of the exporter in the other process without copies
+    */
+    class FrameReader
+    {
+      public:
+        /*!
+            \brief Opens the ring, the first call of next returns the newest frame
+            \param name the name of the shared memory
+        */
+        FrameReader(std::string_view const name);
+
+        ~FrameReader();
+
+        FrameReader(FrameReader const&) = delete;
+
+        auto operator=(FrameReader const&) -> FrameReader& = delete;
+
+        /*!
+            \brief Returns the newest published frame or std::nullopt before the first one
+        */
+        auto latest() const -> std::optional<SharedFrame>;
+
+        /*!
+            \brief Returns the frame after the one returned before, the overwritten frames are skipped
+            \return frame or std::nullopt if no newer frame is published
+        */
+        auto next() -> std::optional<SharedFrame>;
+
+        /*!
+            \brief Returns true if the slot of the frame was not reused (check it after the pixels are used)
+        */
+        auto valid(SharedFrame const& frame) const -> bool;
+
+        /*!
+            \brief Returns the number of the frames skipped by next because the writer overwrote them
+        */
+        auto dropped() const -> uint64_t;
+
+      private:
+        std::unique_ptr<internal::MappedFile> memory;
+        uint64_t cursor;
+        uint64_t skipped;
+
+        auto read(uint64_t const sequence) const -> std::optional<SharedFrame>;
+    };
+} // namespace memucpp
@@ -0,0 +1,164 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "memucpp.hpp"
+
+namespace memucpp
+{
+    namespace internal
+    {
+        class FleetScheduler;
+    } // namespace internal
+
+    struct FleetOptions
+    {
+        // Number of the worker threads (0 is the number of the hardware threads)
+        uint32_t threads;
+
+        static auto Default() -> FleetOptions
+        {
+            return FleetOptions{.threads = 0};
+        }
+    };
+
+    struct FleetStats
+    {
+        uint32_t machines;
+        uint32_t threads;
+        size_t queued;
+        size_t running;
+        uint64_t submitted;
+        uint64_t completed;
+        uint64_t failed;
+        uint64_t steals;
+        std::chrono::steady_clock::duration uptime;
+        // Completed commands per second since the fleet was created
+        double throughput;
+    };
+
+    /*!
+        \brief Runs the commands of many VMs on the shared worker pool
+        \details The commands of one VM run one by one in the submission order, different VMs run in parallel
+    */
+    class Fleet
+    {
+      public:
+        /*!
+            \param vm_indices the VMs of the fleet (Memuc instances are created in parallel)
+            \param config the config of every VM
+            \param options the size of the worker pool
+        */
+        Fleet(std::span<uint16_t const> const vm_indices, VMConfig const& config,
+              FleetOptions const& options = FleetOptions::Default());
+
+        ~Fleet();
+
+        Fleet(Fleet const&) = delete;
+
+        auto operator=(Fleet const&) -> Fleet& = delete;
+
+        /*!
+            \brief Queues the command of the VM
+            \param vm_index the VM of the fleet
+            \param function callable that takes Memuc&
+            \return future of the function result (holds the thrown exception)
+        */
+        template <typename Function>
+        auto submit(uint16_t const vm_index, Function&& function)
+            -> std::future<std::invoke_result_t<std::decay_t<Function>&, Memuc&>>
+        {
+            using Result = std::invoke_result_t<std::decay_t<Function>&, Memuc&>;
+
+            std::promise<Result> promise;
+            auto future = promise.get_future();
+
+            enqueue(vm_index, [promise = std::move(promise),
+                               function = std::forward<Function>(function)](Memuc& memuc) mutable -> bool {
+                try
+                {
+                    if constexpr (std::is_void_v<Result>)
+                    {
+                        function(memuc);
+                        promise.set_value();
+                    }
+                    else
+                    {
+                        promise.set_value(function(memuc));
+                    }
+                    return true;
+                }
+                catch (...)
+                {
+                    promise.set_exception(std::current_exception());
+                    return false;
+                }
+            });
+            return future;
+        }
+
+        /*!
+            \brief Queues the command of every VM
+            \return futures in the order of vm_indices()
+        */
+        template <typename Function>
+        auto broadcast(Function const& function)
+            -> std::vector<std::future<std::invoke_result_t<Function const&, Memuc&>>>
+        {
+            std::vector<std::future<std::invoke_result_t<Function const&, Memuc&>>> futures;
+            futures.reserve(indices.size());
+
+            for (uint16_t const vm_index : indices)
+            {
+                futures.push_back(submit(vm_index, function));
+            }
+            return futures;
+        }
+
+        /*!
+            \brief Starts the application on every VM
+        */
+        auto start_app(std::string_view const package_name) -> std::vector<std::future<void>>;
+
+        /*!
+            \brief Stops the application on every VM
+        */
+        auto stop_app(std::string_view const package_name) -> std::vector<std::future<void>>;
+
+        /*!
+            \brief Captures the screen of every VM
+        */
+        auto capture() -> std::vector<std::future<Frame>>;
+
+        /*!
+            \brief Waits until every queued command is completed
+        */
+        auto wait() -> void;
+
+        /*!
+            \brief Returns the number of the queued (not started) commands of the VM
+        */
+        auto queue_depth(uint16_t const vm_index) const -> size_t;
+
+        auto stats() const -> FleetStats;
+
+        auto vm_indices() const -> std::span<uint16_t const>;
+
+      private:
+        std::vector<uint16_t> indices;
+        std::unique_ptr<internal::FleetScheduler> scheduler;
+
+        auto enqueue(uint16_t const vm_index, std::move_only_function<bool(Memuc&)> command) -> void;
+    };
+} // namespace memucpp
@@ -0,0 +1,161 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "pool.hpp"
+
+namespace memucpp
+{
+    enum class PixelFormat : uint32_t
+    {
+        RGBA8888,
+        RGBX8888,
+        BGRA8888,
+        RGB565,
+        BGR888,
+        Gray8
+    };
+
+    /*!
+        \brief Returns the number of bytes of the one pixel
+    */
+    constexpr auto bytes_per_pixel(PixelFormat const format) -> uint32_t
+    {
+        switch (format)
+        {
+            case PixelFormat::RGB565:
+                return 2;
+            case PixelFormat::BGR888:
+                return 3;
+            case PixelFormat::Gray8:
+                return 1;
+            default:
+                return 4;
+        }
+    }
+
+    /*!
+        \brief Returns the size of the 24 bit bitmap image (BMP format) with the rows aligned to 4 bytes
+    */
+    constexpr auto bmp_size(uint32_t const width, uint32_t const height) -> size_t
+    {
+        return 54 + static_cast<size_t>((width * 3 + 3) & ~3u) * height;
+    }
+
+    /*!
+        \brief Rectangle in the pixels of the frame
+    */
+    struct Rect
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+
+        auto intersects(Rect const& other) const -> bool
+        {
+            return x < other.x + other.width && other.x < x + width && y < other.y + other.height &&
+                   other.y < y + height;
+        }
+
+        auto operator==(Rect const&) const -> bool = default;
+    };
+
+    /*!
+        \brief View of the pixels (top-down rows), the buffer keeps the pooled pixels alive
+    */
+    struct Frame
+    {
+        std::span<uint8_t const> data;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        PixelFormat format;
+        FrameBuffer buffer;
+
+        /*!
+            \brief Returns the pixels of the row
+            \param y the row index (0 is top)
+        */
+        auto row(uint32_t const y) const -> std::span<uint8_t const>
+        {
+            return data.subspan(static_cast<size_t>(y) * stride, static_cast<size_t>(width) * bytes_per_pixel(format));
+        }
+    };
+
+    /*!
+        \brief Frame of the screen region, optionally downscaled
+    */
+    struct RegionFrame
+    {
+        Frame frame;
+        Rect region;
+        uint32_t factor;
+
+        /*!
+            \brief Maps the position in the frame to the screen position (center of the downscaled pixel)
+        */
+        auto to_screen(std::tuple<uint32_t, uint32_t> const position) const -> std::tuple<uint32_t, uint32_t>
+        {
+            return {region.x + std::get<0>(position) * factor + factor / 2,
+                    region.y + std::get<1>(position) * factor + factor / 2};
+        }
+
+        /*!
+            \brief Maps the rectangle in the frame to the screen rectangle
+        */
+        auto to_screen(Rect const& rect) const -> Rect
+        {
+            return Rect{.x = region.x + rect.x * factor,
+                        .y = region.y + rect.y * factor,
+                        .width = rect.width * factor,
+                        .height = rect.height * factor};
+        }
+    };
+
+    /*!
+        \brief Encodes the frame into the bitmap image (BMP format, 24 bit)
+        \param frame the RGBA8888 or RGBX8888 frame
+        \param output the reusable output buffer
+        \return span of the bitmap image inside the output buffer
+    */
+    auto encode_bmp(Frame const& frame, std::vector<uint8_t>& output) -> std::span<uint8_t const>;
+
+    /*!
+        \brief Decodes the bitmap image (BMP format, 24 or 32 bit, e.g. the result of screen_cap)
+        \param bitmap the bytes of the image
+        \param output the reusable output buffer
+        \return top-down BGR888 frame inside the output buffer
+    */
+    auto decode_bmp(std::span<uint8_t const> const bitmap, std::vector<uint8_t>& output) -> Frame;
+
+    /*!
+        \brief Converts the frame into packed BGR888 pixels
+        \param frame the RGBA8888 or RGBX8888 frame
+        \param output the reusable output buffer
+        \return BGR888 frame inside the output buffer
+    */
+    auto encode_bgr(Frame const& frame, std::vector<uint8_t>& output) -> Frame;
+
+    /*!
+        \brief Converts the frame into 8 bit luminance (BT.601)
+        \param frame the RGBA8888, RGBX8888 or BGRA8888 frame
+        \param output the reusable output buffer
+        \return Gray8 frame inside the output buffer
+    */
+    auto encode_grayscale(Frame const& frame, std::vector<uint8_t>& output) -> Frame;
+
+    /*!
+        \brief Downscales the frame by averaging factor x factor blocks
+        \param frame the frame with 4 or 1 byte pixels
+        \param factor the integer scale factor
+        \param output the reusable output buffer
+        \return frame of the same format inside the output buffer
+    */
+    auto downscale(Frame const& frame, uint32_t const factor, std::vector<uint8_t>& output) -> Frame;
+} // namespace memucpp
@@ -0,0 +1,128 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace memucpp
+{
+    struct GestureOptions
+    {
+        // Interval between the moves of the swipe
+        std::chrono::milliseconds move_interval;
+        // Press time of the tap
+        std::chrono::milliseconds tap_duration;
+
+        static auto Default() -> GestureOptions
+        {
+            return GestureOptions{.move_interval = std::chrono::milliseconds(10),
+                                  .tap_duration = std::chrono::milliseconds(40)};
+        }
+    };
+
+    /*!
+        \brief Touch screen of the device (found by getevent -p)
+    */
+    struct TouchDevice
+    {
+        std::string path;
+        // Maximum values of the position axes
+        uint32_t max_x;
+        uint32_t max_y;
+        // Screen size the positions of the script are given in
+        uint32_t screen_width;
+        uint32_t screen_height;
+        // Number of the multi-touch slots (0 is the device without slots, protocol A)
+        uint32_t slots;
+        // Size of struct input_event in the device userspace (16 on 32 bit, 24 on 64 bit)
+        uint32_t event_size;
+
+        auto operator==(TouchDevice const&) const -> bool = default;
+    };
+
+    /*!
+        \brief Path of the one finger
+    */
+    struct TouchStroke
+    {
+        // Positions of the screen passed at the constant speed (one position is the hold)
+        std::vector<std::tuple<uint32_t, uint32_t>> path;
+        // Time from the start of the step to the press
+        std::chrono::milliseconds start;
+        // Time from the press to the release
+        std::chrono::milliseconds duration;
+    };
+
+    /*!
+        \brief Device side batch of the script, one shell command that writes the events into the touch screen
+    */
+    struct CompiledGesture
+    {
+        TouchDevice device;
+        std::string command;
+        std::chrono::milliseconds duration;
+        // Number of the event reports (SYN_REPORT) written by the command
+        uint32_t reports;
+    };
+
+    /*!
+        \brief Sequence of the taps, swipes, holds, waits and multi-touch steps played one after another
+
+        The script does not depend on the VM, it is compiled for the touch screen once and the compiled
+        gesture is reused by every VM with the same touch screen.
+    */
+    class GestureScript
+    {
+      public:
+        GestureScript(GestureOptions const& options = GestureOptions::Default());
+
+        auto tap(std::tuple<uint32_t, uint32_t> const position) -> GestureScript&;
+
+        /*!
+            \brief Presses the position for the duration (long press)
+        */
+        auto hold(std::tuple<uint32_t, uint32_t> const position, std::chrono::milliseconds const duration)
+            -> GestureScript&;
+
+        /*!
+            \brief Moves one finger through the positions
+            \param path at least two positions of the screen
+            \param duration time from the press to the release
+        */
+        auto swipe(std::vector<std::tuple<uint32_t, uint32_t>> path, std::chrono::milliseconds const duration)
+            -> GestureScript&;
+
+        auto wait(std::chrono::milliseconds const duration) -> GestureScript&;
+
+        /*!
+            \brief Plays the strokes at once (e.g. pinch), the next step starts after the last release
+        */
+        auto touch(std::vector<TouchStroke> strokes) -> GestureScript&;
+
+        /*!
+            \brief Returns the time of the whole script
+        */
+        auto duration() const -> std::chrono::milliseconds;
+
+        /*!
+            \brief Compiles the script into the events of the touch screen
+            \param device the touch screen (Memuc::touch_device)
+            \return one shell command that plays the whole script
+        */
+        auto compile(TouchDevice const& device) const -> CompiledGesture;
+
+      private:
+        struct Step
+        {
+            std::vector<TouchStroke> strokes;
+            std::chrono::milliseconds duration;
+        };
+
+        GestureOptions options;
+        std::vector<Step> steps;
+    };
+} // namespace memucpp
@@ -0,0 +1,114 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+#include "frame.hpp"
+
+namespace memucpp
+{
+    enum class MatchMethod : uint32_t
+    {
+        // Sum of the absolute differences (fastest, sensitive to the brightness)
+        SAD,
+        // Normalized cross-correlation (tolerates the brightness and the contrast changes)
+        NCC
+    };
+
+    struct MatchOptions
+    {
+        MatchMethod method;
+        double threshold;
+        uint32_t pyramid_levels;
+        uint32_t candidates;
+
+        static auto Default() -> MatchOptions
+        {
+            return {.method = MatchMethod::NCC, .threshold = 0.9, .pyramid_levels = 2, .candidates = 4};
+        }
+    };
+
+    struct Match
+    {
+        Rect rect;
+        double score;
+
+        /*!
+            \brief Returns the center of the match (position for trigger_click)
+        */
+        auto center() const -> std::tuple<uint32_t, uint32_t>
+        {
+            return {rect.x + rect.width / 2, rect.y + rect.height / 2};
+        }
+    };
+
+    /*!
+        \brief Image to search for with the precomputed pyramid
+    */
+    class Template
+    {
+        friend class TemplateMatcher;
+
+      public:
+        /*!
+            \brief Copies the pixels of the template
+            \param frame the frame with 4 byte pixels
+            \param pyramid_levels number of the downscaled copies (each is half of the previous one)
+        */
+        Template(Frame const& frame, uint32_t const pyramid_levels = 2);
+
+        /*!
+            \brief Copies the part of the frame (e.g. the button cut out of the captured screen)
+        */
+        Template(Frame const& frame, Rect const& rect, uint32_t const pyramid_levels = 2);
+
+        auto width() const -> uint32_t;
+
+        auto height() const -> uint32_t;
+
+        auto format() const -> PixelFormat;
+
+      private:
+        struct Level
+        {
+            std::vector<uint8_t> pixels;
+            uint32_t width;
+            uint32_t height;
+            uint64_t sum;
+            uint64_t squares;
+        };
+
+        PixelFormat pixel_format;
+        std::vector<Level> levels;
+    };
+
+    /*!
+        \brief Finds the templates on the frames (coarse-to-fine search over the image pyramid)
+    */
+    class TemplateMatcher
+    {
+      public:
+        TemplateMatcher(MatchOptions const& options = MatchOptions::Default());
+
+        /*!
+            \brief Finds the best match of the template
+            \param frame the frame of the same channel order as the template (is not copied)
+            \param pattern the template to search for
+            \param region the region of interest (the whole frame if not set)
+            \return the best match if the score reaches the threshold
+        */
+        auto find(Frame const& frame, Template const& pattern, std::optional<Rect> const& region = std::nullopt)
+            -> std::optional<Match>;
+
+        auto options() const -> MatchOptions const&;
+
+      private:
+        MatchOptions match_options;
+        std::vector<std::vector<uint8_t>> pyramid;
+        std::vector<float> scores;
+    };
+} // namespace memucpp
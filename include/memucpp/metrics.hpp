@@ -0,0 +1,134 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace memucpp
+{
+    enum class Metric : uint32_t
+    {
+        // Memuc commands
+        ListVms,
+        Reboot,
+        StartApp,
+        StopApp,
+        TriggerKey,
+        TriggerSwipe,
+        TriggerClick,
+        ListProcess,
+        Capture,
+        CaptureRegion,
+        ScreenCap,
+        Provision,
+        BootWait,
+        ConfigRead,
+        Gesture,
+        StateWait,
+        // Internal stages
+        ProcessSpawn,
+        PipeTransfer,
+        ProcessWait,
+        TextDecode,
+        BmpEncode,
+        Downscale,
+        AdbRequest,
+        Count
+    };
+
+    /*!
+        \brief Returns the snake case name of the metric (e.g. trigger_click)
+    */
+    auto metric_name(Metric const metric) -> std::string_view;
+
+    struct LatencyStats
+    {
+        // Bucket k counts the durations of [2^k, 2^(k+1)) nanoseconds
+        static size_t constexpr bucket_count = 40;
+
+        uint64_t count;
+        uint64_t errors;
+        uint64_t bytes;
+        std::chrono::nanoseconds total;
+        std::chrono::nanoseconds max;
+        std::array<uint64_t, bucket_count> buckets;
+
+        auto mean() const -> std::chrono::nanoseconds;
+
+        /*!
+            \brief Returns the upper bound of the bucket holding the percentile
+            \param fraction the percentile (0.5 is median)
+        */
+        auto percentile(double const fraction) const -> std::chrono::nanoseconds;
+
+        auto merge(LatencyStats const& other) -> void;
+    };
+
+    struct MetricsEntry
+    {
+        Metric metric;
+        // Commands without the VM (e.g. list_vms of the other thread) have no index
+        std::optional<uint16_t> vm_index;
+        LatencyStats stats;
+    };
+
+    struct MetricsSnapshot
+    {
+        std::vector<MetricsEntry> entries;
+        // Time since the metrics were enabled or reset
+        std::chrono::steady_clock::duration elapsed;
+
+        /*!
+            \brief Returns the stats of the metric summed over the VMs
+        */
+        auto total(Metric const metric) const -> LatencyStats;
+
+        /*!
+            \brief Returns the completed operations per second
+        */
+        auto throughput(Metric const metric) const -> double;
+    };
+
+    /*!
+        \brief Latency histograms, byte and error counters of the commands and the internal stages
+
+        Counters are relaxed atomics kept per metric and per VM, so the collection never takes a lock.
+        Disabled metrics cost one atomic load per operation.
+    */
+    class Metrics
+    {
+      public:
+        /*!
+            \brief Enables the collection of the counters (disabled is default)
+        */
+        static auto enable(bool const enabled) -> void;
+
+        static auto enabled() -> bool;
+
+        static auto snapshot() -> MetricsSnapshot;
+
+        /*!
+            \brief Clears the counters
+        */
+        static auto reset() -> void;
+
+        /*!
+            \brief Starts recording every operation as the trace event (takes a lock per event)
+            \param capacity maximum number of the kept events (the newer events are dropped)
+        */
+        static auto start_trace(size_t const capacity = 1 << 20) -> void;
+
+        static auto stop_trace() -> void;
+
+        /*!
+            \brief Writes the recorded events in the Chrome trace event format (chrome://tracing, Perfetto)
+        */
+        static auto write_trace(std::ostream& stream) -> void;
+    };
+} // namespace memucpp
@@ -0,0 +1,155 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace memucpp
+{
+    enum class AppEventType : uint32_t
+    {
+        Started,
+        Died,
+        Crashed,
+        NotResponding
+    };
+
+    struct AppEvent
+    {
+        AppEventType type;
+        int32_t pid;
+        std::string name;
+        // Exception class of the crash or reason of the ANR (empty for the other events)
+        std::string detail;
+        std::chrono::system_clock::time_point time;
+    };
+
+    struct AppProcess
+    {
+        int32_t pid;
+        std::string name;
+        // Fields of the ps snapshot, the processes started after it have ppid -1, rss 0 and state '?'
+        // (the events carry no parent and memory)
+        int32_t ppid;
+        // Resident set size in KiB
+        uint64_t rss;
+        char state;
+    };
+
+    struct AppMonitorOptions
+    {
+        // Delay before the dropped channel is opened again
+        std::chrono::milliseconds reconnect_delay;
+
+        static auto Default() -> AppMonitorOptions
+        {
+            return AppMonitorOptions{.reconnect_delay = std::chrono::seconds(1)};
+        }
+    };
+
+    struct AppMonitorStats
+    {
+        uint64_t events;
+        uint64_t connections;
+    };
+
+    using AppEventHandler = std::function<void(AppEvent const&)>;
+
+    /*!
+        \brief Follows the process start, death, crash and ANR events of the device through one streaming channel
+
+        The channel takes one ps snapshot and then streams the activity manager events of logcat,
+        so the process table is kept up to date without polling. Handlers are called on the monitor thread.
+    */
+    class AppMonitor
+    {
+      public:
+        /*!
+            \brief Opens the channel on the background thread
+            \param command the shell command line (e.g. memuc -i 0 adb shell)
+            \param options the reconnect policy
+        */
+        AppMonitor(std::vector<std::string> command, AppMonitorOptions const& options = AppMonitorOptions::Default());
+
+        ~AppMonitor();
+
+        AppMonitor(AppMonitor const&) = delete;
+
+        auto operator=(AppMonitor const&) -> AppMonitor& = delete;
+
+        /*!
+            \brief Adds the event handler
+            \param name the process name to follow (empty follows all processes)
+            \return identifier of the subscription
+        */
+        auto subscribe(std::string_view const name, AppEventHandler handler) -> uint64_t;
+
+        auto unsubscribe(uint64_t const id) -> void;
+
+        /*!
+            \brief Returns the cached process table ordered by the process id
+        */
+        auto processes() const -> std::vector<AppProcess>;
+
+        /*!
+            \brief Returns true if the process is running according to the cached table
+        */
+        auto running(std::string_view const name) const -> bool;
+
+        /*!
+            \brief Returns true after the first process snapshot is loaded
+        */
+        auto ready() const -> bool;
+
+        /*!
+            \brief Waits for the first process snapshot
+            \return false on timeout
+        */
+        auto wait_ready(std::chrono::milliseconds const timeout) const -> bool;
+
+        auto stats() const -> AppMonitorStats;
+
+      private:
+        struct Subscription
+        {
+            uint64_t id;
+            std::string name;
+            std::shared_ptr<AppEventHandler> handler;
+        };
+
+        std::vector<std::string> command;
+        AppMonitorOptions options;
+
+        mutable std::mutex mutex;
+        mutable std::condition_variable_any loaded;
+        std::map<int32_t, AppProcess> table;
+        bool has_snapshot;
+        AppMonitorStats counters;
+
+        std::mutex subscription_mutex;
+        std::vector<Subscription> subscriptions;
+        uint64_t next_id;
+
+        std::jthread thread;
+
+        auto run(std::stop_token const stop_token) -> void;
+
+        auto stream(std::stop_token const stop_token) -> void;
+
+        auto apply_snapshot(std::map<int32_t, AppProcess> snapshot) -> void;
+
+        auto apply_event(AppEvent event) -> void;
+
+        auto publish(AppEvent const& event) -> void;
+    };
+} // namespace memucpp
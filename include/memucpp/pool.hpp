@@ -0,0 +1,130 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace memucpp
+{
+    /*!
+        \brief Reference-counted handle of the pooled buffer (returns to the pool with the last copy)
+    */
+    class FrameBuffer
+    {
+      public:
+        FrameBuffer() = default;
+
+        auto data() const -> uint8_t*
+        {
+            return handle->data();
+        }
+
+        auto size() const -> size_t
+        {
+            return handle->size();
+        }
+
+        /*!
+            \brief Returns the underlying storage (may be grown by the writer)
+        */
+        auto storage() const -> std::vector<uint8_t>&
+        {
+            return *handle;
+        }
+
+        auto use_count() const -> long
+        {
+            return handle.use_count();
+        }
+
+        explicit operator bool() const
+        {
+            return handle != nullptr;
+        }
+
+      private:
+        friend class FramePool;
+
+        std::shared_ptr<std::vector<uint8_t>> handle;
+
+        explicit FrameBuffer(std::shared_ptr<std::vector<uint8_t>> handle) : handle(std::move(handle))
+        {
+        }
+    };
+
+    struct PoolStats
+    {
+        size_t buffers;
+        size_t idle_buffers;
+        size_t bytes;
+        size_t in_use_bytes;
+        size_t peak_bytes;
+        size_t limit;
+        uint64_t reuses;
+        uint64_t allocations;
+        uint64_t rejections;
+    };
+
+    /*!
+        \brief Pool of the frame buffers shared between the Memuc instances
+    */
+    class FramePool : public std::enable_shared_from_this<FramePool>
+    {
+      public:
+        /*!
+            \brief Creates the pool
+            \param limit maximum number of bytes held by the pool (idle and in use)
+        */
+        static auto Create(size_t const limit = std::numeric_limits<size_t>::max()) -> std::shared_ptr<FramePool>;
+
+        /*!
+            \brief Returns the process wide pool used by default
+        */
+        static auto Shared() -> std::shared_ptr<FramePool>;
+
+        ~FramePool();
+
+        FramePool(FramePool const&) = delete;
+
+        auto operator=(FramePool const&) -> FramePool& = delete;
+
+        /*!
+            \brief Returns the buffer of at least the given size (recycled when possible)
+            \param size required size in bytes
+        */
+        auto acquire(size_t const size) -> FrameBuffer;
+
+        /*!
+            \brief Changes the memory limit (idle buffers above it are freed)
+        */
+        auto set_limit(size_t const limit) -> void;
+
+        /*!
+            \brief Frees all idle buffers
+        */
+        auto trim() -> void;
+
+        auto stats() const -> PoolStats;
+
+      private:
+        struct Entry
+        {
+            std::unique_ptr<std::vector<uint8_t>> storage;
+            size_t bytes;
+        };
+
+        mutable std::mutex mutex;
+        std::vector<Entry> idle;
+        PoolStats counters;
+
+        explicit FramePool(size_t const limit);
+
+        auto release(std::vector<uint8_t>* storage, size_t const bytes) -> void;
+
+        auto evict(size_t const required) -> void;
+    };
+} // namespace memucpp
@@ -0,0 +1,167 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "memucpp.hpp"
+
+namespace memucpp
+{
+    namespace internal
+    {
+        class MappedFile;
+    } // namespace internal
+
+    struct RecorderOptions
+    {
+        // Bytes of the frames and the input commands kept in the file (the oldest are overwritten)
+        uint64_t capacity;
+        // Number of the index entries (the records above it drop the oldest ones)
+        uint32_t index_size;
+
+        static auto Default() -> RecorderOptions
+        {
+            return RecorderOptions{.capacity = 256ull * 1024 * 1024, .index_size = 16 * 1024};
+        }
+    };
+
+    struct RecordedFrame
+    {
+        uint64_t sequence;
+        std::chrono::system_clock::time_point time;
+        // Pixels view the mapped file, they are valid while the replay is alive
+        Frame frame;
+    };
+
+    struct RecordedInput
+    {
+        uint64_t sequence;
+        std::chrono::system_clock::time_point time;
+        std::string command;
+    };
+
+    /*!
+        \brief Appends the raw frames and the input commands to the memory-mapped ring buffer file
+
+        The file is written in place and survives the crash of the process, the oldest records are
+        overwritten when the file is full.
+    */
+    class FrameRecorder
+    {
+      public:
+        /*!
+            \brief Creates the file (the old recording is discarded)
+            \param options size of the ring buffer and of its index
+        */
+        FrameRecorder(std::filesystem::path const& path, RecorderOptions const& options = RecorderOptions::Default());
+
+        ~FrameRecorder();
+
+        FrameRecorder(FrameRecorder const&) = delete;
+
+        auto operator=(FrameRecorder const&) -> FrameRecorder& = delete;
+
+        /*!
+            \brief Appends the pixels of the frame (the rows are packed)
+        */
+        auto record(Frame const& frame) -> void;
+
+        /*!
+            \brief Appends the input command issued to the VM
+        */
+        auto record_input(std::string_view const command) -> void;
+
+        /*!
+            \brief Returns the number of the records written since the file was created
+        */
+        auto records() const -> uint64_t;
+
+        /*!
+            \brief Writes the mapped pages to the disk
+        */
+        auto flush() -> void;
+
+      private:
+        std::unique_ptr<internal::MappedFile> file;
+        mutable std::mutex mutex;
+    };
+
+    /*!
+        \brief Reads the recording in place (the frames are not copied)
+    */
+    class FrameReplay
+    {
+      public:
+        FrameReplay(std::filesystem::path const& path);
+
+        ~FrameReplay();
+
+        FrameReplay(FrameReplay const&) = delete;
+
+        auto operator=(FrameReplay const&) -> FrameReplay& = delete;
+
+        /*!
+            \brief Returns the number of the frames kept in the file
+        */
+        auto frame_count() const -> size_t;
+
+        /*!
+            \brief Returns the frame in the order of the recording
+            \param index the frame index (0 is the oldest kept frame)
+        */
+        auto frame(size_t const index) const -> RecordedFrame;
+
+        /*!
+            \brief Returns the input commands kept in the file in the order of the recording
+        */
+        auto inputs() const -> std::vector<RecordedInput>;
+
+      private:
+        std::unique_ptr<internal::MappedFile> file;
+        // Index entries of the kept records in the order of the recording
+        std::vector<uint32_t> frame_entries;
+        std::vector<uint32_t> input_entries;
+    };
+
+    /*!
+        \brief Serves the recorded frames to the screen captures instead of the VM
+
+        Every screencap returns the next frame of the recording (the last one is repeated at the end, or the
+        replay starts over when it loops), the other commands succeed without effect (ps lists no processes)
+        and only the input commands and gestures are collected.
+    */
+    class ReplayBackend : public ProcessBackend
+    {
+      public:
+        ReplayBackend(std::shared_ptr<FrameReplay> replay, bool const loop = false);
+
+        auto execute(std::span<std::string const> const arguments, std::vector<uint8_t>& output,
+                     std::chrono::milliseconds const timeout) -> ProcessResult override;
+
+        /*!
+            \brief Returns true when every frame has been served
+        */
+        auto finished() const -> bool;
+
+        /*!
+            \brief Returns the input commands issued during the replay
+        */
+        auto inputs() const -> std::vector<std::string>;
+
+      private:
+        std::shared_ptr<FrameReplay> replay;
+        bool loop;
+        size_t position;
+        std::vector<std::string> issued;
+        mutable std::mutex mutex;
+    };
+} // namespace memucpp
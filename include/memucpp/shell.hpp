@@ -0,0 +1,91 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        class Process;
+    } // namespace internal
+
+    struct ShellOptions
+    {
+        std::chrono::milliseconds timeout;
+        uint32_t reconnect_attempts;
+
+        static auto Default() -> ShellOptions
+        {
+            return ShellOptions{.timeout = std::chrono::seconds(10), .reconnect_attempts = 1};
+        }
+    };
+
+    struct ShellResult
+    {
+        int32_t exit_code;
+        std::string output;
+    };
+
+    /*!
+        \brief Long-lived shell channel that runs commands through its standard input
+
+        Completion of every command is detected by a sentinel line carrying the exit status,
+        so a single shell process serves any number of commands.
+    */
+    class ShellSession
+    {
+      public:
+        /*!
+            \brief Creates the session (the shell is spawned on first use)
+            \param command the shell command line (e.g. memuc -i 0 adb shell)
+            \param options the command timeout and reconnect policy
+        */
+        ShellSession(std::vector<std::string> command, ShellOptions const& options = ShellOptions::Default());
+
+        ~ShellSession();
+
+        ShellSession(ShellSession const&) = delete;
+
+        auto operator=(ShellSession const&) -> ShellSession& = delete;
+
+        /*!
+            \brief Executes the command in the shell
+            \details The closed shell is reopened only if the command could not be sent, the shell that closes
+                     while the command runs throws (the command may have run already)
+            \param command the shell command
+            \return exit status and combined output of the command
+        */
+        auto execute(std::string_view const command) -> ShellResult;
+
+        /*!
+            \brief Closes the current shell, the next command opens a new one
+        */
+        auto disconnect() -> void;
+
+        /*!
+            \brief Returns true if the shell process is open
+        */
+        auto connected() const -> bool;
+
+      private:
+        std::vector<std::string> command;
+        ShellOptions options;
+        std::unique_ptr<internal::Process> process;
+        std::vector<uint8_t> buffer;
+        uint64_t sequence;
+        mutable std::mutex mutex;
+
+        auto connect() -> void;
+
+        auto run(std::string_view const command) -> std::optional<ShellResult>;
+    };
+} // namespace memucpp
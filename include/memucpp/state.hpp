@@ -0,0 +1,110 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frame.hpp"
+
+namespace memucpp
+{
+    struct StateIndexOptions
+    {
+        // Maximum Hamming distance of the match (bits of the 64 bit hash, averaged over the regions)
+        uint32_t max_distance;
+
+        static auto Default() -> StateIndexOptions
+        {
+            return {.max_distance = 10};
+        }
+    };
+
+    struct StateWaitOptions
+    {
+        // The interval doubles while the screen stays the same and drops back once it changes
+        std::chrono::milliseconds min_interval;
+        std::chrono::milliseconds max_interval;
+
+        static auto Default() -> StateWaitOptions
+        {
+            return {.min_interval = std::chrono::milliseconds(20), .max_interval = std::chrono::milliseconds(500)};
+        }
+    };
+
+    struct StateMatch
+    {
+        std::string label;
+        // Hamming distance averaged over the regions of the reference
+        uint32_t distance;
+        // 1 for the same hashes, 0 for the distance of the unrelated images (half of the bits)
+        double confidence;
+    };
+
+    /*!
+        \brief Returns the perceptual hash of the region (difference hash of the 9x8 luminance grid)
+        \param frame the frame of any format except RGB565
+        \param region the rectangle of the frame (clipped to the frame)
+    */
+    auto perceptual_hash(Frame const& frame, Rect const& region) -> uint64_t;
+
+    /*!
+        \brief Index of the known screens that classifies the frames by the Hamming distance of their hashes
+    */
+    class ScreenStateIndex
+    {
+      public:
+        ScreenStateIndex(StateIndexOptions const& options = StateIndexOptions::Default());
+
+        /*!
+            \brief Adds the reference capture of the state (a state can have many references)
+            \param label the name of the state
+            \param frame the reference capture
+            \param regions the rectangles that identify the state (the whole frame if empty)
+        */
+        auto add(std::string_view const label, Frame const& frame, std::vector<Rect> const& regions = {}) -> void;
+
+        /*!
+            \brief Adds the reference screenshot of the state
+            \param bitmap the bitmap image (BMP format, e.g. the result of Memuc::screen_cap)
+        */
+        auto add(std::string_view const label, std::span<uint8_t const> const bitmap,
+                 std::vector<Rect> const& regions = {}) -> void;
+
+        /*!
+            \brief Finds the state of the frame
+            \return the closest reference within the maximum distance, std::nullopt if the screen is unknown
+        */
+        auto classify(Frame const& frame) const -> std::optional<StateMatch>;
+
+        /*!
+            \brief Returns the number of the references
+        */
+        auto size() const -> size_t;
+
+      private:
+        struct Reference
+        {
+            uint32_t label;
+            uint32_t layout;
+            // Position of the hashes of the regions
+            size_t offset;
+        };
+
+        StateIndexOptions options;
+        std::vector<std::string> labels;
+        // Distinct sets of the regions, each frame is hashed once per set
+        std::vector<std::vector<Rect>> layouts;
+        std::vector<Reference> references;
+        std::vector<uint64_t> hashes;
+
+        auto find_label(std::string_view const label) -> uint32_t;
+
+        auto find_layout(std::vector<Rect> const& regions) -> uint32_t;
+    };
+} // namespace memucpp
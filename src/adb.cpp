@@ -0,0 +1,415 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/adb.hpp"
+#include "memucpp.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#undef NOMINMAX
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace memucpp
+{
+    namespace internal
+    {
+#ifdef _WIN32
+        using SocketHandle = SOCKET;
+        SocketHandle constexpr invalid_socket = INVALID_SOCKET;
+
+        auto close_socket(SocketHandle const handle) -> void
+        {
+            ::closesocket(handle);
+        }
+
+        auto poll_socket(pollfd& descriptor, int32_t const milliseconds) -> int32_t
+        {
+            return ::WSAPoll(&descriptor, 1, milliseconds);
+        }
+
+        /*!
+            \brief Returns true if the last socket call was interrupted by a signal (it can be repeated)
+        */
+        auto socket_interrupted() -> bool
+        {
+            return ::WSAGetLastError() == WSAEINTR;
+        }
+
+        // Winsock is initialized once for the process
+        struct WinsockLibrary
+        {
+            WinsockLibrary()
+            {
+                WSADATA data;
+                ::WSAStartup(MAKEWORD(2, 2), &data);
+            }
+
+            ~WinsockLibrary()
+            {
+                ::WSACleanup();
+            }
+        };
+#else
+        using SocketHandle = int32_t;
+        SocketHandle constexpr invalid_socket = -1;
+
+        auto close_socket(SocketHandle const handle) -> void
+        {
+            ::close(handle);
+        }
+
+        auto poll_socket(pollfd& descriptor, int32_t const milliseconds) -> int32_t
+        {
+            return ::poll(&descriptor, 1, milliseconds);
+        }
+
+        auto socket_interrupted() -> bool
+        {
+            return errno == EINTR;
+        }
+#endif
+
+        /*!
+            \brief TCP connection to the adb server
+        */
+        class Socket
+        {
+          public:
+            Socket(std::string const& host, uint16_t const port, std::chrono::milliseconds const timeout)
+                : handle(invalid_socket), timeout(timeout)
+            {
+#ifdef _WIN32
+                static WinsockLibrary const library;
+#endif
+                addrinfo hints{};
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_STREAM;
+                hints.ai_protocol = IPPROTO_TCP;
+
+                addrinfo* addresses = nullptr;
+                if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+                {
+                    throw error("adb server address is not resolved");
+                }
+
+                for (addrinfo* address = addresses; address; address = address->ai_next)
+                {
+                    handle = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+                    if (handle == invalid_socket)
+                    {
+                        continue;
+                    }
+                    if (::connect(handle, address->ai_addr, static_cast<int32_t>(address->ai_addrlen)) == 0)
+                    {
+                        break;
+                    }
+                    close_socket(handle);
+                    handle = invalid_socket;
+                }
+                ::freeaddrinfo(addresses);
+
+                if (handle == invalid_socket)
+                {
+                    throw error("adb server is not available");
+                }
+
+                // Requests are small, they must not wait for the Nagle's algorithm
+                int32_t const enabled = 1;
+                ::setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const*>(&enabled),
+                             sizeof(enabled));
+            }
+
+            ~Socket()
+            {
+                close_socket(handle);
+            }
+
+            Socket(Socket const&) = delete;
+
+            auto operator=(Socket const&) -> Socket& = delete;
+
+            auto send(std::string_view const data) -> void
+            {
+#ifdef MSG_NOSIGNAL
+                int32_t const flags = MSG_NOSIGNAL;
+#else
+                int32_t const flags = 0;
+#endif
+                size_t offset = 0;
+                while (offset < data.size())
+                {
+                    auto const sent = ::send(handle, data.data() + offset, static_cast<int32_t>(data.size() - offset), flags);
+                    if (sent <= 0)
+                    {
+                        throw error("adb connection is closed");
+                    }
+                    offset += static_cast<size_t>(sent);
+                }
+            }
+
+            /*!
+                \brief Receives the available bytes
+                \return number of bytes received (0 is end of stream, the connection errors throw)
+            */
+            auto receive(std::span<uint8_t> const buffer) -> size_t
+            {
+                int32_t const milliseconds =
+                    timeout == std::chrono::milliseconds::max() ? -1 : static_cast<int32_t>(timeout.count());
+
+                while (true)
+                {
+                    pollfd descriptor{.fd = handle, .events = POLLIN, .revents = 0};
+                    int32_t const ready = poll_socket(descriptor, milliseconds);
+                    if (ready == 0)
+                    {
+                        throw error("adb request timed out");
+                    }
+                    if (ready < 0)
+                    {
+                        if (socket_interrupted())
+                        {
+                            continue;
+                        }
+                        throw error("An error occurred when waiting for the adb connection");
+                    }
+
+                    auto const received =
+                        ::recv(handle, reinterpret_cast<char*>(buffer.data()), static_cast<int32_t>(buffer.size()), 0);
+                    if (received < 0)
+                    {
+                        if (socket_interrupted())
+                        {
+                            continue;
+                        }
+                        // A reset connection must not look like the complete output
+                        throw error("An error occurred when receiving from the adb connection");
+                    }
+                    return static_cast<size_t>(received);
+                }
+            }
+
+            auto receive_exact(std::span<uint8_t> const buffer) -> void
+            {
+                size_t offset = 0;
+                while (offset < buffer.size())
+                {
+                    size_t const received = receive(buffer.subspan(offset));
+                    if (received == 0)
+                    {
+                        throw error("adb connection is closed");
+                    }
+                    offset += received;
+                }
+            }
+
+            /*!
+                \brief Sends the request and reads the status (OKAY or FAIL with the message)
+            */
+            auto request(std::string_view const service) -> void
+            {
+                send(std::format("{:04x}{}", service.size(), service));
+
+                std::array<uint8_t, 4> status;
+                receive_exact(status);
+
+                std::string_view const reply(reinterpret_cast<char const*>(status.data()), status.size());
+                if (reply == "OKAY")
+                {
+                    return;
+                }
+                if (reply != "FAIL")
+                {
+                    throw error("adb server sent the unknown status");
+                }
+
+                std::array<uint8_t, 4> length;
+                receive_exact(length);
+
+                std::string message(stoi_hex(length), '\0');
+                receive_exact(std::span<uint8_t>(reinterpret_cast<uint8_t*>(message.data()), message.size()));
+                throw error(std::format("adb server refused the request ({})", message));
+            }
+
+            /*!
+                \brief Reads the stream until the server closes it
+            */
+            auto receive_all(std::vector<uint8_t>& output) -> size_t
+            {
+                size_t const minimum_size = 256 * 1024;
+
+                size_t size = 0;
+                while (true)
+                {
+                    if (size == output.size())
+                    {
+                        output.resize(std::max(output.size() * 2, minimum_size));
+                    }
+
+                    size_t const received = receive(std::span<uint8_t>(output.data() + size, output.size() - size));
+                    if (received == 0)
+                    {
+                        return size;
+                    }
+                    size += received;
+                }
+            }
+
+          private:
+            SocketHandle handle;
+            std::chrono::milliseconds timeout;
+
+            static auto stoi_hex(std::span<uint8_t const> const source) -> size_t
+            {
+                size_t out = 0;
+                auto const result = std::from_chars(reinterpret_cast<char const*>(source.data()),
+                                                    reinterpret_cast<char const*>(source.data() + source.size()), out, 16);
+                if (result.ec != std::errc())
+                {
+                    throw error("adb server sent the invalid length");
+                }
+                return out;
+            }
+        };
+    } // namespace internal
+
+    AdbClient::AdbClient(std::string serial, AdbOptions const& options)
+        : device_serial(std::move(serial)), options(options), counters{}
+    {
+    }
+
+    AdbClient::~AdbClient() = default;
+
+    auto AdbClient::vm_serial(uint16_t const vm_index) -> std::string
+    {
+        return std::format("127.0.0.1:{}", 21503 + 10 * static_cast<uint32_t>(vm_index));
+    }
+
+    auto AdbClient::shell(std::string_view const command) -> std::string
+    {
+        internal::Probe probe(Metric::AdbRequest);
+        auto socket = open(std::format("shell:{}", command));
+
+        std::vector<uint8_t> output;
+        size_t const size = socket->receive_all(output);
+        socket.reset();
+        probe.add_bytes(size);
+
+        refill();
+        return std::string(reinterpret_cast<char const*>(output.data()), size);
+    }
+
+    auto AdbClient::exec(std::string_view const command, std::vector<uint8_t>& output) -> size_t
+    {
+        internal::Probe probe(Metric::AdbRequest);
+        auto socket = open(std::format("exec:{}", command));
+
+        // The service streams the bytes straight into the caller's buffer
+        size_t const size = socket->receive_all(output);
+        socket.reset();
+        probe.add_bytes(size);
+
+        refill();
+        return size;
+    }
+
+    auto AdbClient::serial() const -> std::string_view
+    {
+        return device_serial;
+    }
+
+    auto AdbClient::stats() const -> AdbStats
+    {
+        std::lock_guard lock(mutex);
+        return counters;
+    }
+
+    auto AdbClient::connect() -> std::unique_ptr<internal::Socket>
+    {
+        auto socket = std::make_unique<internal::Socket>(options.host, options.port, options.timeout);
+        socket->request(std::format("host:transport:{}", device_serial));
+
+        std::lock_guard lock(mutex);
+        ++counters.connections;
+        return socket;
+    }
+
+    auto AdbClient::open(std::string_view const service) -> std::unique_ptr<internal::Socket>
+    {
+        {
+            std::lock_guard lock(mutex);
+            ++counters.requests;
+        }
+
+        // The idle connection may have been closed by the server, then the request is repeated on the new one
+        while (true)
+        {
+            std::unique_ptr<internal::Socket> socket;
+            {
+                std::lock_guard lock(mutex);
+                if (!idle.empty())
+                {
+                    socket = std::move(idle.back());
+                    idle.pop_back();
+                    ++counters.reuses;
+                }
+            }
+
+            bool const reused = socket != nullptr;
+            if (!reused)
+            {
+                socket = connect();
+            }
+
+            try
+            {
+                socket->request(service);
+                return socket;
+            }
+            catch (error const&)
+            {
+                if (!reused)
+                {
+                    throw;
+                }
+            }
+        }
+    }
+
+    auto AdbClient::refill() -> void
+    {
+        while (true)
+        {
+            {
+                std::lock_guard lock(mutex);
+                if (idle.size() >= options.connections)
+                {
+                    return;
+                }
+            }
+
+            std::unique_ptr<internal::Socket> socket;
+            try
+            {
+                socket = connect();
+            }
+            catch (error const&)
+            {
+                // The next request reports the error
+                return;
+            }
+
+            std::lock_guard lock(mutex);
+            idle.push_back(std::move(socket));
+        }
+    }
+} // namespace memucpp
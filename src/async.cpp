@@ -0,0 +1,509 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/async.hpp"
+#include "memucpp.hpp"
+#include "process.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace memucpp
+{
+    namespace internal
+    {
+        // Free space kept at the end of the output buffer before every read
+        size_t constexpr read_chunk_size = 64 * 1024;
+
+        struct AsyncCommand
+        {
+            uint64_t id;
+            std::vector<std::string> arguments;
+            FrameBuffer output;
+            size_t size;
+            std::chrono::steady_clock::time_point deadline;
+            EventLoop::Completion completion;
+            std::optional<Process> process;
+            // Output is closed, the process is waited without blocking the loop
+            bool closed;
+        };
+
+        /*!
+            \brief Thread of the event loop, watches the output pipes of the running commands
+            \details Linux uses epoll, other POSIX systems use poll, Windows polls the pipes every millisecond
+        */
+        class EventLoopThread
+        {
+          public:
+            EventLoopThread() : next_id(1), in_flight(0), started(0), completed(0), timed_out(0), cancelled(0)
+            {
+#ifndef _WIN32
+                std::array<int32_t, 2> wake_pipe;
+                if (::pipe(wake_pipe.data()) != 0)
+                {
+                    throw error("An error occurred when creating the event loop");
+                }
+                for (int32_t const fd : wake_pipe)
+                {
+                    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+                }
+                wake_read = wake_pipe[0];
+                wake_write = wake_pipe[1];
+#endif
+#ifdef __linux__
+                poll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+                epoll_event event{.events = EPOLLIN, .data = {.u64 = 0}};
+                if (poll_fd == -1 || ::epoll_ctl(poll_fd, EPOLL_CTL_ADD, wake_read, &event) != 0)
+                {
+                    close_descriptors();
+                    throw error("An error occurred when creating the event loop");
+                }
+#endif
+                thread = std::jthread([this](std::stop_token const stop_token) { run(stop_token); });
+            }
+
+            ~EventLoopThread()
+            {
+                thread.request_stop();
+                wake();
+                thread.join();
+                close_descriptors();
+            }
+
+            auto push(std::unique_ptr<AsyncCommand> command) -> uint64_t
+            {
+                uint64_t const id = next_id.fetch_add(1, std::memory_order_relaxed);
+                command->id = id;
+
+                in_flight.fetch_add(1, std::memory_order_relaxed);
+                {
+                    std::lock_guard lock(mutex);
+                    pending.push_back(std::move(command));
+                }
+                wake();
+                return id;
+            }
+
+            auto cancel(uint64_t const id) -> void
+            {
+                {
+                    std::lock_guard lock(mutex);
+                    cancels.push_back(id);
+                }
+                wake();
+            }
+
+            auto stats() const -> EventLoopStats
+            {
+                return EventLoopStats{.in_flight = in_flight.load(std::memory_order_relaxed),
+                                      .started = started.load(std::memory_order_relaxed),
+                                      .completed = completed.load(std::memory_order_relaxed),
+                                      .timed_out = timed_out.load(std::memory_order_relaxed),
+                                      .cancelled = cancelled.load(std::memory_order_relaxed)};
+            }
+
+          private:
+            std::atomic<uint64_t> next_id;
+            std::atomic<size_t> in_flight;
+            std::atomic<uint64_t> started;
+            std::atomic<uint64_t> completed;
+            std::atomic<uint64_t> timed_out;
+            std::atomic<uint64_t> cancelled;
+
+            std::mutex mutex;
+            std::condition_variable_any submitted;
+            std::vector<std::unique_ptr<AsyncCommand>> pending;
+            std::vector<uint64_t> cancels;
+
+            // Owned by the loop thread
+            std::unordered_map<uint64_t, std::unique_ptr<AsyncCommand>> running;
+
+#ifndef _WIN32
+            int32_t wake_read = -1;
+            int32_t wake_write = -1;
+#endif
+#ifdef __linux__
+            int32_t poll_fd = -1;
+#endif
+
+            std::jthread thread;
+
+            auto wake() -> void
+            {
+                {
+                    // Empty critical section orders the notification after the check of the waiting loop
+                    std::lock_guard lock(mutex);
+                }
+                submitted.notify_one();
+#ifndef _WIN32
+                uint8_t const byte = 1;
+                [[maybe_unused]] auto const result = ::write(wake_write, &byte, 1);
+#endif
+            }
+
+            auto close_descriptors() -> void
+            {
+#ifndef _WIN32
+                for (int32_t const fd : {wake_read, wake_write})
+                {
+                    if (fd != -1)
+                    {
+                        ::close(fd);
+                    }
+                }
+#endif
+#ifdef __linux__
+                if (poll_fd != -1)
+                {
+                    ::close(poll_fd);
+                }
+#endif
+            }
+
+            auto finish(AsyncCommand& command, std::exception_ptr const exception, int32_t const exit_code) -> void
+            {
+                in_flight.fetch_sub(1, std::memory_order_relaxed);
+                completed.fetch_add(1, std::memory_order_relaxed);
+
+                try
+                {
+                    command.completion(exception, exit_code, command.size);
+                }
+                catch (...)
+                {
+                }
+            }
+
+            auto forget(AsyncCommand& command) -> void
+            {
+#ifdef __linux__
+                if (!command.closed && command.process)
+                {
+                    ::epoll_ctl(poll_fd, EPOLL_CTL_DEL, command.process->output_descriptor(), nullptr);
+                }
+#endif
+                // Destruction of the killed process reaps it
+                command.process.reset();
+            }
+
+            auto abort(uint64_t const id, std::string_view const message) -> bool
+            {
+                auto const found = running.find(id);
+                if (found == running.end())
+                {
+                    return false;
+                }
+
+                auto command = std::move(found->second);
+                running.erase(found);
+
+                command->process->kill();
+                forget(*command);
+                finish(*command, std::make_exception_ptr(error(message)), -1);
+                return true;
+            }
+
+            auto launch(std::unique_ptr<AsyncCommand> command) -> void
+            {
+                started.fetch_add(1, std::memory_order_relaxed);
+                try
+                {
+                    command->process.emplace(command->arguments, false);
+                }
+                catch (...)
+                {
+                    finish(*command, std::current_exception(), -1);
+                    return;
+                }
+
+#ifdef __linux__
+                epoll_event event{.events = EPOLLIN, .data = {.u64 = command->id}};
+                ::epoll_ctl(poll_fd, EPOLL_CTL_ADD, command->process->output_descriptor(), &event);
+#endif
+                running.emplace(command->id, std::move(command));
+            }
+
+            // Reads the available output, returns false at the end of stream
+            auto drain(AsyncCommand& command) -> bool
+            {
+                auto& storage = command.output.storage();
+                if (storage.size() - command.size < read_chunk_size)
+                {
+                    storage.resize(std::max(storage.size() * 2, command.size + read_chunk_size));
+                }
+
+                auto const read_bytes = command.process->read(
+                    std::span<uint8_t>(storage.data() + command.size, storage.size() - command.size),
+                    std::chrono::milliseconds(0));
+                if (!read_bytes)
+                {
+                    return true;
+                }
+                if (*read_bytes == 0)
+                {
+                    return false;
+                }
+
+                command.size += *read_bytes;
+                return true;
+            }
+
+            auto close_output(AsyncCommand& command) -> void
+            {
+#ifdef __linux__
+                ::epoll_ctl(poll_fd, EPOLL_CTL_DEL, command.process->output_descriptor(), nullptr);
+#endif
+                command.closed = true;
+            }
+
+            auto wait_events(std::chrono::milliseconds const timeout) -> void
+            {
+#ifdef __linux__
+                std::array<epoll_event, 64> events;
+                int32_t const count =
+                    ::epoll_wait(poll_fd, events.data(), static_cast<int32_t>(events.size()),
+                                 static_cast<int32_t>(timeout.count()));
+
+                for (int32_t i = 0; i < count; ++i)
+                {
+                    uint64_t const id = events[i].data.u64;
+                    if (id == 0)
+                    {
+                        clear_wake();
+                        continue;
+                    }
+
+                    auto const found = running.find(id);
+                    if (found != running.end() && !drain(*found->second))
+                    {
+                        close_output(*found->second);
+                    }
+                }
+#elif !defined(_WIN32)
+                std::vector<pollfd> descriptors{pollfd{.fd = wake_read, .events = POLLIN, .revents = 0}};
+                std::vector<AsyncCommand*> commands;
+                for (auto& [id, command] : running)
+                {
+                    if (!command->closed)
+                    {
+                        descriptors.push_back(
+                            pollfd{.fd = command->process->output_descriptor(), .events = POLLIN, .revents = 0});
+                        commands.push_back(command.get());
+                    }
+                }
+
+                if (::poll(descriptors.data(), descriptors.size(), static_cast<int32_t>(timeout.count())) <= 0)
+                {
+                    return;
+                }
+                if (descriptors[0].revents != 0)
+                {
+                    clear_wake();
+                }
+                for (size_t i = 1; i < descriptors.size(); ++i)
+                {
+                    if (descriptors[i].revents != 0 && !drain(*commands[i - 1]))
+                    {
+                        close_output(*commands[i - 1]);
+                    }
+                }
+#else
+                // Anonymous pipes cannot be waited on, the pipes are peeked every tick
+                {
+                    std::unique_lock lock(mutex);
+                    submitted.wait_for(lock, std::min(timeout, std::chrono::milliseconds(1)),
+                                       [&]() { return !pending.empty() || !cancels.empty(); });
+                }
+                for (auto& [id, command] : running)
+                {
+                    if (!command->closed && !drain(*command))
+                    {
+                        close_output(*command);
+                    }
+                }
+#endif
+            }
+
+            auto clear_wake() -> void
+            {
+#ifndef _WIN32
+                std::array<uint8_t, 256> bytes;
+                while (::read(wake_read, bytes.data(), bytes.size()) > 0)
+                {
+                }
+#endif
+            }
+
+            auto run(std::stop_token const stop_token) -> void
+            {
+                while (!stop_token.stop_requested())
+                {
+                    std::vector<std::unique_ptr<AsyncCommand>> starting;
+                    std::vector<uint64_t> cancelling;
+                    {
+                        std::unique_lock lock(mutex);
+                        if (running.empty())
+                        {
+                            // Nothing to watch, sleeps until the next command
+                            submitted.wait(lock, stop_token, [&]() { return !pending.empty() || !cancels.empty(); });
+                        }
+                        std::swap(starting, pending);
+                        std::swap(cancelling, cancels);
+                    }
+
+                    for (auto& command : starting)
+                    {
+                        launch(std::move(command));
+                    }
+                    for (uint64_t const id : cancelling)
+                    {
+                        if (abort(id, "MEmuc command is cancelled"))
+                        {
+                            cancelled.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+
+                    if (running.empty())
+                    {
+                        continue;
+                    }
+
+                    auto const now = std::chrono::steady_clock::now();
+                    auto timeout = std::chrono::milliseconds(1000);
+                    for (auto& [id, command] : running)
+                    {
+                        if (command->closed)
+                        {
+                            // Output is closed right before the exit, so the exit is polled often
+                            timeout = std::chrono::milliseconds(1);
+                            break;
+                        }
+                        timeout = std::min(timeout, std::chrono::ceil<std::chrono::milliseconds>(
+                                                        std::max(command->deadline - now, std::chrono::steady_clock::duration::zero())));
+                    }
+                    wait_events(timeout);
+
+                    reap();
+                }
+
+                // Commands left at the stop complete with the error
+                std::vector<std::unique_ptr<AsyncCommand>> remaining;
+                {
+                    std::lock_guard lock(mutex);
+                    std::swap(remaining, pending);
+                }
+                for (auto& [id, command] : running)
+                {
+                    command->process->kill();
+                    forget(*command);
+                    remaining.push_back(std::move(command));
+                }
+                running.clear();
+
+                for (auto& command : remaining)
+                {
+                    finish(*command, std::make_exception_ptr(error("Event loop is stopped")), -1);
+                }
+            }
+
+            auto reap() -> void
+            {
+                auto const now = std::chrono::steady_clock::now();
+
+                std::vector<uint64_t> expired;
+                for (auto it = running.begin(); it != running.end();)
+                {
+                    auto& command = *it->second;
+
+                    std::optional<int32_t> exit_code;
+                    if (command.closed)
+                    {
+                        exit_code = command.process->wait(std::chrono::milliseconds(0));
+                    }
+
+                    if (exit_code)
+                    {
+                        auto finished = std::move(it->second);
+                        it = running.erase(it);
+
+                        finished->process.reset();
+                        finish(*finished, nullptr, *exit_code);
+                        continue;
+                    }
+
+                    if (command.deadline <= now)
+                    {
+                        expired.push_back(it->first);
+                    }
+                    ++it;
+                }
+
+                for (uint64_t const id : expired)
+                {
+                    if (abort(id, "MEmuc command timed out"))
+                    {
+                        timed_out.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        };
+    } // namespace internal
+
+    EventLoop::EventLoop() : thread(std::make_unique<internal::EventLoopThread>())
+    {
+    }
+
+    EventLoop::~EventLoop() = default;
+
+    auto EventLoop::Create() -> std::shared_ptr<EventLoop>
+    {
+        return std::shared_ptr<EventLoop>(new EventLoop());
+    }
+
+    auto EventLoop::Shared() -> std::shared_ptr<EventLoop>
+    {
+        static std::shared_ptr<EventLoop> const loop = Create();
+        return loop;
+    }
+
+    auto EventLoop::start(std::vector<std::string> arguments, FrameBuffer output,
+                          std::chrono::milliseconds const timeout, Completion completion) -> uint64_t
+    {
+        auto const now = std::chrono::steady_clock::now();
+        auto const deadline = timeout >= std::chrono::duration_cast<std::chrono::milliseconds>(
+                                             std::chrono::steady_clock::time_point::max() - now)
+                                  ? std::chrono::steady_clock::time_point::max()
+                                  : now + timeout;
+
+        return thread->push(std::make_unique<internal::AsyncCommand>(internal::AsyncCommand{
+            .id = 0,
+            .arguments = std::move(arguments),
+            .output = std::move(output),
+            .size = 0,
+            .deadline = deadline,
+            .completion = std::move(completion),
+            .process = std::nullopt,
+            .closed = false}));
+    }
+
+    auto EventLoop::cancel(uint64_t const command_id) -> void
+    {
+        thread->cancel(command_id);
+    }
+
+    auto EventLoop::stats() const -> EventLoopStats
+    {
+        return thread->stats();
+    }
+} // namespace memucpp
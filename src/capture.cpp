@@ -0,0 +1,135 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "capture.hpp"
+
+namespace memucpp
+{
+    namespace internal
+    {
+        CaptureWorker::CaptureWorker(Memuc& source, CaptureOptions const& options)
+            : source(&source), capture_options(options), slots{}, middle(1), back(0), front(2), unconsumed(0),
+              captured(0), consumed(0), dropped(0), failures(0)
+        {
+            thread = std::jthread([this](std::stop_token const stop_token) { run(stop_token); });
+        }
+
+        CaptureWorker::~CaptureWorker()
+        {
+            thread.request_stop();
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+
+        auto CaptureWorker::latest() -> std::optional<CapturedFrame>
+        {
+            std::lock_guard lock(reader_mutex);
+
+            if (middle.load(std::memory_order_acquire) & fresh_bit)
+            {
+                front = middle.exchange(front, std::memory_order_acq_rel) & ~fresh_bit;
+
+                consumed.fetch_add(1, std::memory_order_relaxed);
+                unconsumed.store(0, std::memory_order_relaxed);
+                {
+                    std::lock_guard wake_lock(wake_mutex);
+                }
+                wake.notify_one();
+            }
+
+            if (slots[front].sequence == 0)
+            {
+                return std::nullopt;
+            }
+            return slots[front];
+        }
+
+        auto CaptureWorker::stats() const -> CaptureStats
+        {
+            return CaptureStats{.captured = captured.load(std::memory_order_relaxed),
+                                .consumed = consumed.load(std::memory_order_relaxed),
+                                .dropped = dropped.load(std::memory_order_relaxed),
+                                .failures = failures.load(std::memory_order_relaxed)};
+        }
+
+        auto CaptureWorker::options() const -> CaptureOptions const&
+        {
+            return capture_options;
+        }
+
+        auto CaptureWorker::pause() -> std::unique_lock<std::mutex>
+        {
+            return std::unique_lock<std::mutex>(source_mutex);
+        }
+
+        auto CaptureWorker::rebind(Memuc& source) -> void
+        {
+            this->source = &source;
+        }
+
+        auto CaptureWorker::run(std::stop_token const stop_token) -> void
+        {
+            auto const interval = capture_options.target_fps > 0
+                                      ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                            std::chrono::duration<double>(1.0 / capture_options.target_fps))
+                                      : std::chrono::steady_clock::duration::zero();
+            auto next = std::chrono::steady_clock::now();
+            uint64_t sequence = 0;
+
+            while (!stop_token.stop_requested())
+            {
+                auto const started = std::chrono::steady_clock::now();
+                next = std::max(next + interval, started);
+
+                try
+                {
+                    std::unique_lock lock(source_mutex);
+                    auto frame = source->capture();
+                    lock.unlock();
+
+                    publish(CapturedFrame{.frame = std::move(frame),
+                                          .sequence = ++sequence,
+                                          .timestamp = std::chrono::steady_clock::now()});
+                }
+                catch (std::exception const&)
+                {
+                    // The VM may be rebooting, so retries at most once per second
+                    failures.fetch_add(1, std::memory_order_relaxed);
+                    next = std::max(next, started + std::chrono::seconds(1));
+                }
+
+                std::unique_lock lock(wake_mutex);
+
+                // Back-pressure: stops capturing while nobody takes the published frames
+                if (capture_options.max_unconsumed > 0)
+                {
+                    wake.wait(lock, stop_token, [&]() {
+                        return unconsumed.load(std::memory_order_relaxed) < capture_options.max_unconsumed;
+                    });
+                }
+                wake.wait_until(lock, stop_token, next, []() { return false; });
+            }
+        }
+
+        auto CaptureWorker::publish(CapturedFrame&& frame) -> void
+        {
+            slots[back] = std::move(frame);
+
+            uint32_t const previous = middle.exchange(back | fresh_bit, std::memory_order_acq_rel);
+            back = previous & ~fresh_bit;
+
+            // The overwritten frame was never taken by a reader
+            if (previous & fresh_bit)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Releases the pooled buffer of the stale frame right away
+            slots[back] = CapturedFrame();
+
+            captured.fetch_add(1, std::memory_order_relaxed);
+            unconsumed.fetch_add(1, std::memory_order_relaxed);
+        }
+    } // namespace internal
+} // namespace memucpp
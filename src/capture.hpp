@@ -0,0 +1,70 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include "memucpp.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        /*!
+            \brief Thread that keeps capturing the screen into a triple buffer
+        */
+        class CaptureWorker
+        {
+          public:
+            CaptureWorker(Memuc& source, CaptureOptions const& options);
+
+            ~CaptureWorker();
+
+            /*!
+                \brief Returns the newest complete frame (never waits for the capture thread)
+            */
+            auto latest() -> std::optional<CapturedFrame>;
+
+            auto stats() const -> CaptureStats;
+
+            auto options() const -> CaptureOptions const&;
+
+            /*!
+                \brief Blocks the capture until the lock is released (used to retarget the moved Memuc)
+            */
+            auto pause() -> std::unique_lock<std::mutex>;
+
+            auto rebind(Memuc& source) -> void;
+
+          private:
+            static constexpr uint32_t fresh_bit = 4;
+
+            Memuc* source;
+            CaptureOptions capture_options;
+            std::mutex source_mutex;
+
+            // Slots are owned by the writer (back), the readers (front) and the exchange (middle)
+            std::array<CapturedFrame, 3> slots;
+            std::atomic<uint32_t> middle;
+            uint32_t back;
+            uint32_t front;
+            std::mutex reader_mutex;
+
+            std::atomic<uint32_t> unconsumed;
+            std::atomic<uint64_t> captured;
+            std::atomic<uint64_t> consumed;
+            std::atomic<uint64_t> dropped;
+            std::atomic<uint64_t> failures;
+
+            std::mutex wake_mutex;
+            std::condition_variable_any wake;
+            std::jthread thread;
+
+            auto run(std::stop_token const stop_token) -> void;
+
+            auto publish(CapturedFrame&& frame) -> void;
+        };
+    } // namespace internal
+} // namespace memucpp
@@ -0,0 +1,131 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/diff.hpp"
+#include "memucpp.hpp"
+#include "pixel.hpp"
+#include <algorithm>
+
+namespace memucpp
+{
+    FrameDiffer::FrameDiffer(DiffOptions const& options)
+        : options(options), width(0), height(0), format(PixelFormat::RGBA8888), diff{}
+    {
+        if (options.tile_size == 0)
+        {
+            throw error("Tile size must be positive");
+        }
+    }
+
+    auto FrameDiffer::update(Frame const& frame) -> FrameDiff const&
+    {
+        uint32_t const tile_size = options.tile_size;
+        uint32_t const columns = (frame.width + tile_size - 1) / tile_size;
+        uint32_t const rows = (frame.height + tile_size - 1) / tile_size;
+        uint32_t const pixel_size = bytes_per_pixel(frame.format);
+
+        // Every tile of the first or resized frame is changed
+        bool const reshaped = tile_hashes.empty() || frame.width != width || frame.height != height ||
+                              frame.format != format;
+        width = frame.width;
+        height = frame.height;
+        format = frame.format;
+        tile_hashes.resize(static_cast<size_t>(columns) * rows);
+        lanes.resize(columns);
+
+        diff.regions.clear();
+        diff.changed_tiles = 0;
+        diff.tiles = columns * rows;
+        previous_runs.clear();
+
+        auto const level = internal::simd_level();
+
+        for (uint32_t ty = 0; ty < rows; ++ty)
+        {
+            uint32_t const top = ty * tile_size;
+            uint32_t const bottom = std::min(top + tile_size, height);
+
+            std::ranges::fill(lanes, internal::hash_begin());
+
+            // Walks the frame row by row, so every row is read once in the memory order
+            for (uint32_t y = top; y < bottom; ++y)
+            {
+                auto const row = frame.row(y);
+                for (uint32_t tx = 0; tx < columns; ++tx)
+                {
+                    uint32_t const left = tx * tile_size;
+                    uint32_t const count = std::min(tile_size, width - left);
+                    internal::hash_row(row.subspan(static_cast<size_t>(left) * pixel_size,
+                                                   static_cast<size_t>(count) * pixel_size),
+                                       lanes[tx], level);
+                }
+            }
+
+            // Merges the runs of the changed tiles with the same runs of the previous tile row
+            runs.clear();
+            auto previous = previous_runs.begin();
+            uint32_t run_begin = columns;
+
+            for (uint32_t tx = 0; tx <= columns; ++tx)
+            {
+                bool changed = false;
+                if (tx < columns)
+                {
+                    uint64_t const hash = internal::hash_end(lanes[tx]);
+                    uint64_t& stored = tile_hashes[static_cast<size_t>(ty) * columns + tx];
+
+                    changed = reshaped || hash != stored;
+                    stored = hash;
+                }
+
+                if (changed)
+                {
+                    ++diff.changed_tiles;
+                    run_begin = std::min(run_begin, tx);
+                    continue;
+                }
+                if (run_begin == columns)
+                {
+                    continue;
+                }
+
+                Rect const rect{.x = run_begin * tile_size,
+                                .y = top,
+                                .width = std::min(tx * tile_size, width) - run_begin * tile_size,
+                                .height = bottom - top};
+                run_begin = columns;
+
+                while (previous != previous_runs.end() && diff.regions[*previous].x < rect.x)
+                {
+                    ++previous;
+                }
+
+                if (previous != previous_runs.end() && diff.regions[*previous].x == rect.x &&
+                    diff.regions[*previous].width == rect.width)
+                {
+                    diff.regions[*previous].height += rect.height;
+                    runs.push_back(*previous);
+                }
+                else
+                {
+                    runs.push_back(diff.regions.size());
+                    diff.regions.push_back(rect);
+                }
+            }
+            std::swap(runs, previous_runs);
+        }
+
+        diff.changed = diff.changed_tiles > 0;
+        return diff;
+    }
+
+    auto FrameDiffer::reset() -> void
+    {
+        tile_hashes.clear();
+        diff = FrameDiff{};
+    }
+
+    auto FrameDiffer::hashes() const -> std::span<uint64_t const>
+    {
+        return tile_hashes;
+    }
+} // namespace memucpp
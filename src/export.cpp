@@ -0,0 +1,256 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/export.hpp"
+#include "mapping.hpp"
+#include "memucpp.hpp"
+#include <atomic>
+#include <cstring>
+#include <format>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        std::array<char, 8> constexpr ring_magic{'M', 'E', 'M', 'U', 'S', 'H', 'M', '1'};
+
+        // The memory: header, slot headers, slot pixels (each slot is aligned to 64 bytes)
+        struct RingHeader
+        {
+            std::array<char, 8> magic;
+            uint32_t slots;
+            uint32_t reserved;
+            uint64_t slot_size;
+            // Sequence number of the newest published frame plus one (0 before the first frame)
+            uint64_t latest;
+            std::array<uint64_t, 4> padding;
+        };
+
+        // The fields are accessed atomically, the readers run in the other processes
+        struct SlotHeader
+        {
+            // 2 * sequence + 1 while the frame is written, 2 * sequence + 2 once it is published
+            uint64_t state;
+            // Nanoseconds of the steady clock
+            int64_t time;
+            uint64_t size;
+            uint32_t width;
+            uint32_t height;
+            uint32_t stride;
+            uint32_t format;
+            std::array<uint64_t, 3> padding;
+        };
+
+        static_assert(sizeof(RingHeader) == 64 && sizeof(SlotHeader) == 64);
+
+        auto ring_header(MappedFile const& memory) -> RingHeader&
+        {
+            return *reinterpret_cast<RingHeader*>(memory.data().data());
+        }
+
+        auto slot_header(MappedFile const& memory, uint32_t const slot) -> SlotHeader&
+        {
+            return reinterpret_cast<SlotHeader*>(memory.data().data() + sizeof(RingHeader))[slot];
+        }
+
+        auto slot_data(MappedFile const& memory, uint32_t const slot) -> uint8_t*
+        {
+            auto const& header = ring_header(memory);
+            return memory.data().data() + sizeof(RingHeader) + header.slots * sizeof(SlotHeader) +
+                   slot * header.slot_size;
+        }
+
+        auto steady_time(int64_t const time) -> std::chrono::steady_clock::time_point
+        {
+            return std::chrono::steady_clock::time_point(
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(time)));
+        }
+
+        template <typename T>
+        auto load(T& value, std::memory_order const order = std::memory_order_relaxed) -> T
+        {
+            return std::atomic_ref(value).load(order);
+        }
+
+        template <typename T>
+        auto store(T& value, T const desired, std::memory_order const order = std::memory_order_relaxed) -> void
+        {
+            std::atomic_ref(value).store(desired, order);
+        }
+    } // namespace internal
+
+    FrameExporter::FrameExporter(std::string_view const name, size_t const frame_size,
+                                 FrameExportOptions const& options)
+        : name(name), next_sequence(0)
+    {
+        if (options.slots < 2 || frame_size == 0)
+        {
+            throw error("Frame export needs at least two slots of the positive size");
+        }
+
+        uint64_t const slot_size = (static_cast<uint64_t>(frame_size) + 63) & ~63ull;
+        memory = std::make_unique<internal::MappedFile>(internal::MappedFile::CreateShared(
+            this->name, sizeof(internal::RingHeader) + options.slots * (sizeof(internal::SlotHeader) + slot_size)));
+
+        auto& header = internal::ring_header(*memory);
+        header.slots = options.slots;
+        header.slot_size = slot_size;
+        // The readers check the magic before the layout
+        std::atomic_thread_fence(std::memory_order_release);
+        header.magic = internal::ring_magic;
+    }
+
+    FrameExporter::~FrameExporter()
+    {
+        internal::MappedFile::RemoveShared(name);
+    }
+
+    auto FrameExporter::publish(Frame const& frame) -> uint64_t
+    {
+        auto& header = internal::ring_header(*memory);
+
+        size_t const row_size = static_cast<size_t>(frame.width) * bytes_per_pixel(frame.format);
+        if (row_size * frame.height > header.slot_size)
+        {
+            throw error("Frame is larger than the slot of the shared memory");
+        }
+
+        uint64_t const sequence = next_sequence++;
+        uint32_t const slot = static_cast<uint32_t>(sequence % header.slots);
+        auto& slot_header = internal::slot_header(*memory, slot);
+
+        // The odd state invalidates the frame the readers may still use before its pixels are overwritten
+        internal::store(slot_header.state, 2 * sequence + 1);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        auto* data = internal::slot_data(*memory, slot);
+        for (uint32_t y = 0; y < frame.height; ++y)
+        {
+            auto const row = frame.row(y);
+            std::memcpy(data + y * row_size, row.data(), row.size());
+        }
+
+        internal::store(slot_header.time, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                              std::chrono::steady_clock::now().time_since_epoch())
+                                              .count());
+        internal::store(slot_header.size, static_cast<uint64_t>(row_size * frame.height));
+        internal::store(slot_header.width, frame.width);
+        internal::store(slot_header.height, frame.height);
+        internal::store(slot_header.stride, static_cast<uint32_t>(row_size));
+        internal::store(slot_header.format, static_cast<uint32_t>(frame.format));
+
+        internal::store(slot_header.state, 2 * sequence + 2, std::memory_order_release);
+        internal::store(header.latest, sequence + 1, std::memory_order_release);
+        return sequence;
+    }
+
+    auto FrameExporter::vm_name(uint16_t const vm_index) -> std::string
+    {
+        return std::format("memucpp_vm_{}", vm_index);
+    }
+
+    FrameReader::FrameReader(std::string_view const name) : cursor(0), skipped(0)
+    {
+        memory = std::make_unique<internal::MappedFile>(internal::MappedFile::OpenShared(std::string(name)));
+
+        auto const& header = internal::ring_header(*memory);
+        if (memory->data().size() < sizeof(internal::RingHeader) || header.magic != internal::ring_magic)
+        {
+            throw error("Shared memory is not the frame ring");
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (memory->data().size() < sizeof(internal::RingHeader) +
+                                        header.slots * (sizeof(internal::SlotHeader) + header.slot_size))
+        {
+            throw error("Shared memory is smaller than the frame ring");
+        }
+
+        uint64_t const latest = internal::load(internal::ring_header(*memory).latest, std::memory_order_acquire);
+        cursor = latest > 0 ? latest - 1 : 0;
+    }
+
+    FrameReader::~FrameReader()
+    {
+    }
+
+    auto FrameReader::read(uint64_t const sequence) const -> std::optional<SharedFrame>
+    {
+        uint32_t const slot = static_cast<uint32_t>(sequence % internal::ring_header(*memory).slots);
+        auto& slot_header = internal::slot_header(*memory, slot);
+
+        if (internal::load(slot_header.state, std::memory_order_acquire) != 2 * sequence + 2)
+        {
+            return std::nullopt;
+        }
+
+        SharedFrame out{
+            .sequence = sequence,
+            .timestamp = internal::steady_time(internal::load(slot_header.time)),
+            .frame = Frame{.data = std::span<uint8_t const>(internal::slot_data(*memory, slot),
+                                                            internal::load(slot_header.size)),
+                           .width = internal::load(slot_header.width),
+                           .height = internal::load(slot_header.height),
+                           .stride = internal::load(slot_header.stride),
+                           .format = static_cast<PixelFormat>(internal::load(slot_header.format)),
+                           .buffer = FrameBuffer()}};
+
+        // The writer could start the next frame of the slot while the fields were read
+        return valid(out) ? std::optional(std::move(out)) : std::nullopt;
+    }
+
+    auto FrameReader::latest() const -> std::optional<SharedFrame>
+    {
+        // Retries only if the writer laps the ring between the two loads
+        while (true)
+        {
+            uint64_t const latest = internal::load(internal::ring_header(*memory).latest, std::memory_order_acquire);
+            if (latest == 0)
+            {
+                return std::nullopt;
+            }
+            if (auto frame = read(latest - 1))
+            {
+                return frame;
+            }
+        }
+    }
+
+    auto FrameReader::next() -> std::optional<SharedFrame>
+    {
+        auto& header = internal::ring_header(*memory);
+        while (true)
+        {
+            uint64_t const latest = internal::load(header.latest, std::memory_order_acquire);
+            if (cursor >= latest)
+            {
+                return std::nullopt;
+            }
+
+            // Only the newest frame of each slot can be intact, read checks whether it is written again
+            if (latest - cursor > header.slots)
+            {
+                skipped += latest - header.slots - cursor;
+                cursor = latest - header.slots;
+            }
+
+            if (auto frame = read(cursor++))
+            {
+                return frame;
+            }
+            ++skipped;
+        }
+    }
+
+    auto FrameReader::valid(SharedFrame const& frame) const -> bool
+    {
+        // The pixels are read before the state is checked again
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        uint32_t const slot = static_cast<uint32_t>(frame.sequence % internal::ring_header(*memory).slots);
+        return internal::load(internal::slot_header(*memory, slot).state) == 2 * frame.sequence + 2;
+    }
+
+    auto FrameReader::dropped() const -> uint64_t
+    {
+        return skipped;
+    }
+} // namespace memucpp
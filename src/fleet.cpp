@@ -0,0 +1,375 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/fleet.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        using FleetCommand = std::move_only_function<bool(std::optional<Memuc>&)>;
+
+        /*!
+            \brief Commands of one VM, at most one worker runs them at a time
+        */
+        struct Machine
+        {
+            std::optional<Memuc> memuc;
+            uint32_t home;
+            std::mutex mutex;
+            std::deque<FleetCommand> commands;
+            bool scheduled = false;
+        };
+
+        /*!
+            \brief Work-stealing pool that runs the ready machines
+        */
+        class FleetScheduler
+        {
+          public:
+            FleetScheduler(std::span<uint16_t const> const vm_indices, uint32_t const thread_count)
+                : started(std::chrono::steady_clock::now()), ready(0), outstanding(0), queued(0), running(0),
+                  submitted(0), completed(0), failed(0), steals(0)
+            {
+                for (uint16_t const vm_index : vm_indices)
+                {
+                    auto machine = std::make_unique<Machine>();
+                    machine->home = static_cast<uint32_t>(machines.size() % thread_count);
+
+                    if (!machines.emplace(vm_index, std::move(machine)).second)
+                    {
+                        throw error("VM is added to the fleet twice");
+                    }
+                }
+
+                for (uint32_t i = 0; i < thread_count; ++i)
+                {
+                    workers.push_back(std::make_unique<Worker>());
+                }
+                for (uint32_t i = 0; i < thread_count; ++i)
+                {
+                    threads.emplace_back([this, i](std::stop_token const stop_token) { run(i, stop_token); });
+                }
+            }
+
+            ~FleetScheduler()
+            {
+                for (auto& thread : threads)
+                {
+                    thread.request_stop();
+                }
+                threads.clear();
+            }
+
+            auto push(uint16_t const vm_index, FleetCommand command) -> void
+            {
+                auto const found = machines.find(vm_index);
+                if (found == machines.end())
+                {
+                    throw error("VM is not a part of the fleet");
+                }
+                auto& machine = *found->second;
+
+                {
+                    std::lock_guard lock(wait_mutex);
+                    ++outstanding;
+                }
+                submitted.fetch_add(1, std::memory_order_relaxed);
+                queued.fetch_add(1, std::memory_order_relaxed);
+
+                bool schedule_machine = false;
+                {
+                    std::lock_guard lock(machine.mutex);
+                    machine.commands.push_back(std::move(command));
+                    schedule_machine = !std::exchange(machine.scheduled, true);
+                }
+
+                // Commands of the running or the queued machine are picked up when its turn comes
+                if (schedule_machine)
+                {
+                    schedule(machine, current_scheduler == this ? current_worker : machine.home);
+                }
+            }
+
+            auto wait() -> void
+            {
+                std::unique_lock lock(wait_mutex);
+                drained.wait(lock, [&]() { return outstanding == 0; });
+            }
+
+            auto depth(uint16_t const vm_index) const -> size_t
+            {
+                auto const found = machines.find(vm_index);
+                if (found == machines.end())
+                {
+                    throw error("VM is not a part of the fleet");
+                }
+
+                std::lock_guard lock(found->second->mutex);
+                return found->second->commands.size();
+            }
+
+            auto stats() const -> FleetStats
+            {
+                auto const uptime = std::chrono::steady_clock::now() - started;
+                uint64_t const done = completed.load(std::memory_order_relaxed);
+
+                return FleetStats{.machines = static_cast<uint32_t>(machines.size()),
+                                  .threads = static_cast<uint32_t>(workers.size()),
+                                  .queued = queued.load(std::memory_order_relaxed),
+                                  .running = running.load(std::memory_order_relaxed),
+                                  .submitted = submitted.load(std::memory_order_relaxed),
+                                  .completed = done,
+                                  .failed = failed.load(std::memory_order_relaxed),
+                                  .steals = steals.load(std::memory_order_relaxed),
+                                  .uptime = uptime,
+                                  .throughput = done / std::max(std::chrono::duration<double>(uptime).count(), 1e-9)};
+            }
+
+          private:
+            struct Worker
+            {
+                std::mutex mutex;
+                std::deque<Machine*> machines;
+            };
+
+            // Commands submitted by the commands go to the queue of their worker
+            static thread_local FleetScheduler const* current_scheduler;
+            static thread_local size_t current_worker;
+
+            std::chrono::steady_clock::time_point started;
+            std::unordered_map<uint16_t, std::unique_ptr<Machine>> machines;
+            std::vector<std::unique_ptr<Worker>> workers;
+
+            std::mutex idle_mutex;
+            std::condition_variable_any idle;
+            size_t ready;
+
+            std::mutex wait_mutex;
+            std::condition_variable drained;
+            size_t outstanding;
+
+            std::atomic<size_t> queued;
+            std::atomic<size_t> running;
+            std::atomic<uint64_t> submitted;
+            std::atomic<uint64_t> completed;
+            std::atomic<uint64_t> failed;
+            std::atomic<uint64_t> steals;
+
+            std::vector<std::jthread> threads;
+
+            auto schedule(Machine& machine, size_t const worker) -> void
+            {
+                {
+                    std::lock_guard lock(workers[worker]->mutex);
+                    workers[worker]->machines.push_back(&machine);
+                }
+                {
+                    std::lock_guard lock(idle_mutex);
+                    ++ready;
+                }
+                idle.notify_one();
+            }
+
+            // Takes the oldest machine of the own queue, otherwise steals the newest machine of another worker
+            auto take(size_t const index) -> Machine*
+            {
+                while (true)
+                {
+                    for (size_t k = 0; k < workers.size(); ++k)
+                    {
+                        auto& worker = *workers[(index + k) % workers.size()];
+
+                        std::lock_guard lock(worker.mutex);
+                        if (worker.machines.empty())
+                        {
+                            continue;
+                        }
+
+                        Machine* machine;
+                        if (k == 0)
+                        {
+                            machine = worker.machines.front();
+                            worker.machines.pop_front();
+                        }
+                        else
+                        {
+                            machine = worker.machines.back();
+                            worker.machines.pop_back();
+                            steals.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        return machine;
+                    }
+                    std::this_thread::yield();
+                }
+            }
+
+            auto run(size_t const index, std::stop_token const stop_token) -> void
+            {
+                current_scheduler = this;
+                current_worker = index;
+
+                while (true)
+                {
+                    {
+                        std::unique_lock lock(idle_mutex);
+                        if (!idle.wait(lock, stop_token, [&]() { return ready > 0; }))
+                        {
+                            return;
+                        }
+                        // Claims one of the queued machines, so the scan below always finds one
+                        --ready;
+                    }
+
+                    Machine* machine = take(index);
+
+                    FleetCommand command;
+                    {
+                        std::lock_guard lock(machine->mutex);
+                        command = std::move(machine->commands.front());
+                        machine->commands.pop_front();
+                    }
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    running.fetch_add(1, std::memory_order_relaxed);
+
+                    bool const succeeded = command(machine->memuc);
+                    command = nullptr;
+
+                    running.fetch_sub(1, std::memory_order_relaxed);
+                    (succeeded ? completed : failed).fetch_add(1, std::memory_order_relaxed);
+
+                    // Runs one command per turn, so the busy VMs do not starve the others
+                    bool reschedule;
+                    {
+                        std::lock_guard lock(machine->mutex);
+                        reschedule = !machine->commands.empty();
+                        machine->scheduled = reschedule;
+                    }
+                    if (reschedule)
+                    {
+                        schedule(*machine, index);
+                    }
+
+                    {
+                        std::lock_guard lock(wait_mutex);
+                        if (--outstanding == 0)
+                        {
+                            drained.notify_all();
+                        }
+                    }
+                }
+            }
+        };
+
+        thread_local FleetScheduler const* FleetScheduler::current_scheduler = nullptr;
+        thread_local size_t FleetScheduler::current_worker = 0;
+    } // namespace internal
+
+    Fleet::Fleet(std::span<uint16_t const> const vm_indices, VMConfig const& config, FleetOptions const& options)
+        : indices(vm_indices.begin(), vm_indices.end())
+    {
+        uint32_t threads = options.threads > 0 ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+        threads = std::clamp(threads, 1u, std::max(static_cast<uint32_t>(indices.size()), 1u));
+
+        scheduler = std::make_unique<internal::FleetScheduler>(indices, threads);
+
+        // Every VM is configured on its own queue, so the slow memuc calls overlap
+        std::vector<std::future<void>> futures;
+        for (uint16_t const vm_index : indices)
+        {
+            std::promise<void> promise;
+            futures.push_back(promise.get_future());
+
+            scheduler->push(vm_index, [vm_index, config, promise = std::move(promise)](
+                                          std::optional<Memuc>& memuc) mutable -> bool {
+                try
+                {
+                    memuc.emplace(vm_index, config);
+                    promise.set_value();
+                    return true;
+                }
+                catch (...)
+                {
+                    promise.set_exception(std::current_exception());
+                    return false;
+                }
+            });
+        }
+
+        try
+        {
+            for (auto& future : futures)
+            {
+                future.get();
+            }
+        }
+        catch (...)
+        {
+            scheduler->wait();
+            scheduler.reset();
+            throw;
+        }
+    }
+
+    Fleet::~Fleet()
+    {
+        // Memuc stops its VM on destruction, so the VMs are stopped in parallel as well
+        for (uint16_t const vm_index : indices)
+        {
+            scheduler->push(vm_index, [](std::optional<Memuc>& memuc) -> bool {
+                memuc.reset();
+                return true;
+            });
+        }
+        scheduler->wait();
+    }
+
+    auto Fleet::start_app(std::string_view const package_name) -> std::vector<std::future<void>>
+    {
+        return broadcast([package = std::string(package_name)](Memuc& memuc) { memuc.start_app(package); });
+    }
+
+    auto Fleet::stop_app(std::string_view const package_name) -> std::vector<std::future<void>>
+    {
+        return broadcast([package = std::string(package_name)](Memuc& memuc) { memuc.stop_app(package); });
+    }
+
+    auto Fleet::capture() -> std::vector<std::future<Frame>>
+    {
+        return broadcast([](Memuc& memuc) { return memuc.capture(); });
+    }
+
+    auto Fleet::wait() -> void
+    {
+        scheduler->wait();
+    }
+
+    auto Fleet::queue_depth(uint16_t const vm_index) const -> size_t
+    {
+        return scheduler->depth(vm_index);
+    }
+
+    auto Fleet::stats() const -> FleetStats
+    {
+        return scheduler->stats();
+    }
+
+    auto Fleet::vm_indices() const -> std::span<uint16_t const>
+    {
+        return indices;
+    }
+
+    auto Fleet::enqueue(uint16_t const vm_index, std::move_only_function<bool(Memuc&)> command) -> void
+    {
+        scheduler->push(vm_index, [command = std::move(command)](std::optional<Memuc>& memuc) mutable -> bool {
+            return command(*memuc);
+        });
+    }
+} // namespace memucpp
@@ -0,0 +1,252 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/frame.hpp"
+#include "memucpp.hpp"
+#include "metrics.hpp"
+#include "pixel.hpp"
+#include <cstring>
+
+namespace memucpp
+{
+    namespace internal
+    {
+#pragma pack(push, 1)
+        struct BitmapFileHeader
+        {
+            uint16_t type;
+            uint32_t size;
+            uint16_t reserved1;
+            uint16_t reserved2;
+            uint32_t offset;
+        };
+
+        struct BitmapInfoHeader
+        {
+            uint32_t size;
+            int32_t width;
+            int32_t height;
+            uint16_t planes;
+            uint16_t bit_count;
+            uint32_t compression;
+            uint32_t image_size;
+            int32_t x_pixels_per_meter;
+            int32_t y_pixels_per_meter;
+            uint32_t colors_used;
+            uint32_t colors_important;
+        };
+#pragma pack(pop)
+
+        auto require_rgba(Frame const& frame) -> void
+        {
+            if (frame.format != PixelFormat::RGBA8888 && frame.format != PixelFormat::RGBX8888)
+            {
+                throw error("Frame pixel format is not supported");
+            }
+        }
+    } // namespace internal
+
+    auto encode_bmp(Frame const& frame, std::vector<uint8_t>& output) -> std::span<uint8_t const>
+    {
+        internal::Probe probe(Metric::BmpEncode);
+        internal::require_rgba(frame);
+
+        internal::BitmapFileHeader file_header{
+            .type = 0x4D42, .offset = sizeof(internal::BitmapFileHeader) + sizeof(internal::BitmapInfoHeader)};
+        internal::BitmapInfoHeader info_header{.size = sizeof(internal::BitmapInfoHeader),
+                                               .width = static_cast<int32_t>(frame.width),
+                                               .height = static_cast<int32_t>(frame.height),
+                                               .planes = 1,
+                                               .bit_count = 24};
+        uint32_t const row_size = internal::bitmap_row_size(frame.width);
+        size_t const bitmap_size = static_cast<size_t>(row_size) * frame.height;
+        file_header.size = static_cast<uint32_t>(bitmap_size + file_header.offset);
+
+        size_t const bytes = file_header.offset + bitmap_size;
+        if (output.size() < bytes)
+        {
+            output.resize(bytes);
+        }
+
+        std::memcpy(output.data(), &file_header, sizeof(internal::BitmapFileHeader));
+        std::memcpy(output.data() + sizeof(internal::BitmapFileHeader), &info_header,
+                    sizeof(internal::BitmapInfoHeader));
+
+        // Swizzles RGBA to BGR, mirrors vertically and pads the rows in one pass
+        internal::rgba_to_bgr24(frame.data, frame.width, frame.height, frame.stride,
+                                std::span<uint8_t>(output.data() + file_header.offset, bitmap_size), row_size, true,
+                                internal::simd_level(), capture_threads);
+        probe.add_bytes(bytes);
+        return std::span<uint8_t const>(output.data(), bytes);
+    }
+
+    auto decode_bmp(std::span<uint8_t const> const bitmap, std::vector<uint8_t>& output) -> Frame
+    {
+        internal::BitmapFileHeader file_header;
+        internal::BitmapInfoHeader info_header;
+        if (bitmap.size() < sizeof(file_header) + sizeof(info_header))
+        {
+            throw error("Bitmap image is truncated");
+        }
+        std::memcpy(&file_header, bitmap.data(), sizeof(file_header));
+        std::memcpy(&info_header, bitmap.data() + sizeof(file_header), sizeof(info_header));
+
+        if (file_header.type != 0x4D42 || info_header.compression != 0 ||
+            (info_header.bit_count != 24 && info_header.bit_count != 32) || info_header.width <= 0 ||
+            info_header.height == 0)
+        {
+            throw error("Bitmap image format is not supported");
+        }
+
+        // The positive height stores the rows bottom-up
+        bool const flip = info_header.height > 0;
+        uint32_t const width = static_cast<uint32_t>(info_header.width);
+        uint32_t const height = static_cast<uint32_t>(flip ? info_header.height : -info_header.height);
+        uint32_t const pixel_size = info_header.bit_count / 8;
+        uint32_t const row_size = (width * pixel_size + 3) & ~3u;
+        if (bitmap.size() < file_header.offset + static_cast<size_t>(row_size) * height)
+        {
+            throw error("Bitmap image is truncated");
+        }
+
+        uint32_t const stride = width * 3;
+        size_t const bytes = static_cast<size_t>(stride) * height;
+        if (output.size() < bytes)
+        {
+            output.resize(bytes);
+        }
+
+        for (uint32_t j = 0; j < height; ++j)
+        {
+            uint8_t const* row =
+                bitmap.data() + file_header.offset + static_cast<size_t>(flip ? height - 1 - j : j) * row_size;
+            uint8_t* out = output.data() + static_cast<size_t>(j) * stride;
+            if (pixel_size == 3)
+            {
+                std::memcpy(out, row, stride);
+                continue;
+            }
+            for (uint32_t i = 0; i < width; ++i)
+            {
+                std::memcpy(out + i * 3, row + i * 4, 3);
+            }
+        }
+        return Frame{.data = std::span<uint8_t const>(output.data(), bytes),
+                     .width = width,
+                     .height = height,
+                     .stride = stride,
+                     .format = PixelFormat::BGR888};
+    }
+
+    auto encode_bgr(Frame const& frame, std::vector<uint8_t>& output) -> Frame
+    {
+        internal::require_rgba(frame);
+
+        uint32_t const stride = frame.width * 3;
+        size_t const bytes = static_cast<size_t>(stride) * frame.height;
+        if (output.size() < bytes)
+        {
+            output.resize(bytes);
+        }
+
+        internal::rgba_to_bgr24(frame.data, frame.width, frame.height, frame.stride,
+                                std::span<uint8_t>(output.data(), bytes), stride, false, internal::simd_level(),
+                                capture_threads);
+        return Frame{.data = std::span<uint8_t const>(output.data(), bytes),
+                     .width = frame.width,
+                     .height = frame.height,
+                     .stride = stride,
+                     .format = PixelFormat::BGR888};
+    }
+
+    auto encode_grayscale(Frame const& frame, std::vector<uint8_t>& output) -> Frame
+    {
+        if (frame.format != PixelFormat::RGBA8888 && frame.format != PixelFormat::RGBX8888 &&
+            frame.format != PixelFormat::BGRA8888)
+        {
+            throw error("Frame pixel format is not supported");
+        }
+
+        size_t const bytes = static_cast<size_t>(frame.width) * frame.height;
+        if (output.size() < bytes)
+        {
+            output.resize(bytes);
+        }
+
+        uint32_t const red = frame.format == PixelFormat::BGRA8888 ? 2 : 0;
+        uint32_t const blue = 2 - red;
+
+        for (uint32_t const j : std::views::iota(0u, frame.height))
+        {
+            uint8_t const* row = frame.data.data() + static_cast<size_t>(j) * frame.stride;
+            uint8_t* out = output.data() + static_cast<size_t>(j) * frame.width;
+
+            for (uint32_t i = 0; i < frame.width; ++i)
+            {
+                out[i] = static_cast<uint8_t>((row[i * 4 + red] * 77 + row[i * 4 + 1] * 150 + row[i * 4 + blue] * 29 +
+                                               128) >>
+                                              8);
+            }
+        }
+        return Frame{.data = std::span<uint8_t const>(output.data(), bytes),
+                     .width = frame.width,
+                     .height = frame.height,
+                     .stride = frame.width,
+                     .format = PixelFormat::Gray8};
+    }
+
+    auto downscale(Frame const& frame, uint32_t const factor, std::vector<uint8_t>& output) -> Frame
+    {
+        internal::Probe probe(Metric::Downscale);
+        uint32_t const channels = bytes_per_pixel(frame.format);
+        if (factor == 0 || (channels != 4 && channels != 1))
+        {
+            throw error("Frame downscale is not supported");
+        }
+
+        uint32_t const width = frame.width / factor;
+        uint32_t const height = frame.height / factor;
+        uint32_t const stride = width * channels;
+        size_t const bytes = static_cast<size_t>(stride) * height;
+        if (output.size() < bytes)
+        {
+            output.resize(bytes);
+        }
+
+        uint32_t const area = factor * factor;
+        std::vector<uint32_t> sums(stride);
+
+        for (uint32_t const j : std::views::iota(0u, height))
+        {
+            std::ranges::fill(sums, 0u);
+
+            // Sums the factor rows of the block column-wise, then folds every factor pixels
+            for (uint32_t const k : std::views::iota(0u, factor))
+            {
+                uint8_t const* row = frame.data.data() + static_cast<size_t>(j * factor + k) * frame.stride;
+
+                for (uint32_t i = 0; i < width; ++i)
+                {
+                    for (uint32_t l = 0; l < factor; ++l)
+                    {
+                        for (uint32_t c = 0; c < channels; ++c)
+                        {
+                            sums[i * channels + c] += row[(i * factor + l) * channels + c];
+                        }
+                    }
+                }
+            }
+
+            uint8_t* out = output.data() + static_cast<size_t>(j) * stride;
+            for (uint32_t i = 0; i < stride; ++i)
+            {
+                out[i] = static_cast<uint8_t>((sums[i] + area / 2) / area);
+            }
+        }
+        probe.add_bytes(bytes);
+        return Frame{.data = std::span<uint8_t const>(output.data(), bytes),
+                     .width = width,
+                     .height = height,
+                     .stride = stride,
+                     .format = frame.format};
+    }
+} // namespace memucpp
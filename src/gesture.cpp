@@ -0,0 +1,382 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/gesture.hpp"
+#include "memucpp.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        // Opens the command: takes the start from /proc/uptime (builtin read of 10 ms ticks) and defines __wait,
+        // which sleeps until the milliseconds since the start (never early, at most two ticks late)
+        std::string_view constexpr wait_prelude =
+            "{ read __t __ </proc/uptime; __start=${__t%.*}${__t#*.}; "
+            "__wait() { read __t __ </proc/uptime; __left=$(( $1 - (${__t%.*}${__t#*.} - __start - 1) * 10 )); "
+            "[ $__left -gt 0 ] && "
+            "sleep $((__left / 1000)).$((__left / 100 % 10))$((__left / 10 % 10))$((__left % 10)); }; ";
+
+        // Codes of linux/input-event-codes.h
+        uint16_t constexpr ev_syn = 0x00;
+        uint16_t constexpr ev_key = 0x01;
+        uint16_t constexpr ev_abs = 0x03;
+        uint16_t constexpr syn_report = 0x00;
+        uint16_t constexpr syn_mt_report = 0x02;
+        uint16_t constexpr btn_touch = 0x14a;
+        uint16_t constexpr abs_mt_slot = 0x2f;
+        uint16_t constexpr abs_mt_position_x = 0x35;
+        uint16_t constexpr abs_mt_position_y = 0x36;
+        uint16_t constexpr abs_mt_tracking_id = 0x39;
+
+        enum class ContactChange
+        {
+            Down,
+            Move,
+            Up
+        };
+
+        struct Contact
+        {
+            int64_t time;
+            size_t step;
+            uint32_t slot;
+            ContactChange change;
+            uint32_t x;
+            uint32_t y;
+        };
+
+        /*!
+            \brief Returns the position on the path at the fraction of its length
+        */
+        auto path_position(std::vector<std::tuple<uint32_t, uint32_t>> const& path, double const fraction)
+            -> std::tuple<double, double>
+        {
+            auto distance = [](auto const& first, auto const& second) {
+                return std::hypot(static_cast<double>(std::get<0>(second)) - std::get<0>(first),
+                                  static_cast<double>(std::get<1>(second)) - std::get<1>(first));
+            };
+
+            double length = 0.0;
+            for (size_t i = 1; i < path.size(); ++i)
+            {
+                length += distance(path[i - 1], path[i]);
+            }
+
+            double left = fraction * length;
+            for (size_t i = 1; i < path.size(); ++i)
+            {
+                double const segment = distance(path[i - 1], path[i]);
+                if (segment > 0.0 && left <= segment)
+                {
+                    double const t = left / segment;
+                    return {std::get<0>(path[i - 1]) + t * (static_cast<double>(std::get<0>(path[i])) -
+                                                            std::get<0>(path[i - 1])),
+                            std::get<1>(path[i - 1]) + t * (static_cast<double>(std::get<1>(path[i])) -
+                                                            std::get<1>(path[i - 1]))};
+                }
+                left -= segment;
+            }
+            return {std::get<0>(path.back()), std::get<1>(path.back())};
+        }
+
+        /*!
+            \brief Maps the screen position to the axis of the touch screen
+        */
+        auto to_axis(double const position, uint32_t const screen_size, uint32_t const max) -> uint32_t
+        {
+            double const scaled = position * (static_cast<double>(max) + 1.0) / std::max(screen_size, 1u);
+            return static_cast<uint32_t>(std::clamp(scaled, 0.0, static_cast<double>(max)));
+        }
+
+        auto append_event(std::string& out, uint32_t const event_size, uint16_t const type, uint16_t const code,
+                          int32_t const value) -> void
+        {
+            // struct input_event: timeval (ignored by evdev), type, code, value (little endian)
+            out.append(event_size - 8, '\0');
+            for (uint32_t const field : {uint32_t(type) | uint32_t(code) << 16, static_cast<uint32_t>(value)})
+            {
+                for (uint32_t i = 0; i < 4; ++i)
+                {
+                    out.push_back(static_cast<char>(field >> (i * 8) & 0xff));
+                }
+            }
+        }
+
+        /*!
+            \brief Returns the bytes as the format of printf (octal escapes, alphanumerics as they are)
+        */
+        auto printf_format(std::string_view const bytes) -> std::string
+        {
+            auto is_plain = [](char const c) { return std::isalnum(static_cast<unsigned char>(c)) != 0; };
+
+            std::string out;
+            out.reserve(bytes.size() * 2);
+            for (size_t i = 0; i < bytes.size(); ++i)
+            {
+                if (is_plain(bytes[i]))
+                {
+                    out.push_back(bytes[i]);
+                    continue;
+                }
+
+                // The short escape (e.g. \0) must not be followed by a digit that would extend it
+                bool const padded = i + 1 < bytes.size() && std::isdigit(static_cast<unsigned char>(bytes[i + 1]));
+                auto const value = static_cast<uint8_t>(bytes[i]);
+                out.push_back('\\');
+                if (padded || value >= 0100)
+                {
+                    out.push_back(static_cast<char>('0' + (value >> 6)));
+                }
+                if (padded || value >= 010)
+                {
+                    out.push_back(static_cast<char>('0' + (value >> 3 & 7)));
+                }
+                out.push_back(static_cast<char>('0' + (value & 7)));
+            }
+            return out;
+        }
+
+        /*!
+            \brief Returns the events of the report (the contacts of the same time and step)
+            \param active positions of the pressed slots, updated by the contacts
+        */
+        auto report_events(TouchDevice const& device, std::span<Contact const> const contacts,
+                           std::vector<std::optional<std::tuple<uint32_t, uint32_t>>>& active, int32_t& tracking_id)
+            -> std::string
+        {
+            auto pressed = [&]() {
+                return std::ranges::any_of(active, [](auto const& slot) { return slot.has_value(); });
+            };
+            bool const was_pressed = pressed();
+
+            std::string out;
+            for (auto const& contact : contacts)
+            {
+                if (contact.slot >= active.size())
+                {
+                    active.resize(contact.slot + 1);
+                }
+
+                if (contact.change == ContactChange::Up)
+                {
+                    active[contact.slot].reset();
+                }
+                else
+                {
+                    active[contact.slot] = std::make_tuple(contact.x, contact.y);
+                }
+
+                // Protocol B sends the changes of the slots, protocol A resends every contact below
+                if (device.slots > 0)
+                {
+                    append_event(out, device.event_size, ev_abs, abs_mt_slot, static_cast<int32_t>(contact.slot));
+                    if (contact.change != ContactChange::Move)
+                    {
+                        append_event(out, device.event_size, ev_abs, abs_mt_tracking_id,
+                                     contact.change == ContactChange::Down ? tracking_id++ : -1);
+                    }
+                    if (contact.change != ContactChange::Up)
+                    {
+                        append_event(out, device.event_size, ev_abs, abs_mt_position_x,
+                                     static_cast<int32_t>(contact.x));
+                        append_event(out, device.event_size, ev_abs, abs_mt_position_y,
+                                     static_cast<int32_t>(contact.y));
+                    }
+                }
+            }
+
+            if (device.slots == 0)
+            {
+                for (auto const& slot : active)
+                {
+                    if (slot)
+                    {
+                        append_event(out, device.event_size, ev_abs, abs_mt_position_x,
+                                     static_cast<int32_t>(std::get<0>(slot.value())));
+                        append_event(out, device.event_size, ev_abs, abs_mt_position_y,
+                                     static_cast<int32_t>(std::get<1>(slot.value())));
+                        append_event(out, device.event_size, ev_syn, syn_mt_report, 0);
+                    }
+                }
+                if (!pressed())
+                {
+                    append_event(out, device.event_size, ev_syn, syn_mt_report, 0);
+                }
+            }
+
+            bool const is_pressed = pressed();
+            if (is_pressed != was_pressed)
+            {
+                append_event(out, device.event_size, ev_key, btn_touch, is_pressed);
+            }
+            append_event(out, device.event_size, ev_syn, syn_report, 0);
+            return out;
+        }
+    } // namespace internal
+
+    GestureScript::GestureScript(GestureOptions const& options) : options(options)
+    {
+    }
+
+    auto GestureScript::tap(std::tuple<uint32_t, uint32_t> const position) -> GestureScript&
+    {
+        return hold(position, options.tap_duration);
+    }
+
+    auto GestureScript::hold(std::tuple<uint32_t, uint32_t> const position, std::chrono::milliseconds const duration)
+        -> GestureScript&
+    {
+        return touch({TouchStroke{.path = {position}, .start = std::chrono::milliseconds(0), .duration = duration}});
+    }
+
+    auto GestureScript::swipe(std::vector<std::tuple<uint32_t, uint32_t>> path,
+                              std::chrono::milliseconds const duration) -> GestureScript&
+    {
+        if (path.size() < 2)
+        {
+            throw error("Swipe needs at least two positions");
+        }
+        return touch(
+            {TouchStroke{.path = std::move(path), .start = std::chrono::milliseconds(0), .duration = duration}});
+    }
+
+    auto GestureScript::wait(std::chrono::milliseconds const duration) -> GestureScript&
+    {
+        steps.push_back(Step{.strokes = {}, .duration = duration});
+        return *this;
+    }
+
+    auto GestureScript::touch(std::vector<TouchStroke> strokes) -> GestureScript&
+    {
+        std::chrono::milliseconds duration(0);
+        for (auto const& stroke : strokes)
+        {
+            if (stroke.path.empty() || stroke.start.count() < 0 || stroke.duration.count() < 0)
+            {
+                throw error("Touch stroke is malformed");
+            }
+            duration = std::max(duration, stroke.start + stroke.duration);
+        }
+
+        steps.push_back(Step{.strokes = std::move(strokes), .duration = duration});
+        return *this;
+    }
+
+    auto GestureScript::duration() const -> std::chrono::milliseconds
+    {
+        std::chrono::milliseconds out(0);
+        for (auto const& step : steps)
+        {
+            out += step.duration;
+        }
+        return out;
+    }
+
+    auto GestureScript::compile(TouchDevice const& device) const -> CompiledGesture
+    {
+        std::vector<internal::Contact> contacts;
+
+        int64_t base = 0;
+        for (size_t i = 0; i < steps.size(); ++i)
+        {
+            auto const& step = steps[i];
+            if (device.slots > 0 && step.strokes.size() > device.slots)
+            {
+                throw error(std::format("Touch screen supports {} touches at once", device.slots));
+            }
+
+            for (uint32_t slot = 0; slot < step.strokes.size(); ++slot)
+            {
+                auto const& stroke = step.strokes[slot];
+                int64_t const start = base + stroke.start.count();
+                int64_t const duration = stroke.duration.count();
+
+                auto contact = [&](int64_t const time, internal::ContactChange const change, double const fraction) {
+                    auto const [x, y] = internal::path_position(stroke.path, fraction);
+                    internal::Contact out{.time = time,
+                                          .step = i,
+                                          .slot = slot,
+                                          .change = change,
+                                          .x = internal::to_axis(x, device.screen_width, device.max_x),
+                                          .y = internal::to_axis(y, device.screen_height, device.max_y)};
+
+                    // Moves that do not change the position of the touch screen are dropped
+                    if (change != internal::ContactChange::Move || contacts.back().x != out.x ||
+                        contacts.back().y != out.y)
+                    {
+                        contacts.push_back(out);
+                    }
+                };
+
+                contact(start, internal::ContactChange::Down, 0.0);
+                if (stroke.path.size() > 1)
+                {
+                    int64_t const interval = std::max<int64_t>(options.move_interval.count(), 1);
+                    for (int64_t time = interval; time < duration; time += interval)
+                    {
+                        contact(start + time, internal::ContactChange::Move,
+                                static_cast<double>(time) / static_cast<double>(duration));
+                    }
+                    contact(start + duration, internal::ContactChange::Move, 1.0);
+                }
+                contact(start + duration, internal::ContactChange::Up, 1.0);
+            }
+            base += step.duration.count();
+        }
+
+        // Contacts of the same time and step form one report, the strokes are interleaved by time
+        std::ranges::stable_sort(contacts, [](auto const& first, auto const& second) {
+            return std::tie(first.time, first.step) < std::tie(second.time, second.step);
+        });
+
+        CompiledGesture out{
+            .device = device, .command = std::string(internal::wait_prelude), .duration = duration(), .reports = 0};
+
+        std::vector<std::optional<std::tuple<uint32_t, uint32_t>>> active;
+        int32_t tracking_id = 1;
+        int64_t written = 0;
+        std::string events;
+
+        // The waits are measured from the start, so the launches of sleep and printf do not add up
+        auto sleep = [&](int64_t const until) {
+            if (until > written)
+            {
+                out.command += std::format("__wait {}; ", until);
+                written = until;
+            }
+        };
+
+        // Reports of the same time are written at once, the waits between them are slept by the device
+        for (size_t begin = 0; begin < contacts.size();)
+        {
+            size_t end = begin + 1;
+            while (end < contacts.size() && contacts[end].time == contacts[begin].time &&
+                   contacts[end].step == contacts[begin].step)
+            {
+                ++end;
+            }
+
+            events += internal::report_events(
+                device, std::span<internal::Contact const>(contacts.data() + begin, end - begin), active, tracking_id);
+            ++out.reports;
+
+            if (end == contacts.size() || contacts[end].time != contacts[begin].time)
+            {
+                sleep(contacts[begin].time);
+                out.command += std::format("printf '{}'; ", internal::printf_format(events));
+                events.clear();
+            }
+            begin = end;
+        }
+        sleep(out.duration.count());
+
+        if (written == 0 && out.reports == 0)
+        {
+            out.command += "true; ";
+        }
+        out.command += std::format("}} > {}", device.path);
+        return out;
+    }
+} // namespace memucpp
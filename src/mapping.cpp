@@ -0,0 +1,289 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "mapping.hpp"
+#include "memucpp.hpp"
+#include <utility>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#undef NOMINMAX
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace memucpp
+{
+    namespace internal
+    {
+        MappedFile::MappedFile()
+            : address(nullptr), size(0)
+#ifdef _WIN32
+              ,
+              file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+        {
+        }
+
+        MappedFile::~MappedFile()
+        {
+            close();
+        }
+
+        MappedFile::MappedFile(MappedFile&& other) : MappedFile()
+        {
+            *this = std::move(other);
+        }
+
+        auto MappedFile::operator=(MappedFile&& other) -> MappedFile&
+        {
+            close();
+            address = std::exchange(other.address, nullptr);
+            size = std::exchange(other.size, 0);
+#ifdef _WIN32
+            file = std::exchange(other.file, INVALID_HANDLE_VALUE);
+            mapping = std::exchange(other.mapping, nullptr);
+#endif
+            return *this;
+        }
+
+#ifdef _WIN32
+        auto MappedFile::Create(std::filesystem::path const& path, uint64_t const size) -> MappedFile
+        {
+            MappedFile out;
+            out.file = ::CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                                     CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (out.file == INVALID_HANDLE_VALUE)
+            {
+                throw error("An error occurred when creating the mapped file");
+            }
+
+            out.mapping = ::CreateFileMappingW(out.file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                               static_cast<DWORD>(size), nullptr);
+            out.address = out.mapping ? static_cast<uint8_t*>(::MapViewOfFile(out.mapping, FILE_MAP_WRITE, 0, 0, 0))
+                                      : nullptr;
+            if (!out.address)
+            {
+                throw error("An error occurred when mapping the file");
+            }
+            out.size = static_cast<size_t>(size);
+            return out;
+        }
+
+        auto MappedFile::Open(std::filesystem::path const& path) -> MappedFile
+        {
+            MappedFile out;
+            out.file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                     OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            LARGE_INTEGER size;
+            if (out.file == INVALID_HANDLE_VALUE || !::GetFileSizeEx(out.file, &size))
+            {
+                throw error("An error occurred when opening the mapped file");
+            }
+
+            out.mapping = ::CreateFileMappingW(out.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            out.address = out.mapping ? static_cast<uint8_t*>(::MapViewOfFile(out.mapping, FILE_MAP_READ, 0, 0, 0))
+                                      : nullptr;
+            if (!out.address)
+            {
+                throw error("An error occurred when mapping the file");
+            }
+            out.size = static_cast<size_t>(size.QuadPart);
+            return out;
+        }
+
+        auto MappedFile::CreateShared(std::string const& name, uint64_t const size) -> MappedFile
+        {
+            // The mapping backed by the paging file lives while any process keeps its handle
+            MappedFile out;
+            out.mapping = ::CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                               static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name.c_str());
+            out.address = out.mapping ? static_cast<uint8_t*>(::MapViewOfFile(out.mapping, FILE_MAP_WRITE, 0, 0, 0))
+                                      : nullptr;
+            if (!out.address)
+            {
+                throw error("An error occurred when creating the shared memory");
+            }
+            out.size = static_cast<size_t>(size);
+            return out;
+        }
+
+        auto MappedFile::OpenShared(std::string const& name) -> MappedFile
+        {
+            MappedFile out;
+            out.mapping = ::OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+            out.address = out.mapping ? static_cast<uint8_t*>(::MapViewOfFile(out.mapping, FILE_MAP_READ, 0, 0, 0))
+                                      : nullptr;
+            if (!out.address)
+            {
+                throw error("An error occurred when opening the shared memory");
+            }
+
+            MEMORY_BASIC_INFORMATION information;
+            ::VirtualQuery(out.address, &information, sizeof(information));
+            out.size = information.RegionSize;
+            return out;
+        }
+
+        auto MappedFile::RemoveShared(std::string const&) -> void
+        {
+        }
+
+        auto MappedFile::flush() -> void
+        {
+            ::FlushViewOfFile(address, size);
+            ::FlushFileBuffers(file);
+        }
+
+        auto MappedFile::close() -> void
+        {
+            if (address)
+            {
+                ::UnmapViewOfFile(address);
+            }
+            if (mapping)
+            {
+                ::CloseHandle(mapping);
+            }
+            if (file != INVALID_HANDLE_VALUE)
+            {
+                ::CloseHandle(file);
+            }
+            address = nullptr;
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+        }
+#else
+        auto MappedFile::Create(std::filesystem::path const& path, uint64_t const size) -> MappedFile
+        {
+            int32_t const fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd == -1)
+            {
+                throw error("An error occurred when creating the mapped file");
+            }
+
+            MappedFile out;
+            if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+            {
+                void* address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                out.address = address == MAP_FAILED ? nullptr : static_cast<uint8_t*>(address);
+            }
+            ::close(fd);
+
+            if (!out.address)
+            {
+                throw error("An error occurred when mapping the file");
+            }
+            out.size = static_cast<size_t>(size);
+            return out;
+        }
+
+        auto MappedFile::Open(std::filesystem::path const& path) -> MappedFile
+        {
+            int32_t const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat status;
+            if (fd == -1 || ::fstat(fd, &status) == -1)
+            {
+                if (fd != -1)
+                {
+                    ::close(fd);
+                }
+                throw error("An error occurred when opening the mapped file");
+            }
+
+            MappedFile out;
+            if (status.st_size > 0)
+            {
+                void* address = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+                out.address = address == MAP_FAILED ? nullptr : static_cast<uint8_t*>(address);
+            }
+            ::close(fd);
+
+            if (!out.address)
+            {
+                throw error("An error occurred when mapping the file");
+            }
+            out.size = static_cast<size_t>(status.st_size);
+            return out;
+        }
+
+        /*!
+            \brief Maps the descriptor and closes it
+        */
+        auto map_descriptor(int32_t const fd, size_t const size, int32_t const protection) -> uint8_t*
+        {
+            void* address = size > 0 ? ::mmap(nullptr, size, protection, MAP_SHARED, fd, 0) : MAP_FAILED;
+            ::close(fd);
+            return address == MAP_FAILED ? nullptr : static_cast<uint8_t*>(address);
+        }
+
+        auto MappedFile::CreateShared(std::string const& name, uint64_t const size) -> MappedFile
+        {
+            // The name of the previous run is replaced, its readers keep the old memory
+            ::shm_unlink(("/" + name).c_str());
+            int32_t const fd = ::shm_open(("/" + name).c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd == -1 || ::ftruncate(fd, static_cast<off_t>(size)) == -1)
+            {
+                if (fd != -1)
+                {
+                    ::close(fd);
+                }
+                throw error("An error occurred when creating the shared memory");
+            }
+
+            MappedFile out;
+            out.address = map_descriptor(fd, static_cast<size_t>(size), PROT_READ | PROT_WRITE);
+            if (!out.address)
+            {
+                throw error("An error occurred when mapping the shared memory");
+            }
+            out.size = static_cast<size_t>(size);
+            return out;
+        }
+
+        auto MappedFile::OpenShared(std::string const& name) -> MappedFile
+        {
+            int32_t const fd = ::shm_open(("/" + name).c_str(), O_RDONLY | O_CLOEXEC, 0);
+            struct stat status;
+            if (fd == -1 || ::fstat(fd, &status) == -1)
+            {
+                if (fd != -1)
+                {
+                    ::close(fd);
+                }
+                throw error("An error occurred when opening the shared memory");
+            }
+
+            MappedFile out;
+            out.address = map_descriptor(fd, static_cast<size_t>(status.st_size), PROT_READ);
+            if (!out.address)
+            {
+                throw error("An error occurred when mapping the shared memory");
+            }
+            out.size = static_cast<size_t>(status.st_size);
+            return out;
+        }
+
+        auto MappedFile::RemoveShared(std::string const& name) -> void
+        {
+            ::shm_unlink(("/" + name).c_str());
+        }
+
+        auto MappedFile::flush() -> void
+        {
+            ::msync(address, size, MS_SYNC);
+        }
+
+        auto MappedFile::close() -> void
+        {
+            if (address)
+            {
+                ::munmap(address, size);
+            }
+            address = nullptr;
+        }
+#endif
+    } // namespace internal
+} // namespace memucpp
@@ -0,0 +1,78 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        /*!
+            \brief File mapped into the memory of the process (shared with the other mappings of the file)
+        */
+        class MappedFile
+        {
+          public:
+            /*!
+                \brief Creates the file of the size (the old content is discarded) and maps it for writing
+            */
+            static auto Create(std::filesystem::path const& path, uint64_t const size) -> MappedFile;
+
+            /*!
+                \brief Maps the existing file for reading
+            */
+            static auto Open(std::filesystem::path const& path) -> MappedFile;
+
+            /*!
+                \brief Creates the named shared memory of the size (zero filled) and maps it for writing
+            */
+            static auto CreateShared(std::string const& name, uint64_t const size) -> MappedFile;
+
+            /*!
+                \brief Maps the existing named shared memory for reading
+            */
+            static auto OpenShared(std::string const& name) -> MappedFile;
+
+            /*!
+                \brief Removes the name of the shared memory, the existing mappings stay valid
+            */
+            static auto RemoveShared(std::string const& name) -> void;
+
+            ~MappedFile();
+
+            MappedFile(MappedFile const&) = delete;
+
+            MappedFile(MappedFile&& other);
+
+            auto operator=(MappedFile const&) -> MappedFile& = delete;
+
+            auto operator=(MappedFile&& other) -> MappedFile&;
+
+            auto data() const -> std::span<uint8_t>
+            {
+                return std::span<uint8_t>(address, size);
+            }
+
+            /*!
+                \brief Writes the changed pages to the file
+            */
+            auto flush() -> void;
+
+          private:
+            uint8_t* address;
+            size_t size;
+#ifdef _WIN32
+            void* file;
+            void* mapping;
+#endif
+
+            MappedFile();
+
+            auto close() -> void;
+        };
+    } // namespace internal
+} // namespace memucpp
@@ -0,0 +1,298 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/match.hpp"
+#include "memucpp.hpp"
+#include "pixel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        // RGBA8888 and RGBX8888 frames share the channel order
+        auto channel_order(PixelFormat const format) -> uint32_t
+        {
+            switch (format)
+            {
+                case PixelFormat::RGBA8888:
+                case PixelFormat::RGBX8888:
+                    return 0;
+                case PixelFormat::BGRA8888:
+                    return 1;
+                default:
+                    throw error("Frame pixel format is not supported");
+            }
+        }
+
+        auto crop(Frame const& frame, Rect const& rect) -> Frame
+        {
+            size_t const offset = static_cast<size_t>(rect.y) * frame.stride + static_cast<size_t>(rect.x) * 4;
+            return Frame{.data = frame.data.subspan(offset),
+                         .width = rect.width,
+                         .height = rect.height,
+                         .stride = frame.stride,
+                         .format = frame.format};
+        }
+    } // namespace internal
+
+    Template::Template(Frame const& frame, uint32_t const pyramid_levels)
+        : Template(frame, Rect{.x = 0, .y = 0, .width = frame.width, .height = frame.height}, pyramid_levels)
+    {
+    }
+
+    Template::Template(Frame const& frame, Rect const& rect, uint32_t const pyramid_levels)
+        : pixel_format(frame.format)
+    {
+        internal::channel_order(frame.format);
+
+        if (rect.width == 0 || rect.height == 0 || rect.x + rect.width > frame.width ||
+            rect.y + rect.height > frame.height)
+        {
+            throw error("Template region is out of the frame");
+        }
+
+        auto summarize = [](Level& level) {
+            level.sum = 0;
+            level.squares = 0;
+            for (size_t i = 0; i < level.pixels.size(); ++i)
+            {
+                // The fourth byte is zeroed, so it adds nothing
+                uint64_t const value = level.pixels[i];
+                level.sum += value;
+                level.squares += value * value;
+            }
+        };
+
+        // The fourth byte is cleared, as the kernels mask it on the frame side
+        Level base{.width = rect.width, .height = rect.height};
+        base.pixels.resize(static_cast<size_t>(rect.width) * rect.height * 4);
+
+        Frame const source = internal::crop(frame, rect);
+        for (uint32_t y = 0; y < rect.height; ++y)
+        {
+            auto const row = source.row(y);
+            uint8_t* out = base.pixels.data() + static_cast<size_t>(y) * rect.width * 4;
+            for (uint32_t i = 0; i < rect.width * 4; ++i)
+            {
+                out[i] = (i & 3) == 3 ? 0 : row[i];
+            }
+        }
+        summarize(base);
+        levels.push_back(std::move(base));
+
+        // Stops before the template becomes too small to be distinguished
+        while (levels.size() <= pyramid_levels && levels.back().width >= 8 && levels.back().height >= 8)
+        {
+            auto const& previous = levels.back();
+            Frame const image{.data = previous.pixels,
+                              .width = previous.width,
+                              .height = previous.height,
+                              .stride = previous.width * 4,
+                              .format = pixel_format};
+
+            Level level;
+            auto const small = downscale(image, 2, level.pixels);
+            level.width = small.width;
+            level.height = small.height;
+            level.pixels.resize(small.data.size());
+            summarize(level);
+            levels.push_back(std::move(level));
+        }
+    }
+
+    auto Template::width() const -> uint32_t
+    {
+        return levels.front().width;
+    }
+
+    auto Template::height() const -> uint32_t
+    {
+        return levels.front().height;
+    }
+
+    auto Template::format() const -> PixelFormat
+    {
+        return pixel_format;
+    }
+
+    TemplateMatcher::TemplateMatcher(MatchOptions const& options) : match_options(options)
+    {
+    }
+
+    auto TemplateMatcher::find(Frame const& frame, Template const& pattern, std::optional<Rect> const& region)
+        -> std::optional<Match>
+    {
+        if (internal::channel_order(frame.format) != internal::channel_order(pattern.pixel_format))
+        {
+            throw error("Template and frame channel orders differ");
+        }
+
+        Rect area = region.value_or(Rect{.x = 0, .y = 0, .width = frame.width, .height = frame.height});
+        area.x = std::min(area.x, frame.width);
+        area.y = std::min(area.y, frame.height);
+        area.width = std::min(area.width, frame.width - area.x);
+        area.height = std::min(area.height, frame.height - area.y);
+
+        if (area.width < pattern.width() || area.height < pattern.height())
+        {
+            return std::nullopt;
+        }
+
+        auto const level = internal::simd_level();
+        auto const sad_row = internal::sad_row(level);
+        auto const correlate_row = internal::correlate_row(level);
+
+        auto score = [&](Frame const& image, Template::Level const& target, uint32_t const x,
+                         uint32_t const y) -> double {
+            uint32_t const row_size = target.width * 4;
+            double const samples = 3.0 * target.width * target.height;
+            uint8_t const* origin = image.data.data() + static_cast<size_t>(y) * image.stride + x * 4;
+
+            if (match_options.method == MatchMethod::SAD)
+            {
+                uint64_t difference = 0;
+                for (uint32_t j = 0; j < target.height; ++j)
+                {
+                    difference += sad_row(origin + static_cast<size_t>(j) * image.stride,
+                                          target.pixels.data() + static_cast<size_t>(j) * row_size, row_size);
+                }
+                return 1.0 - static_cast<double>(difference) / (255.0 * samples);
+            }
+
+            internal::CorrelationSums sums{};
+            for (uint32_t j = 0; j < target.height; ++j)
+            {
+                auto const row = correlate_row(origin + static_cast<size_t>(j) * image.stride,
+                                               target.pixels.data() + static_cast<size_t>(j) * row_size, row_size);
+                sums.sum += row.sum;
+                sums.squares += row.squares;
+                sums.products += row.products;
+            }
+
+            double const sum = static_cast<double>(sums.sum);
+            double const frame_variance = static_cast<double>(sums.squares) - sum * sum / samples;
+            double const target_variance =
+                static_cast<double>(target.squares) - static_cast<double>(target.sum) * target.sum / samples;
+
+            // Flat areas have no correlation, so only their brightness is compared (the variance of the area that
+            // is not flat is at least one, less is the rounding error)
+            if (frame_variance < 0.5 || target_variance < 0.5)
+            {
+                if (frame_variance >= 0.5 || target_variance >= 0.5)
+                {
+                    return 0.0;
+                }
+                return 1.0 - std::abs(sum - static_cast<double>(target.sum)) / (255.0 * samples);
+            }
+            return (static_cast<double>(sums.products) - sum * target.sum / samples) /
+                   std::sqrt(frame_variance * target_variance);
+        };
+
+        // Builds the pyramid of the region while the template still fits into it
+        std::vector<Frame> images{internal::crop(frame, area)};
+        uint32_t const top_limit =
+            std::min(match_options.pyramid_levels, static_cast<uint32_t>(pattern.levels.size() - 1));
+        pyramid.resize(top_limit);
+
+        while (images.size() <= top_limit)
+        {
+            auto const& target = pattern.levels[images.size()];
+            if ((images.back().width / 2) < target.width || (images.back().height / 2) < target.height)
+            {
+                break;
+            }
+            images.push_back(downscale(images.back(), 2, pyramid[images.size() - 1]));
+        }
+        uint32_t const top = static_cast<uint32_t>(images.size() - 1);
+
+        // Exhaustive search on the coarsest level
+        auto const& image = images[top];
+        auto const& target = pattern.levels[top];
+        uint32_t const columns = image.width - target.width + 1;
+        uint32_t const rows = image.height - target.height + 1;
+
+        scores.resize(static_cast<size_t>(columns) * rows);
+        for (uint32_t y = 0; y < rows; ++y)
+        {
+            for (uint32_t x = 0; x < columns; ++x)
+            {
+                scores[static_cast<size_t>(y) * columns + x] = static_cast<float>(score(image, target, x, y));
+            }
+        }
+
+        // Takes the best positions apart from each other, so one object does not occupy every candidate
+        std::vector<std::tuple<uint32_t, uint32_t, double>> candidates;
+        uint32_t const radius = std::max(1u, std::min(target.width, target.height) / 2);
+
+        for (uint32_t k = 0; k < std::max(match_options.candidates, 1u); ++k)
+        {
+            auto const best = std::ranges::max_element(scores);
+            if (*best == -std::numeric_limits<float>::infinity())
+            {
+                break;
+            }
+
+            uint32_t const index = static_cast<uint32_t>(best - scores.begin());
+            uint32_t const x = index % columns;
+            uint32_t const y = index / columns;
+            candidates.emplace_back(x, y, *best);
+
+            for (uint32_t j = y - std::min(y, radius); j <= std::min(y + radius, rows - 1); ++j)
+            {
+                for (uint32_t i = x - std::min(x, radius); i <= std::min(x + radius, columns - 1); ++i)
+                {
+                    scores[static_cast<size_t>(j) * columns + i] = -std::numeric_limits<float>::infinity();
+                }
+            }
+        }
+
+        // Refines the candidates on the finer levels within a few pixels of the upscaled position
+        for (int32_t l = static_cast<int32_t>(top) - 1; l >= 0; --l)
+        {
+            auto const& finer_image = images[l];
+            auto const& finer_target = pattern.levels[l];
+            uint32_t const last_x = finer_image.width - finer_target.width;
+            uint32_t const last_y = finer_image.height - finer_target.height;
+
+            for (auto& [x, y, value] : candidates)
+            {
+                uint32_t const center_x = std::min(x * 2, last_x);
+                uint32_t const center_y = std::min(y * 2, last_y);
+
+                value = -std::numeric_limits<double>::infinity();
+                for (uint32_t j = center_y - std::min(center_y, 2u); j <= std::min(center_y + 2, last_y); ++j)
+                {
+                    for (uint32_t i = center_x - std::min(center_x, 2u); i <= std::min(center_x + 2, last_x); ++i)
+                    {
+                        double const current = score(finer_image, finer_target, i, j);
+                        if (current > value)
+                        {
+                            value = current;
+                            x = i;
+                            y = j;
+                        }
+                    }
+                }
+            }
+        }
+
+        auto const best = std::ranges::max_element(
+            candidates, {}, [](auto const& candidate) { return std::get<2>(candidate); });
+        if (best == candidates.end() || std::get<2>(*best) < match_options.threshold)
+        {
+            return std::nullopt;
+        }
+        return Match{.rect = Rect{.x = area.x + std::get<0>(*best),
+                                  .y = area.y + std::get<1>(*best),
+                                  .width = pattern.width(),
+                                  .height = pattern.height()},
+                     .score = std::get<2>(*best)};
+    }
+
+    auto TemplateMatcher::options() const -> MatchOptions const&
+    {
+        return match_options;
+    }
+} // namespace memucpp
@@ -1,64 +1,47 @@
 // Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
 
 #include "memucpp.hpp"
+#include "memucpp/adb.hpp"
+#include "memucpp/async.hpp"
+#include "memucpp/record.hpp"
+#include "capture.hpp"
+#include "metrics.hpp"
+#include "parse.hpp"
+#include "memucpp/shell.hpp"
+#include "process.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#ifdef _WIN32
 #define NOMINMAX
 #include <windows.h>
 #undef NOMINMAX
+#endif
 
 namespace memucpp
 {
     namespace internal
     {
-        auto subprocess_execute(std::span<std::string const> const arguments) -> std::optional<std::vector<uint8_t>>
+        auto subprocess_execute(std::span<std::string const> const arguments) -> std::span<uint8_t const>
         {
-            std::array<uint8_t, 256> buffer;
-            std::vector<uint8_t> result;
+            // The output buffer is reused by every command on this thread
+            thread_local std::vector<uint8_t> output;
 
-            std::stringstream stream;
-
-            bool first = true;
-            for (auto const& argument : arguments)
-            {
-                if (!first)
-                {
-                    stream << " ";
-                }
-                stream << argument;
-                first = false;
-            }
-
-            FILE* pipe = ::_popen(stream.str().c_str(), "rb");
-            if (!pipe)
+            auto const result = process_backend->execute(arguments, output, process_timeout);
+            if (result.timed_out)
             {
-                return std::nullopt;
-            }
-
-            try
-            {
-                while (pipe)
-                {
-                    size_t const read_bytes = ::fread(buffer.data(), sizeof(uint8_t), 128, pipe);
-                    if (read_bytes > 0)
-                    {
-                        result.insert(result.end(), buffer.begin(), std::next(buffer.begin(), read_bytes));
-                    }
-                    else
-                    {
-                        break;
-                    }
-                }
-                ::_pclose(pipe);
-                return result;
-            }
-            catch (...)
-            {
-                ::_pclose(pipe);
-                return std::nullopt;
+                throw error("MEmuc command timed out");
             }
+            return std::span<uint8_t const>(output.data(), result.size);
         }
 
         auto to_utf_8(std::span<uint8_t const> const source) -> std::string
         {
+            Probe probe(Metric::TextDecode);
+            probe.add_bytes(source.size());
+
+#ifdef _WIN32
             size_t size = ::MultiByteToWideChar(CP_ACP, 0, reinterpret_cast<char const*>(source.data()),
                                                 static_cast<int32_t>(source.size()), nullptr, 0);
 
@@ -74,292 +57,1172 @@ namespace memucpp
             ::WideCharToMultiByte(CP_UTF8, 0, wsource.data(), static_cast<int32_t>(wsource.size()), out.data(),
                                   static_cast<int32_t>(out.size()), nullptr, nullptr);
             return out;
+#else
+            return std::string(reinterpret_cast<char const*>(source.data()), source.size());
+#endif
+        }
+
+        /*!
+            \brief Returns the output as UTF-8, the ASCII output is viewed without the conversion
+            \param storage keeps the converted output
+        */
+        auto text_view(std::span<uint8_t const> const source, std::string& storage) -> std::string_view
+        {
+            if (is_ascii(source))
+            {
+                return std::string_view(reinterpret_cast<char const*>(source.data()), source.size());
+            }
+            storage = to_utf_8(source);
+            return storage;
+        }
+
+        /*!
+            \brief Returns the arguments of the memuc command that takes the VM after the action
+        */
+        auto vm_action(std::string_view const action, uint16_t const vm_index) -> std::vector<std::string>
+        {
+            return {memuc_path.string(), std::string(action), "-i", std::to_string(vm_index)};
+        }
+
+        /*!
+            \brief Returns the arguments of the memuc command that takes the VM before the command
+        */
+        auto vm_command(uint16_t const vm_index, std::vector<std::string> const& command) -> std::vector<std::string>
+        {
+            std::vector<std::string> arguments{memuc_path.string(), "-i", std::to_string(vm_index)};
+            arguments.insert(arguments.end(), command.begin(), command.end());
+            return arguments;
+        }
+
+        /*!
+            \brief Returns the arguments of the device command run through memuc adb
+        */
+        auto adb_command(uint16_t const vm_index, std::string_view const service,
+                         std::vector<std::string> const& command) -> std::vector<std::string>
+        {
+            std::vector<std::string> arguments{"adb", std::string(service)};
+            arguments.insert(arguments.end(), command.begin(), command.end());
+            return vm_command(vm_index, arguments);
+        }
+
+        auto config_parameters(VMConfig const& config) -> std::vector<std::pair<std::string, std::string>>
+        {
+            return {{"is_customed_resolution", "1"},
+                    {"resolution_width", std::to_string(config.width)},
+                    {"resolution_height", std::to_string(config.height)},
+                    {"vbox_dpi", std::to_string(config.dpi)}};
+        }
+
+        /*!
+            \brief Returns the value printed by getconfigex (Value: ...)
+        */
+        auto parse_config(std::span<uint8_t const> const source) -> std::string
+        {
+            auto const output = to_utf_8(source);
+
+            size_t const found = output.find("Value:");
+            if (found == std::string::npos)
+            {
+                throw error("MEmuc is not connected");
+            }
+
+            size_t const start = output.find_first_not_of(' ', found + 6);
+            size_t const end = output.find_first_of("\r\n", start);
+            return start == std::string::npos ? std::string() : output.substr(start, end - start);
+        }
+
+        auto join(std::vector<std::string> const& arguments) -> std::string
+        {
+            std::string out;
+            for (auto const& argument : arguments)
+            {
+                out += out.empty() ? "" : " ";
+                out += argument;
+            }
+            return out;
+        }
+
+        auto check_success(std::span<uint8_t const> const output, std::string_view const message) -> void
+        {
+            std::string storage;
+            if (text_view(output, storage).find("SUCCESS") == std::string_view::npos)
+            {
+                throw error(message);
+            }
+        }
+
+        auto check_connected(std::span<uint8_t const> const output) -> void
+        {
+            std::string storage;
+            if (text_view(output, storage).find("connected") == std::string_view::npos)
+            {
+                throw error("MEmuc is not connected");
+            }
+        }
+
+        // memuc prints the adb connection banner before the output of the device
+        size_t constexpr banner_size = 40;
+
+        /*!
+            \brief Checks the banner of memuc adb and returns the output of the device
+        */
+        auto strip_banner(std::span<uint8_t const> const output) -> std::span<uint8_t const>
+        {
+            auto const banner = output.first(std::min(output.size(), banner_size));
+            check_connected(banner);
+            return output.subspan(banner.size());
+        }
+
+        /*!
+            \brief Parses the output of the screencap (the frame views the output)
+            \return frame and the size of the screencap header
+        */
+        auto parse_screen(std::span<uint8_t const> const output) -> std::tuple<Frame, size_t>
+        {
+            if (output.size() < 3 * sizeof(uint32_t))
+            {
+                throw error("Screen capture is incomplete");
+            }
+
+            std::array<uint32_t, 3> header;
+            std::memcpy(header.data(), output.data(), sizeof(header));
+
+            PixelFormat format;
+            switch (header[2])
+            {
+                case 1:
+                    format = PixelFormat::RGBA8888;
+                    break;
+                case 2:
+                    format = PixelFormat::RGBX8888;
+                    break;
+                case 4:
+                    format = PixelFormat::RGB565;
+                    break;
+                case 5:
+                    format = PixelFormat::BGRA8888;
+                    break;
+                default:
+                    throw error("Screen capture pixel format is not supported");
+            }
+
+            uint32_t const width = header[0];
+            uint32_t const height = header[1];
+            size_t const bytes = static_cast<size_t>(width) * height * bytes_per_pixel(format);
+
+            // Android 10+ appends the color space to the 12 byte header
+            size_t offset = 3 * sizeof(uint32_t);
+            if (output.size() == offset + sizeof(uint32_t) + bytes)
+            {
+                offset += sizeof(uint32_t);
+            }
+
+            if (output.size() < offset + bytes)
+            {
+                throw error("Screen capture is incomplete");
+            }
+
+            return {Frame{.data = output.subspan(offset, bytes),
+                          .width = width,
+                          .height = height,
+                          .stride = width * bytes_per_pixel(format),
+                          .format = format},
+                    offset};
+        }
+
+        /*!
+            \brief Runs the command on the event loop and parses its output on the loop thread
+            \param parse callable that takes the output and its buffer
+        */
+        template <typename Type, typename Parse>
+        auto execute_async(EventLoop& loop, Metric const metric, uint16_t const vm_index,
+                           std::vector<std::string> arguments, FrameBuffer buffer,
+                           std::chrono::milliseconds const timeout, Parse parse) -> AsyncResult<Type>
+        {
+            auto state = std::make_shared<AsyncState<Type>>();
+            state->loop = loop.weak_from_this();
+
+            bool const measured = metrics_active();
+            auto const start = measured ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+            auto completion = [state, buffer, parse = std::move(parse), metric, vm_index, measured,
+                               start](std::exception_ptr const exception, int32_t const, size_t const size) mutable {
+                if (measured)
+                {
+                    record_metric(metric, vm_index, start, size, exception != nullptr);
+                }
+
+                if (exception)
+                {
+                    state->set_exception(exception);
+                    return;
+                }
+
+                try
+                {
+                    std::span<uint8_t const> const output(buffer.data(), size);
+                    if constexpr (std::is_void_v<Type>)
+                    {
+                        parse(output, std::move(buffer));
+                        state->set_value({});
+                    }
+                    else
+                    {
+                        state->set_value(parse(output, std::move(buffer)));
+                    }
+                }
+                catch (...)
+                {
+                    state->set_exception(std::current_exception());
+                }
+            };
+
+            state->command_id = loop.start(std::move(arguments), std::move(buffer), timeout, std::move(completion));
+            return AsyncResult<Type>(state);
         }
     } // namespace internal
 
-    Memuc::Memuc(uint16_t const vm_index, VMConfig const& config) : vm_index(vm_index), image_buffer(8 * 1024 * 1024)
+    auto SpawnBackend::execute(std::span<std::string const> const arguments, std::vector<uint8_t>& output,
+                               std::chrono::milliseconds const timeout) -> ProcessResult
     {
-        // Sets the VM Config
-        {
-            std::vector<std::pair<std::string, std::string>> const parameters{
-                {"is_customed_resolution", "1"},
-                {"resolution_width", std::to_string(config.width)},
-                {"resolution_height", std::to_string(config.height)},
-                {"vbox_dpi", std::to_string(config.dpi)}};
+        size_t const minimum_size = 256 * 1024;
+
+        auto const start = std::chrono::steady_clock::now();
+        auto remaining = [&]() -> std::chrono::milliseconds {
+            if (timeout == std::chrono::milliseconds::max())
+            {
+                return timeout;
+            }
+            auto const elapsed =
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            return std::max(timeout - elapsed, std::chrono::milliseconds(0));
+        };
 
-            for (auto const& parameter : parameters)
+        auto process = [&]() {
+            internal::Probe probe(Metric::ProcessSpawn);
+            return internal::Process(arguments, false);
+        }();
+
+        // Reads straight into the caller's buffer as much as the pipe holds, growing it only when full
+        size_t size = 0;
+        {
+            // The transfer is recorded before the wait starts, so the stages do not overlap
+            internal::Probe transfer(Metric::PipeTransfer);
+            while (true)
             {
-                std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()),
-                                                         "setconfigex",
-                                                         "-i",
-                                                         std::to_string(vm_index),
-                                                         parameter.first,
-                                                         parameter.second};
-                auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
-
-                if (output.find("SUCCESS") == std::string::npos)
+                if (size == output.size())
+                {
+                    output.resize(std::max(output.size() * 2, minimum_size));
+                }
+
+                auto const read_bytes = process.read(
+                    std::span<uint8_t>(output.data() + size, output.size() - size), remaining());
+                if (!read_bytes)
                 {
-                    throw error("MEmuc is not connected");
+                    transfer.fail();
+                    process.kill();
+                    return ProcessResult{.exit_code = process.wait(std::chrono::milliseconds::max()).value_or(-1),
+                                         .timed_out = true,
+                                         .size = size};
                 }
+                else if (read_bytes.value() == 0)
+                {
+                    break;
+                }
+                size += read_bytes.value();
+                transfer.add_bytes(read_bytes.value());
             }
         }
 
+        internal::Probe wait(Metric::ProcessWait);
+        auto exit_code = process.wait(remaining());
+        if (!exit_code)
+        {
+            wait.fail();
+            process.kill();
+            return ProcessResult{.exit_code = process.wait(std::chrono::milliseconds::max()).value_or(-1),
+                                 .timed_out = true,
+                                 .size = size};
+        }
+        return ProcessResult{.exit_code = exit_code.value(), .timed_out = false, .size = size};
+    }
+
+    Memuc::Memuc(uint16_t const vm_index, VMConfig const& config)
+        : vm_index(vm_index), config(config), stop_on_exit(true), frame_pool(FramePool::Shared())
+    {
+        // Sets the VM Config
+        for (auto const& [key, value] : internal::config_parameters(config))
+        {
+            set_config(key, value);
+        }
+
         // Starts the VM
+        internal::check_success(internal::subprocess_execute(internal::vm_action("start", vm_index)),
+                                "An error occurred when starting the VM");
+    }
+
+    Memuc::Memuc(uint16_t const vm_index, VMConfig const& config, ProvisionOptions const& options)
+        : vm_index(vm_index), config(config), stop_on_exit(false), frame_pool(FramePool::Shared())
+    {
+        internal::Probe probe(Metric::Provision, vm_index);
+
+        bool running = false;
+        if (options.attach)
         {
-            std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()), "start", "-i",
-                                                     std::to_string(vm_index)};
-            auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+            auto const vms = list_vms();
+            running = std::ranges::any_of(vms, [&](auto const& vm) { return vm.index == vm_index && vm.enabled; });
+        }
 
-            if (output.find("SUCCESS") == std::string::npos)
-            {
-                throw error("An error occurred when starting the VM");
-            }
+        // Writes of one VM go one by one, memuc rewrites the whole config file of the VM
+        auto const changed = changed_config();
+        for (auto const& [key, value] : changed)
+        {
+            set_config(key, value);
+        }
+
+        if (!running)
+        {
+            internal::check_success(internal::subprocess_execute(internal::vm_action("start", vm_index)),
+                                    "An error occurred when starting the VM");
+            stop_on_exit = options.stop_on_exit;
+        }
+        else if (!changed.empty())
+        {
+            // The resolution and the DPI are applied on the boot
+            reboot();
+        }
+
+        if (options.boot_timeout > std::chrono::milliseconds(0))
+        {
+            wait_boot(options.boot_timeout, options.poll_interval);
         }
     }
 
     Memuc::~Memuc()
     {
-        std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()), "stop", "-i",
-                                                 std::to_string(vm_index)};
-        internal::subprocess_execute(arguments);
+        stop_capture();
+
+        if (!stop_on_exit)
+        {
+            return;
+        }
+
+        try
+        {
+            internal::subprocess_execute(internal::vm_action("stop", vm_index));
+        }
+        catch (...)
+        {
+        }
     }
 
-    Memuc::Memuc(Memuc&& other) : vm_index(other.vm_index), image_buffer(std::move(other.image_buffer))
+    Memuc::Memuc(Memuc&& other) : vm_index(other.vm_index), config(other.config), stop_on_exit(false)
     {
+        *this = std::move(other);
     }
 
     auto Memuc::operator=(Memuc&& other) -> Memuc&
     {
+        stop_capture();
+
+        // The capture thread of the other instance waits until it is bound to this one
+        std::unique_lock<std::mutex> lock;
+        if (other.capture_worker)
+        {
+            lock = other.capture_worker->pause();
+        }
+
         vm_index = other.vm_index;
+        config = other.config;
+        // The moved-from instance must not stop the VM
+        stop_on_exit = std::exchange(other.stop_on_exit, false);
+        frame_pool = std::move(other.frame_pool);
         image_buffer = std::move(other.image_buffer);
+        shell_session = std::move(other.shell_session);
+        capture_worker = std::move(other.capture_worker);
+        event_loop = std::move(other.event_loop);
+        adb_client = std::move(other.adb_client);
+        monitor = std::move(other.monitor);
+        screen_layout = other.screen_layout;
+        touch_screen = std::move(other.touch_screen);
+        frame_recorder = std::move(other.frame_recorder);
+        frame_exporter = std::move(other.frame_exporter);
+
+        if (capture_worker)
+        {
+            capture_worker->rebind(*this);
+        }
         return *this;
     }
 
-    auto Memuc::list_vms() const -> std::vector<VMInfo>
+    auto Memuc::Provision(std::span<uint16_t const> const vm_indices, VMConfig const& config,
+                          ProvisionOptions const& options) -> std::vector<Memuc>
     {
-        std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()), "listvms"};
-        auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+        std::vector<std::optional<Memuc>> instances(vm_indices.size());
+        std::vector<std::exception_ptr> failures(vm_indices.size());
+        std::atomic<size_t> next = 0;
 
-        auto lines = output | std::views::split('\n') |
-                     std::views::filter([&](auto const& element) { return element.size() > 1; });
+        size_t const concurrency =
+            options.concurrency > 0 ? std::min<size_t>(options.concurrency, vm_indices.size()) : vm_indices.size();
+        {
+            // Every worker takes the next VM, so at most concurrency VMs boot at once
+            std::vector<std::jthread> workers;
+            for (size_t i = 0; i < concurrency; ++i)
+            {
+                workers.emplace_back([&]() {
+                    for (size_t k = next++; k < vm_indices.size(); k = next++)
+                    {
+                        try
+                        {
+                            instances[k].emplace(vm_indices[k], config, options);
+                        }
+                        catch (...)
+                        {
+                            failures[k] = std::current_exception();
+                        }
+                    }
+                });
+            }
+        }
 
-        std::vector<VMInfo> out;
+        for (auto const& failure : failures)
+        {
+            if (failure)
+            {
+                std::rethrow_exception(failure);
+            }
+        }
 
-        for (auto const& line : lines)
+        std::vector<Memuc> out;
+        out.reserve(instances.size());
+        for (auto& instance : instances)
         {
-            auto args =
-                line | std::views::split(',') |
-                std::views::transform([](auto&& element) { return std::string_view(element.data(), element.size()); }) |
-                std::ranges::to<std::vector>();
+            out.push_back(std::move(*instance));
+        }
+        return out;
+    }
 
-            VMInfo vm_info{.index = internal::stoi<uint16_t>(args[0]),
-                           .name = std::string(args[1].data(), args[1].size()),
-                           .enabled = static_cast<bool>(internal::stoi<uint16_t>(args[3]))};
-            out.push_back(std::move(vm_info));
+    auto Memuc::wait_boot(std::chrono::milliseconds const timeout, std::chrono::milliseconds const poll_interval)
+        -> void
+    {
+        internal::Probe probe(Metric::BootWait, vm_index);
+
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+
+        while (true)
+        {
+            // adb fails while the guest is starting, such attempts are repeated as well
+            try
+            {
+                std::string output;
+                if (adb_client)
+                {
+                    output = adb_client->shell("getprop sys.boot_completed");
+                }
+                else
+                {
+                    output = internal::to_utf_8(internal::subprocess_execute(
+                        internal::adb_command(vm_index, "shell", {"getprop", "sys.boot_completed"})));
+                    internal::check_connected(std::span<uint8_t const>(
+                        reinterpret_cast<uint8_t const*>(output.data()), output.size()));
+                    output.erase(0, output.find('\n', output.find("connected")));
+                }
+
+                if (output.find('1') != std::string::npos)
+                {
+                    return;
+                }
+            }
+            catch (error const&)
+            {
+                if (std::chrono::steady_clock::now() >= deadline)
+                {
+                    throw;
+                }
+            }
+
+            if (std::chrono::steady_clock::now() + poll_interval > deadline)
+            {
+                throw error("VM boot timed out");
+            }
+            std::this_thread::sleep_for(poll_interval);
         }
+    }
+
+    auto Memuc::owns_vm() const -> bool
+    {
+        return stop_on_exit;
+    }
+
+    auto Memuc::list_vms() const -> std::vector<VMInfo>
+    {
+        std::vector<VMInfo> out;
+        list_vms(out);
         return out;
     }
 
+    auto Memuc::list_vms(std::vector<VMInfo>& out) const -> void
+    {
+        internal::Probe probe(Metric::ListVms, vm_index);
+
+        std::vector<std::string> const arguments{memuc_path.string(), "listvms"};
+        std::string storage;
+        internal::parse_vms(internal::text_view(internal::subprocess_execute(arguments), storage), out);
+    }
+
     auto Memuc::reboot() -> void
     {
-        std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()), "reboot", "-i",
-                                                 std::to_string(vm_index)};
-        auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+        internal::Probe probe(Metric::Reboot, vm_index);
+
+        internal::check_success(internal::subprocess_execute(internal::vm_action("reboot", vm_index)),
+                                "MEmuc is not connected");
+    }
+
+    auto Memuc::start_app(std::string_view const package_name) -> void
+    {
+        internal::Probe probe(Metric::StartApp, vm_index);
+
+        internal::check_success(
+            internal::subprocess_execute(internal::vm_command(vm_index, {"startapp", std::string(package_name)})),
+            "MEmuc is not connected");
+    }
+
+    auto Memuc::stop_app(std::string_view const package_name) -> void
+    {
+        internal::Probe probe(Metric::StopApp, vm_index);
 
-        if (output.find("SUCCESS") == std::string::npos)
+        internal::check_success(
+            internal::subprocess_execute(internal::vm_command(vm_index, {"stopapp", std::string(package_name)})),
+            "MEmuc is not connected");
+    }
+
+    auto Memuc::trigger_key(KeyCode const key_code) -> void
+    {
+        internal::Probe probe(Metric::TriggerKey, vm_index);
+
+        send_input({"input", "keyevent", std::to_string(static_cast<uint32_t>(key_code))});
+    }
+
+    auto Memuc::trigger_swipe(std::tuple<uint32_t, uint32_t> const start_position,
+                              std::tuple<uint32_t, uint32_t> const end_position, uint32_t const speed) -> void
+    {
+        internal::Probe probe(Metric::TriggerSwipe, vm_index);
+
+        send_input({"input", "swipe", std::to_string(std::get<0>(start_position)),
+                    std::to_string(std::get<1>(start_position)), std::to_string(std::get<0>(end_position)),
+                    std::to_string(std::get<1>(end_position)), std::to_string(speed)});
+    }
+
+    auto Memuc::trigger_click(std::tuple<uint32_t, uint32_t> const position) -> void
+    {
+        internal::Probe probe(Metric::TriggerClick, vm_index);
+
+        send_input({"input", "tap", std::to_string(std::get<0>(position)), std::to_string(std::get<1>(position))});
+    }
+
+    auto Memuc::touch_device() -> TouchDevice const&
+    {
+        if (!touch_screen)
         {
-            throw error("MEmuc is not connected");
+            // The ABI tells the size of struct input_event written by the gestures (one shell command line,
+            // whatever the transport does with the separate arguments)
+            auto device = internal::parse_touch_device(shell_output({"getprop ro.product.cpu.abi; getevent -p"}));
+            if (!device)
+            {
+                throw error("Touch screen is not found");
+            }
+
+            device->screen_width = config.width;
+            device->screen_height = config.height;
+            touch_screen = std::move(device);
         }
+        return touch_screen.value();
     }
 
-    auto Memuc::start_app(std::string_view const package_name) -> void
+    auto Memuc::play_gesture(GestureScript const& script) -> void
+    {
+        play_gesture(script.compile(touch_device()));
+    }
+
+    auto Memuc::play_gesture(CompiledGesture const& gesture) -> void
     {
-        std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()), "-i",
-                                                 std::to_string(vm_index), "startapp", std::string(package_name)};
-        auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+        internal::Probe probe(Metric::Gesture, vm_index);
 
-        if (output.find("SUCCESS") == std::string::npos)
+        if (gesture.device != touch_device())
         {
-            throw error("MEmuc is not connected");
+            throw error("Gesture is compiled for the other touch screen");
         }
+        probe.add_bytes(gesture.command.size());
+        send_input({gesture.command});
     }
 
-    auto Memuc::stop_app(std::string_view const package_name) -> void
+    auto Memuc::enable_shell_session(bool const enabled) -> void
     {
-        std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()), "-i",
-                                                 std::to_string(vm_index), "stopapp", std::string(package_name)};
-        auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+        if (!enabled)
+        {
+            shell_session.reset();
+        }
+        else if (!shell_session)
+        {
+            shell_session = std::make_unique<ShellSession>(
+                internal::vm_command(vm_index, {"adb", "shell"}));
+        }
+    }
+
+    auto Memuc::set_config(std::string_view const key, std::string_view const value) -> void
+    {
+        std::vector<std::string> const arguments{
+            memuc_path.string(), "setconfigex", "-i", std::to_string(vm_index), std::string(key), std::string(value)};
+        internal::check_success(internal::subprocess_execute(arguments), "MEmuc is not connected");
+    }
+
+    auto Memuc::changed_config() -> std::vector<std::pair<std::string, std::string>>
+    {
+        auto const parameters = internal::config_parameters(config);
 
-        if (output.find("SUCCESS") == std::string::npos)
+        // Every value is read by its own memuc process, so all of them are read at once
+        std::vector<AsyncResult<std::string>> values;
+        for (auto const& [key, value] : parameters)
         {
-            throw error("MEmuc is not connected");
+            values.push_back(internal::execute_async<std::string>(
+                loop(), Metric::ConfigRead, vm_index,
+                {memuc_path.string(), "getconfigex", "-i", std::to_string(vm_index), key},
+                frame_pool->acquire(text_output_size), process_timeout,
+                [](std::span<uint8_t const> const output, FrameBuffer) { return internal::parse_config(output); }));
         }
+
+        std::vector<std::pair<std::string, std::string>> out;
+        for (size_t i = 0; i < parameters.size(); ++i)
+        {
+            if (values[i].get() != parameters[i].second)
+            {
+                out.push_back(parameters[i]);
+            }
+        }
+        return out;
     }
 
-    auto Memuc::trigger_key(KeyCode const key_code) -> void
+    auto Memuc::enable_adb_transport(bool const enabled, AdbOptions const& options) -> void
     {
-        std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()),
-                                                 "-i",
-                                                 std::to_string(vm_index),
-                                                 "adb",
-                                                 "shell",
-                                                 "input",
-                                                 "keyevent",
-                                                 std::to_string(static_cast<uint32_t>(key_code))};
-        auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+        // The background capture may be reading the screen through the current client
+        std::unique_lock<std::mutex> lock;
+        if (capture_worker)
+        {
+            lock = capture_worker->pause();
+        }
 
-        if (output.find("connected") == std::string::npos)
+        if (!enabled)
         {
-            throw error("MEmuc is not connected");
+            adb_client.reset();
+        }
+        else
+        {
+            adb_client = std::make_unique<AdbClient>(AdbClient::vm_serial(vm_index), options);
         }
     }
 
-    auto Memuc::trigger_swipe(std::tuple<uint32_t, uint32_t> const start_position,
-                              std::tuple<uint32_t, uint32_t> const end_position, uint32_t const speed) -> void
+    auto Memuc::shell_input(std::string_view const command) -> void
     {
-        std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()),
-                                                 "-i",
-                                                 std::to_string(vm_index),
-                                                 "adb",
-                                                 "shell",
-                                                 "input",
-                                                 "swipe",
-                                                 std::to_string(std::get<0>(start_position)),
-                                                 std::to_string(std::get<1>(start_position)),
-                                                 std::to_string(std::get<0>(end_position)),
-                                                 std::to_string(std::get<1>(end_position)),
-                                                 std::to_string(speed)};
-        auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+        auto result = shell_session->execute(command);
 
-        if (output.find("connected") == std::string::npos)
+        if (result.exit_code != 0)
         {
-            throw error("MEmuc is not connected");
+            throw error(std::format("An error occurred when executing the input command ({})", result.exit_code));
         }
     }
 
-    auto Memuc::trigger_click(std::tuple<uint32_t, uint32_t> const position) -> void
+    auto Memuc::send_input(std::vector<std::string> const& arguments) -> void
     {
-        std::vector<std::string> const arguments{std::format("\"{}\"", memuc_path.string()),
-                                                 "-i",
-                                                 std::to_string(vm_index),
-                                                 "adb",
-                                                 "shell",
-                                                 "input",
-                                                 "tap",
-                                                 std::to_string(std::get<0>(position)),
-                                                 std::to_string(std::get<1>(position))};
-        auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+        std::shared_ptr<FrameRecorder> recorder;
+        {
+            std::lock_guard lock(hook_mutex);
+            recorder = frame_recorder;
+        }
+        if (recorder)
+        {
+            recorder->record_input(internal::join(arguments));
+        }
+
+        if (shell_session)
+        {
+            shell_input(internal::join(arguments));
+        }
+        else if (adb_client)
+        {
+            adb_client->shell(internal::join(arguments));
+        }
+        else
+        {
+            internal::check_connected(internal::subprocess_execute(internal::adb_command(vm_index, "shell", arguments)));
+        }
+    }
 
-        if (output.find("connected") == std::string::npos)
+    auto Memuc::shell_output(std::vector<std::string> const& arguments) -> std::string
+    {
+        if (shell_session)
         {
-            throw error("MEmuc is not connected");
+            return shell_session->execute(internal::join(arguments)).output;
         }
+        else if (adb_client)
+        {
+            return adb_client->shell(internal::join(arguments));
+        }
+
+        auto output = internal::to_utf_8(
+            internal::subprocess_execute(internal::adb_command(vm_index, "shell", arguments)));
+        internal::check_connected(
+            std::span<uint8_t const>(reinterpret_cast<uint8_t const*>(output.data()), output.size()));
+        output.erase(0, output.find('\n', output.find("connected")));
+        return output;
+    }
+
+    auto Memuc::exec_out(std::vector<std::string> const& arguments, FrameBuffer& buffer) const
+        -> std::span<uint8_t const>
+    {
+        if (adb_client)
+        {
+            size_t const size = adb_client->exec(internal::join(arguments), buffer.storage());
+            return std::span<uint8_t const>(buffer.data(), size);
+        }
+
+        auto const result =
+            process_backend->execute(internal::adb_command(vm_index, "exec-out", arguments), buffer.storage(),
+                                     process_timeout);
+        if (result.timed_out)
+        {
+            throw error("MEmuc command timed out");
+        }
+        return internal::strip_banner(std::span<uint8_t const>(buffer.data(), result.size));
     }
 
     auto Memuc::list_process() const -> std::vector<ProcessInfo>
     {
-        std::vector<std::string> const arguments{
-            std::format("\"{}\"", memuc_path.string()), "-i", std::to_string(vm_index), "adb", "shell", "ps"};
-        auto output = internal::to_utf_8(internal::subprocess_execute(arguments).value());
+        std::vector<ProcessInfo> out;
+        list_process(out);
+        return out;
+    }
 
-        std::string_view const message(output.data(), output.data() + 40);
+    auto Memuc::list_process(std::vector<ProcessInfo>& out) const -> void
+    {
+        internal::Probe probe(Metric::ListProcess, vm_index);
 
-        if (message.find("connected") == std::string::npos)
+        if (monitor && monitor->ready())
         {
-            throw error("MEmuc is not connected");
+            // Same selection as the parsed ps output, the table is ordered by the process id like ps
+            auto const processes = monitor->processes();
+            auto const applications = processes | std::views::filter([](auto const& process) {
+                                          return process.name.find("com.") != std::string::npos;
+                                      }) |
+                                      std::ranges::to<std::vector>();
+
+            out.resize(applications.size() > 2 ? applications.size() - 2 : 0);
+            for (size_t i = 0; i < out.size(); ++i)
+            {
+                auto const& process = applications[i + 1];
+                out[i].name.assign(process.name);
+                out[i].pid = process.pid;
+                out[i].ppid = process.ppid;
+                out[i].rss = process.rss;
+                out[i].state = process.state;
+            }
+            return;
         }
 
-        std::string_view const data(output.data() + 40, output.data() + output.size());
+        if (adb_client)
+        {
+            internal::parse_processes(adb_client->shell("ps"), out);
+            return;
+        }
 
-        auto lines =
-            data | std::views::split('\n') |
-            std::views::transform([](auto&& element) { return std::string_view(element.data(), element.size()); }) |
-            std::views::filter([](auto&& element) { return element.find("com.") != std::string::npos; }) |
-            std::ranges::to<std::vector>() | std::views::drop(1) | std::views::reverse | std::views::drop(1) |
-            std::views::reverse;
+        std::string storage;
+        internal::parse_processes(
+            internal::text_view(internal::strip_banner(internal::subprocess_execute(
+                                    internal::adb_command(vm_index, "shell", {"ps"}))),
+                                storage),
+            out);
+    }
 
-        std::vector<ProcessInfo> out;
+    auto Memuc::capture() -> Frame
+    {
+        internal::Probe probe(Metric::Capture, vm_index);
+
+        auto frame = std::get<0>(read_screen());
+        probe.add_bytes(frame.data.size());
+        return frame;
+    }
 
-        for (auto const& line : lines)
+    auto Memuc::read_screen() -> std::tuple<Frame, ScreenLayout>
+    {
+        // Banner, header and pixels of the configured resolution, plus room to detect the end of stream
+        auto buffer = frame_pool->acquire(internal::banner_size + 4 * sizeof(uint32_t) +
+                                          static_cast<size_t>(config.width) * config.height * 4 + 4096);
+
+        auto [frame, header] = internal::parse_screen(exec_out({"screencap"}, buffer));
+        frame.buffer = std::move(buffer);
         {
-            ProcessInfo process_info{.name = std::string(line.begin() + line.find("com."), line.begin() + line.size())};
-            out.push_back(process_info);
+            std::lock_guard lock(hook_mutex);
+            if (frame_recorder)
+            {
+                frame_recorder->record(frame);
+            }
+            if (frame_exporter)
+            {
+                frame_exporter->publish(frame);
+            }
         }
-        return out;
+
+        ScreenLayout const layout{.header = header, .width = frame.width, .height = frame.height, .format = frame.format};
+        return {std::move(frame), layout};
     }
 
-    auto Memuc::screen_cap() -> std::span<uint8_t const>
+    auto Memuc::capture_region(Rect const& region, uint32_t const factor) -> RegionFrame
     {
-        std::vector<std::string> const arguments{
-            std::format("\"{}\"", memuc_path.string()), "-i", std::to_string(vm_index), "adb", "exec-out", "screencap"};
-        auto output = internal::subprocess_execute(arguments).value();
+        internal::Probe probe(Metric::CaptureRegion, vm_index);
 
-        auto message = internal::to_utf_8(std::span<uint8_t const>(output.data(), output.data() + 40));
+        if (factor == 0)
+        {
+            throw error("Downscale factor must be positive");
+        }
+
+        Frame frame;
+
+        // The layout of the screencap output is learned from the first full capture
+        if (!screen_layout)
+        {
+            std::tie(frame, screen_layout) = read_screen();
+        }
 
-        if (message.find("connected") == std::string::npos)
+        Rect const area{.x = std::min(region.x, screen_layout->width),
+                        .y = std::min(region.y, screen_layout->height),
+                        .width = std::min(region.width, screen_layout->width - std::min(region.x, screen_layout->width)),
+                        .height =
+                            std::min(region.height, screen_layout->height - std::min(region.y, screen_layout->height))};
+        if (area.width < factor || area.height < factor)
         {
-            throw error("MEmuc is not connected");
+            throw error("Screen region is empty");
         }
 
-        uint32_t width;
-        uint32_t height;
-        uint64_t offset;
+        uint32_t const pixel_size = bytes_per_pixel(screen_layout->format);
+        uint32_t const stride = screen_layout->width * pixel_size;
+
+        if (frame.data.empty())
         {
-            std::basic_ispanstream<uint8_t> stream(
-                std::span<uint8_t>(output.data() + 40, output.data() + output.size()), std::ios::binary);
+            // Cuts the rows of the region on the device, so only they go through adb and the pipe
+            size_t const skip = screen_layout->header + static_cast<size_t>(area.y) * stride;
+            size_t const bytes = static_cast<size_t>(area.height) * stride;
+
+            auto buffer = frame_pool->acquire(internal::banner_size + bytes + 4096);
+            auto const output = exec_out(
+                {"screencap", "|", "tail", "-c", std::format("+{}", skip + 1), "|", "head", "-c", std::to_string(bytes)},
+                buffer);
 
-            stream.read(reinterpret_cast<uint8_t*>(&width), sizeof(uint32_t));
-            stream.read(reinterpret_cast<uint8_t*>(&height), sizeof(uint32_t));
-            stream.seekg(sizeof(uint32_t), std::ios::cur);
+            // The screen may have been resized or rotated since the layout was learned
+            if (output.size() != bytes)
+            {
+                screen_layout.reset();
+                throw error("Screen capture is incomplete");
+            }
 
-            offset = static_cast<uint64_t>(stream.tellg()) + 40;
+            frame = Frame{.data = output,
+                          .width = screen_layout->width,
+                          .height = area.height,
+                          .stride = stride,
+                          .format = screen_layout->format,
+                          .buffer = std::move(buffer)};
         }
+        else
+        {
+            frame.data = frame.data.subspan(static_cast<size_t>(area.y) * stride);
+            frame.height = area.height;
+        }
+
+        // Leaves the columns of the region only
+        frame.data = frame.data.subspan(static_cast<size_t>(area.x) * pixel_size);
+        frame.width = area.width;
 
-        size_t bytes;
+        probe.add_bytes(frame.data.size());
+        if (factor == 1)
         {
-            std::basic_ospanstream<uint8_t> stream(std::span<uint8_t>(image_buffer.data(), image_buffer.size()),
-                                                   std::ios::binary);
+            return RegionFrame{.frame = std::move(frame), .region = area, .factor = factor};
+        }
 
-            uint32_t const alignment = 4;
-            uint32_t const mask = alignment - 1;
+        auto output = frame_pool->acquire(static_cast<size_t>(area.width / factor) * (area.height / factor) *
+                                          pixel_size);
+        auto small = downscale(frame, factor, output.storage());
+        small.buffer = std::move(output);
 
-            uint32_t const row_size = width * 3;
-            uint32_t const align_width = (row_size + mask) & ~mask;
+        return RegionFrame{.frame = std::move(small), .region = area, .factor = factor};
+    }
 
-            uint32_t const bitmap_size = align_width * height;
+    auto Memuc::screen_cap() -> std::span<uint8_t const>
+    {
+        internal::Probe probe(Metric::ScreenCap, vm_index);
 
-            BITMAPFILEHEADER file_header{.bfType = 0x4D42,
-                                         .bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)};
-            BITMAPINFOHEADER info_header{.biSize = sizeof(BITMAPINFOHEADER),
-                                         .biWidth = static_cast<LONG>(width),
-                                         .biHeight = static_cast<LONG>(height),
-                                         .biPlanes = 1,
-                                         .biBitCount = 24};
-            file_header.bfSize = bitmap_size + file_header.bfOffBits;
+        auto frame = std::get<0>(read_screen());
 
-            stream.write(reinterpret_cast<uint8_t const*>(&file_header), sizeof(BITMAPFILEHEADER));
-            stream.write(reinterpret_cast<uint8_t const*>(&info_header), sizeof(BITMAPINFOHEADER));
+        // Returns the previous bitmap to the pool before taking the one of the new size
+        image_buffer = FrameBuffer();
+        image_buffer = frame_pool->acquire(bmp_size(frame.width, frame.height));
+        auto const bitmap = encode_bmp(frame, image_buffer.storage());
+        probe.add_bytes(bitmap.size());
+        return bitmap;
+    }
 
-            // Move at end bitmap buffer for vertical mirror
-            offset += width * height * 4;
+    auto Memuc::set_recorder(std::shared_ptr<FrameRecorder> recorder) -> void
+    {
+        // The background capture records too, it must not use the replaced recorder
+        std::unique_lock<std::mutex> lock;
+        if (capture_worker)
+        {
+            lock = capture_worker->pause();
+        }
+
+        std::lock_guard hook_lock(hook_mutex);
+        frame_recorder = std::move(recorder);
+    }
 
-            for (uint32_t const j : std::views::iota(0u, height))
+    auto Memuc::classify_screen(ScreenStateIndex const& index) -> std::optional<StateMatch>
+    {
+        return index.classify(capture());
+    }
+
+    auto Memuc::wait_state(ScreenStateIndex const& index, std::string_view const label,
+                           std::chrono::milliseconds const timeout, StateWaitOptions const& options) -> StateMatch
+    {
+        return wait_state(index, std::span<std::string_view const>(&label, 1), timeout, options);
+    }
+
+    auto Memuc::wait_state(ScreenStateIndex const& index, std::span<std::string_view const> const labels,
+                           std::chrono::milliseconds const timeout, StateWaitOptions const& options) -> StateMatch
+    {
+        internal::Probe probe(Metric::StateWait, vm_index);
+
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+        auto interval = options.min_interval;
+        std::optional<uint64_t> previous;
+
+        while (true)
+        {
+            auto const frame = capture();
+            if (auto match = index.classify(frame); match && std::ranges::find(labels, match->label) != labels.end())
             {
-                for (uint32_t const i : std::views::iota(0u, width))
-                {
-                    stream.write(output.data() + offset + i * 4 + 2, sizeof(uint8_t)); // R
-                    stream.write(output.data() + offset + i * 4 + 1, sizeof(uint8_t)); // G
-                    stream.write(output.data() + offset + i * 4 + 0, sizeof(uint8_t)); // B
-                }
+                return *match;
+            }
 
-                // Add padding if the image has 24 bit per pixel
-                stream.seekp(align_width - width * 3, std::ios::cur);
+            // The still screen is polled less often, the changing one at the minimum interval
+            uint64_t const hash =
+                perceptual_hash(frame, Rect{.x = 0, .y = 0, .width = frame.width, .height = frame.height});
+            interval = previous == hash ? std::min(interval * 2, options.max_interval) : options.min_interval;
+            previous = hash;
 
-                offset -= width * 4;
+            auto const now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+            {
+                throw error("Screen state wait timed out");
             }
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(interval, deadline - now));
+        }
+    }
+
+    auto Memuc::start_frame_export(FrameExportOptions const& options) -> void
+    {
+        // The background capture publishes too, it must not use the replaced exporter
+        std::unique_lock<std::mutex> lock;
+        if (capture_worker)
+        {
+            lock = capture_worker->pause();
+        }
 
-            bytes = stream.tellp();
+        // The old exporter removes the name before the new one creates it
+        std::lock_guard hook_lock(hook_mutex);
+        frame_exporter.reset();
+        size_t const frame_size = static_cast<size_t>(config.width) * config.height * 4;
+        frame_exporter = std::make_unique<FrameExporter>(FrameExporter::vm_name(vm_index), frame_size, options);
+    }
+
+    auto Memuc::stop_frame_export() -> void
+    {
+        std::unique_lock<std::mutex> lock;
+        if (capture_worker)
+        {
+            lock = capture_worker->pause();
         }
-        return std::span<uint8_t const>(image_buffer.data(), bytes);
+
+        std::lock_guard hook_lock(hook_mutex);
+        frame_exporter.reset();
+    }
+
+    auto Memuc::set_frame_pool(std::shared_ptr<FramePool> pool) -> void
+    {
+        frame_pool = std::move(pool);
+    }
+
+    auto Memuc::set_event_loop(std::shared_ptr<EventLoop> loop) -> void
+    {
+        event_loop = std::move(loop);
+    }
+
+    auto Memuc::loop() const -> EventLoop&
+    {
+        if (!event_loop)
+        {
+            event_loop = EventLoop::Shared();
+        }
+        return *event_loop;
+    }
+
+    auto Memuc::list_vms_async(std::chrono::milliseconds const timeout) const -> AsyncResult<std::vector<VMInfo>>
+    {
+        return internal::execute_async<std::vector<VMInfo>>(
+            loop(), Metric::ListVms, vm_index, {memuc_path.string(), "listvms"}, frame_pool->acquire(text_output_size),
+            timeout,
+            [](std::span<uint8_t const> const output, FrameBuffer) {
+                std::string storage;
+                std::vector<VMInfo> out;
+                internal::parse_vms(internal::text_view(output, storage), out);
+                return out;
+            });
+    }
+
+    auto Memuc::reboot_async(std::chrono::milliseconds const timeout) -> AsyncResult<void>
+    {
+        return internal::execute_async<void>(
+            loop(), Metric::Reboot, vm_index, internal::vm_action("reboot", vm_index),
+            frame_pool->acquire(text_output_size), timeout, [](std::span<uint8_t const> const output, FrameBuffer) {
+                internal::check_success(output, "MEmuc is not connected");
+            });
+    }
+
+    auto Memuc::start_app_async(std::string_view const package_name, std::chrono::milliseconds const timeout)
+        -> AsyncResult<void>
+    {
+        return internal::execute_async<void>(
+            loop(), Metric::StartApp, vm_index, internal::vm_command(vm_index, {"startapp", std::string(package_name)}),
+            frame_pool->acquire(text_output_size), timeout, [](std::span<uint8_t const> const output, FrameBuffer) {
+                internal::check_success(output, "MEmuc is not connected");
+            });
+    }
+
+    auto Memuc::stop_app_async(std::string_view const package_name, std::chrono::milliseconds const timeout)
+        -> AsyncResult<void>
+    {
+        return internal::execute_async<void>(
+            loop(), Metric::StopApp, vm_index, internal::vm_command(vm_index, {"stopapp", std::string(package_name)}),
+            frame_pool->acquire(text_output_size), timeout, [](std::span<uint8_t const> const output, FrameBuffer) {
+                internal::check_success(output, "MEmuc is not connected");
+            });
+    }
+
+    auto Memuc::trigger_key_async(KeyCode const key_code, std::chrono::milliseconds const timeout)
+        -> AsyncResult<void>
+    {
+        return internal::execute_async<void>(
+            loop(), Metric::TriggerKey, vm_index,
+            internal::adb_command(vm_index, "shell",
+                                  {"input", "keyevent", std::to_string(static_cast<uint32_t>(key_code))}),
+            frame_pool->acquire(text_output_size), timeout,
+            [](std::span<uint8_t const> const output, FrameBuffer) { internal::check_connected(output); });
+    }
+
+    auto Memuc::trigger_swipe_async(std::tuple<uint32_t, uint32_t> const start_position,
+                                    std::tuple<uint32_t, uint32_t> const end_position, uint32_t const speed,
+                                    std::chrono::milliseconds const timeout) -> AsyncResult<void>
+    {
+        return internal::execute_async<void>(
+            loop(), Metric::TriggerSwipe, vm_index,
+            internal::adb_command(vm_index, "shell",
+                                  {"input", "swipe", std::to_string(std::get<0>(start_position)),
+                                   std::to_string(std::get<1>(start_position)),
+                                   std::to_string(std::get<0>(end_position)),
+                                   std::to_string(std::get<1>(end_position)), std::to_string(speed)}),
+            frame_pool->acquire(text_output_size), timeout,
+            [](std::span<uint8_t const> const output, FrameBuffer) { internal::check_connected(output); });
+    }
+
+    auto Memuc::trigger_click_async(std::tuple<uint32_t, uint32_t> const position,
+                                    std::chrono::milliseconds const timeout) -> AsyncResult<void>
+    {
+        return internal::execute_async<void>(
+            loop(), Metric::TriggerClick, vm_index,
+            internal::adb_command(vm_index, "shell",
+                                  {"input", "tap", std::to_string(std::get<0>(position)),
+                                   std::to_string(std::get<1>(position))}),
+            frame_pool->acquire(text_output_size), timeout,
+            [](std::span<uint8_t const> const output, FrameBuffer) { internal::check_connected(output); });
+    }
+
+    auto Memuc::list_process_async(std::chrono::milliseconds const timeout) const
+        -> AsyncResult<std::vector<ProcessInfo>>
+    {
+        return internal::execute_async<std::vector<ProcessInfo>>(
+            loop(), Metric::ListProcess, vm_index, internal::adb_command(vm_index, "shell", {"ps"}),
+            frame_pool->acquire(text_output_size), timeout,
+            [](std::span<uint8_t const> const output, FrameBuffer) {
+                std::string storage;
+                std::vector<ProcessInfo> out;
+                internal::parse_processes(internal::text_view(internal::strip_banner(output), storage), out);
+                return out;
+            });
+    }
+
+    auto Memuc::capture_async(std::chrono::milliseconds const timeout) -> AsyncResult<Frame>
+    {
+        return internal::execute_async<Frame>(
+            loop(), Metric::Capture, vm_index, internal::adb_command(vm_index, "exec-out", {"screencap"}),
+            frame_pool->acquire(internal::banner_size + 4 * sizeof(uint32_t) +
+                                static_cast<size_t>(config.width) * config.height * 4 + 4096),
+            timeout, [](std::span<uint8_t const> const output, FrameBuffer buffer) {
+                auto frame = std::get<0>(internal::parse_screen(internal::strip_banner(output)));
+                frame.buffer = std::move(buffer);
+                return frame;
+            });
+    }
+
+    auto Memuc::start_capture(CaptureOptions const& options) -> void
+    {
+        stop_capture();
+        capture_worker = std::make_unique<internal::CaptureWorker>(*this, options);
+    }
+
+    auto Memuc::stop_capture() -> void
+    {
+        capture_worker.reset();
+    }
+
+    auto Memuc::latest_frame() -> std::optional<CapturedFrame>
+    {
+        if (!capture_worker)
+        {
+            throw error("Background capture is not started");
+        }
+        return capture_worker->latest();
+    }
+
+    auto Memuc::start_app_monitor(AppMonitorOptions const& options) -> AppMonitor&
+    {
+        if (!monitor)
+        {
+            monitor = std::make_unique<AppMonitor>(internal::vm_command(vm_index, {"adb", "shell"}), options);
+        }
+        return *monitor;
+    }
+
+    auto Memuc::stop_app_monitor() -> void
+    {
+        monitor.reset();
+    }
+
+    auto Memuc::app_monitor() -> AppMonitor&
+    {
+        if (!monitor)
+        {
+            throw error("App monitor is not started");
+        }
+        return *monitor;
+    }
+
+    auto Memuc::capture_stats() const -> CaptureStats
+    {
+        return capture_worker ? capture_worker->stats() : CaptureStats{};
     }
 } // namespace memucpp
\ No newline at end of file
@@ -0,0 +1,365 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "metrics.hpp"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <memory>
+#include <mutex>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        std::atomic<uint32_t> metrics_flags = 0;
+
+        thread_local int32_t metrics_vm = -1;
+
+        uint32_t constexpr counters_flag = 1;
+        uint32_t constexpr trace_flag = 2;
+
+        // VMs with the larger index are counted together with the operations without the VM
+        size_t constexpr tracked_vms = 256;
+
+        struct Counters
+        {
+            std::atomic<uint64_t> count;
+            std::atomic<uint64_t> errors;
+            std::atomic<uint64_t> bytes;
+            std::atomic<uint64_t> total;
+            std::atomic<uint64_t> max;
+            std::array<std::atomic<uint64_t>, LatencyStats::bucket_count> buckets;
+        };
+
+        using CounterTable = std::array<Counters, static_cast<size_t>(Metric::Count)>;
+
+        struct TraceEvent
+        {
+            Metric metric;
+            int32_t vm_index;
+            uint32_t thread;
+            std::chrono::steady_clock::time_point start;
+            std::chrono::nanoseconds duration;
+            size_t bytes;
+        };
+
+        /*!
+            \brief Counter tables of the VMs (allocated on the first operation of the VM, never freed)
+        */
+        class MetricsRegistry
+        {
+          public:
+            MetricsRegistry() : started(std::chrono::steady_clock::now().time_since_epoch().count())
+            {
+            }
+
+            ~MetricsRegistry()
+            {
+                for (auto& table : tables)
+                {
+                    delete table.load();
+                }
+            }
+
+            auto table(size_t const slot) -> CounterTable&
+            {
+                CounterTable* current = tables[slot].load(std::memory_order_acquire);
+                if (current)
+                {
+                    return *current;
+                }
+
+                // The loser of the race frees its table
+                auto created = std::make_unique<CounterTable>();
+                if (tables[slot].compare_exchange_strong(current, created.get(), std::memory_order_acq_rel))
+                {
+                    return *created.release();
+                }
+                return *current;
+            }
+
+            auto find(size_t const slot) const -> CounterTable const*
+            {
+                return tables[slot].load(std::memory_order_acquire);
+            }
+
+            auto reset() -> void
+            {
+                for (auto& slot : tables)
+                {
+                    if (CounterTable* table = slot.load(std::memory_order_acquire))
+                    {
+                        for (auto& counters : *table)
+                        {
+                            for (auto* value : {&counters.count, &counters.errors, &counters.bytes, &counters.total,
+                                                &counters.max})
+                            {
+                                value->store(0, std::memory_order_relaxed);
+                            }
+                            for (auto& bucket : counters.buckets)
+                            {
+                                bucket.store(0, std::memory_order_relaxed);
+                            }
+                        }
+                    }
+                }
+                started.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            }
+
+            auto elapsed() const -> std::chrono::steady_clock::duration
+            {
+                return std::chrono::steady_clock::now().time_since_epoch() -
+                       std::chrono::steady_clock::duration(started.load(std::memory_order_relaxed));
+            }
+
+            std::mutex trace_mutex;
+            std::vector<TraceEvent> trace;
+            size_t trace_capacity = 0;
+            std::chrono::steady_clock::time_point trace_started;
+
+          private:
+            std::array<std::atomic<CounterTable*>, tracked_vms + 1> tables{};
+            std::atomic<std::chrono::steady_clock::rep> started;
+        };
+
+        auto registry() -> MetricsRegistry&
+        {
+            static MetricsRegistry instance;
+            return instance;
+        }
+
+        auto thread_number() -> uint32_t
+        {
+            static std::atomic<uint32_t> next = 1;
+            thread_local uint32_t const number = next.fetch_add(1, std::memory_order_relaxed);
+            return number;
+        }
+
+        auto record_metric(Metric const metric, int32_t const vm_index,
+                           std::chrono::steady_clock::time_point const start, size_t const bytes,
+                           bool const failed) -> void
+        {
+            auto const duration = std::chrono::steady_clock::now() - start;
+            uint64_t const nanoseconds =
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+            uint32_t const flags = metrics_flags.load(std::memory_order_relaxed);
+            auto& metrics = registry();
+
+            if (flags & counters_flag)
+            {
+                size_t const slot = vm_index >= 0 && static_cast<size_t>(vm_index) < tracked_vms
+                                        ? static_cast<size_t>(vm_index)
+                                        : tracked_vms;
+                auto& counters = metrics.table(slot)[static_cast<size_t>(metric)];
+
+                counters.count.fetch_add(1, std::memory_order_relaxed);
+                counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+                counters.total.fetch_add(nanoseconds, std::memory_order_relaxed);
+                if (failed)
+                {
+                    counters.errors.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                uint64_t max = counters.max.load(std::memory_order_relaxed);
+                while (nanoseconds > max &&
+                       !counters.max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+                {
+                }
+
+                size_t const bucket = std::min<size_t>(std::max<size_t>(std::bit_width(nanoseconds), 1) - 1,
+                                                       LatencyStats::bucket_count - 1);
+                counters.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (flags & trace_flag)
+            {
+                std::lock_guard lock(metrics.trace_mutex);
+                if (metrics.trace.size() < metrics.trace_capacity)
+                {
+                    metrics.trace.push_back(TraceEvent{.metric = metric,
+                                                       .vm_index = vm_index,
+                                                       .thread = thread_number(),
+                                                       .start = start,
+                                                       .duration = duration,
+                                                       .bytes = bytes});
+                }
+            }
+        }
+    } // namespace internal
+
+    auto metric_name(Metric const metric) -> std::string_view
+    {
+        static std::array<std::string_view, static_cast<size_t>(Metric::Count)> constexpr names{
+            "list_vms",      "reboot",        "start_app",    "stop_app",    "trigger_key",
+            "trigger_swipe", "trigger_click", "list_process", "capture",     "capture_region",
+            "screen_cap",    "provision",     "boot_wait",    "config_read", "gesture",
+            "state_wait",    "process_spawn", "pipe_transfer", "process_wait", "text_decode",
+            "bmp_encode",    "downscale",     "adb_request"};
+
+        return names[static_cast<size_t>(metric)];
+    }
+
+    auto LatencyStats::mean() const -> std::chrono::nanoseconds
+    {
+        return count > 0 ? total / static_cast<int64_t>(count) : std::chrono::nanoseconds(0);
+    }
+
+    auto LatencyStats::percentile(double const fraction) const -> std::chrono::nanoseconds
+    {
+        if (count == 0)
+        {
+            return std::chrono::nanoseconds(0);
+        }
+
+        uint64_t const rank = std::max<uint64_t>(static_cast<uint64_t>(fraction * static_cast<double>(count) + 0.5), 1);
+        uint64_t seen = 0;
+        for (size_t k = 0; k < bucket_count; ++k)
+        {
+            seen += buckets[k];
+            if (seen >= rank)
+            {
+                return std::min(std::chrono::nanoseconds(uint64_t(2) << k), max);
+            }
+        }
+        return max;
+    }
+
+    auto LatencyStats::merge(LatencyStats const& other) -> void
+    {
+        count += other.count;
+        errors += other.errors;
+        bytes += other.bytes;
+        total += other.total;
+        max = std::max(max, other.max);
+        for (size_t k = 0; k < bucket_count; ++k)
+        {
+            buckets[k] += other.buckets[k];
+        }
+    }
+
+    auto MetricsSnapshot::total(Metric const metric) const -> LatencyStats
+    {
+        LatencyStats out{};
+        for (auto const& entry : entries)
+        {
+            if (entry.metric == metric)
+            {
+                out.merge(entry.stats);
+            }
+        }
+        return out;
+    }
+
+    auto MetricsSnapshot::throughput(Metric const metric) const -> double
+    {
+        return total(metric).count / std::max(std::chrono::duration<double>(elapsed).count(), 1e-9);
+    }
+
+    auto Metrics::enable(bool const enabled) -> void
+    {
+        if (enabled && !(internal::metrics_flags.load() & internal::counters_flag))
+        {
+            internal::registry().reset();
+        }
+
+        if (enabled)
+        {
+            internal::metrics_flags.fetch_or(internal::counters_flag);
+        }
+        else
+        {
+            internal::metrics_flags.fetch_and(~internal::counters_flag);
+        }
+    }
+
+    auto Metrics::enabled() -> bool
+    {
+        return internal::metrics_flags.load() & internal::counters_flag;
+    }
+
+    auto Metrics::snapshot() -> MetricsSnapshot
+    {
+        auto& registry = internal::registry();
+
+        MetricsSnapshot out{.entries = {}, .elapsed = registry.elapsed()};
+        for (size_t slot = 0; slot <= internal::tracked_vms; ++slot)
+        {
+            auto const* table = registry.find(slot);
+            if (!table)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < table->size(); ++i)
+            {
+                auto const& counters = (*table)[i];
+
+                LatencyStats stats{.count = counters.count.load(std::memory_order_relaxed),
+                                   .errors = counters.errors.load(std::memory_order_relaxed),
+                                   .bytes = counters.bytes.load(std::memory_order_relaxed),
+                                   .total = std::chrono::nanoseconds(counters.total.load(std::memory_order_relaxed)),
+                                   .max = std::chrono::nanoseconds(counters.max.load(std::memory_order_relaxed)),
+                                   .buckets = {}};
+                if (stats.count == 0)
+                {
+                    continue;
+                }
+                for (size_t k = 0; k < LatencyStats::bucket_count; ++k)
+                {
+                    stats.buckets[k] = counters.buckets[k].load(std::memory_order_relaxed);
+                }
+
+                out.entries.push_back(MetricsEntry{
+                    .metric = static_cast<Metric>(i),
+                    .vm_index = slot < internal::tracked_vms ? std::optional<uint16_t>(static_cast<uint16_t>(slot))
+                                                             : std::nullopt,
+                    .stats = stats});
+            }
+        }
+        return out;
+    }
+
+    auto Metrics::reset() -> void
+    {
+        internal::registry().reset();
+    }
+
+    auto Metrics::start_trace(size_t const capacity) -> void
+    {
+        auto& registry = internal::registry();
+        {
+            std::lock_guard lock(registry.trace_mutex);
+            registry.trace.clear();
+            registry.trace_capacity = capacity;
+            registry.trace_started = std::chrono::steady_clock::now();
+        }
+        internal::metrics_flags.fetch_or(internal::trace_flag);
+    }
+
+    auto Metrics::stop_trace() -> void
+    {
+        internal::metrics_flags.fetch_and(~internal::trace_flag);
+    }
+
+    auto Metrics::write_trace(std::ostream& stream) -> void
+    {
+        auto& registry = internal::registry();
+        std::lock_guard lock(registry.trace_mutex);
+
+        // Complete events ("ph": "X") with the microsecond timestamps relative to the trace start
+        stream << "{\"traceEvents\":[";
+        for (size_t i = 0; i < registry.trace.size(); ++i)
+        {
+            auto const& event = registry.trace[i];
+            auto const start =
+                std::chrono::duration<double, std::micro>(event.start - registry.trace_started).count();
+            auto const duration = std::chrono::duration<double, std::micro>(event.duration).count();
+
+            stream << std::format("{}{{\"name\":\"{}\",\"cat\":\"memucpp\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},"
+                                  "\"pid\":1,\"tid\":{},\"args\":{{\"vm\":{},\"bytes\":{}}}}}",
+                                  i > 0 ? "," : "", metric_name(event.metric), start, duration, event.thread,
+                                  event.vm_index, event.bytes);
+        }
+        stream << "],\"displayTimeUnit\":\"ms\"}";
+    }
+} // namespace memucpp
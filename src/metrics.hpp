@@ -0,0 +1,105 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include "memucpp/metrics.hpp"
+#include <atomic>
+#include <exception>
+#include <utility>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        // Bit 0 enables the counters, bit 1 enables the trace
+        extern std::atomic<uint32_t> metrics_flags;
+
+        // VM of the command running on this thread (-1 is none), the nested stages are counted for it
+        extern thread_local int32_t metrics_vm;
+
+        inline auto metrics_active() -> bool
+        {
+            return metrics_flags.load(std::memory_order_relaxed) != 0;
+        }
+
+        /*!
+            \brief Adds the operation to the counters and the trace
+            \param vm_index the VM index (-1 is none)
+        */
+        auto record_metric(Metric const metric, int32_t const vm_index,
+                           std::chrono::steady_clock::time_point const start, size_t const bytes,
+                           bool const failed) -> void;
+
+        /*!
+            \brief Measures the scope as one operation (failed if it is left by the exception or marked)
+        */
+        class Probe
+        {
+          public:
+            explicit Probe(Metric const metric) : metric(metric), active(metrics_active())
+            {
+                if (active)
+                {
+                    vm_index = metrics_vm;
+                    previous_vm = metrics_vm;
+                    begin();
+                }
+            }
+
+            /*!
+                \brief Measures the command of the VM, the stages inside the scope are counted for the VM
+            */
+            Probe(Metric const metric, uint16_t const vm) : metric(metric), active(metrics_active())
+            {
+                if (active)
+                {
+                    vm_index = vm;
+                    previous_vm = std::exchange(metrics_vm, vm);
+                    begin();
+                }
+            }
+
+            ~Probe()
+            {
+                if (active)
+                {
+                    metrics_vm = previous_vm;
+                    record_metric(metric, vm_index, start, bytes, failed || std::uncaught_exceptions() > exceptions);
+                }
+            }
+
+            Probe(Probe const&) = delete;
+
+            auto operator=(Probe const&) -> Probe& = delete;
+
+            auto add_bytes(size_t const size) -> void
+            {
+                bytes += size;
+            }
+
+            /*!
+                \brief Counts the operation as failed without the exception (e.g. the timeout)
+            */
+            auto fail() -> void
+            {
+                failed = true;
+            }
+
+          private:
+            Metric metric;
+            bool active;
+            int32_t vm_index = -1;
+            int32_t previous_vm = -1;
+            int32_t exceptions = 0;
+            size_t bytes = 0;
+            bool failed = false;
+            std::chrono::steady_clock::time_point start;
+
+            auto begin() -> void
+            {
+                exceptions = std::uncaught_exceptions();
+                start = std::chrono::steady_clock::now();
+            }
+        };
+    } // namespace internal
+} // namespace memucpp
@@ -0,0 +1,383 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/monitor.hpp"
+#include "memucpp.hpp"
+#include "parse.hpp"
+#include "process.hpp"
+#include <algorithm>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        std::string_view constexpr snapshot_marker = "__MEMUCPP_PS__";
+        std::string_view constexpr events_marker = "__MEMUCPP_EVENTS__";
+
+        // Events are streamed from the time of the snapshot, the replayed ones are dropped by the process table
+        std::string_view constexpr monitor_script =
+            "__since=$(date '+%m-%d %H:%M:%S.000'); echo; echo __MEMUCPP_PS__; ps; echo __MEMUCPP_EVENTS__; "
+            "logcat -b events -v brief -T \"$__since\" -s am_proc_start:I am_proc_died:I am_crash:I am_anr:I\n";
+
+        auto split(std::string_view const source, char const delimiter) -> std::vector<std::string_view>
+        {
+            std::vector<std::string_view> out;
+            for (auto const part : source | std::views::split(delimiter))
+            {
+                out.push_back(std::string_view(part.begin(), part.end()));
+            }
+            return out;
+        }
+
+        auto parse_pid(std::string_view const source) -> std::optional<int32_t>
+        {
+            int32_t out;
+            auto const result = std::from_chars(source.data(), source.data() + source.size(), out);
+            if (result.ec != std::errc() || result.ptr != source.data() + source.size())
+            {
+                return std::nullopt;
+            }
+            return out;
+        }
+
+        /*!
+            \brief Parses the activity manager event of logcat in the brief format
+            (e.g. I/am_proc_start( 1421): [0,2345,10060,com.example.app,activity,com.example.app/.Main])
+        */
+        auto parse_app_event(std::string_view const line) -> std::optional<AppEvent>
+        {
+            struct Layout
+            {
+                std::string_view tag;
+                AppEventType type;
+                size_t pid;
+                size_t name;
+                // Field of the detail, it extends to the end of the event for the ANR reason
+                size_t detail;
+            };
+
+            static std::array<Layout, 4> constexpr layouts{
+                Layout{"am_proc_start", AppEventType::Started, 1, 3, 0},
+                Layout{"am_proc_died", AppEventType::Died, 1, 2, 0},
+                Layout{"am_crash", AppEventType::Crashed, 1, 2, 4},
+                Layout{"am_anr", AppEventType::NotResponding, 1, 2, 4}};
+
+            size_t const slash = line.find('/');
+            size_t const parenthesis = line.find('(');
+            size_t const begin = line.find('[');
+            size_t const end = line.rfind(']');
+            if (slash == std::string_view::npos || parenthesis == std::string_view::npos || parenthesis < slash ||
+                begin == std::string_view::npos || end == std::string_view::npos || end < begin)
+            {
+                return std::nullopt;
+            }
+
+            std::string_view tag = line.substr(slash + 1, parenthesis - slash - 1);
+            tag.remove_suffix(tag.size() - std::min(tag.size(), tag.find_last_not_of(' ') + 1));
+
+            auto const layout = std::ranges::find(layouts, tag, &Layout::tag);
+            if (layout == layouts.end())
+            {
+                return std::nullopt;
+            }
+
+            std::string_view const payload = line.substr(begin + 1, end - begin - 1);
+            auto const fields = split(payload, ',');
+            if (fields.size() <= std::max({layout->pid, layout->name, layout->detail}))
+            {
+                return std::nullopt;
+            }
+
+            auto const pid = parse_pid(fields[layout->pid]);
+            if (!pid)
+            {
+                return std::nullopt;
+            }
+
+            std::string detail;
+            if (layout->type == AppEventType::Crashed)
+            {
+                detail = fields[layout->detail];
+            }
+            else if (layout->type == AppEventType::NotResponding)
+            {
+                detail = payload.substr(fields[layout->detail].data() - payload.data());
+            }
+
+            return AppEvent{.type = layout->type,
+                            .pid = pid.value(),
+                            .name = std::string(fields[layout->name]),
+                            .detail = std::move(detail),
+                            .time = std::chrono::system_clock::now()};
+        }
+    } // namespace internal
+
+    AppMonitor::AppMonitor(std::vector<std::string> command, AppMonitorOptions const& options)
+        : command(std::move(command)), options(options), has_snapshot(false), counters{}, next_id(1),
+          thread([this](std::stop_token const stop_token) { run(stop_token); })
+    {
+    }
+
+    AppMonitor::~AppMonitor()
+    {
+        thread.request_stop();
+        thread.join();
+    }
+
+    auto AppMonitor::subscribe(std::string_view const name, AppEventHandler handler) -> uint64_t
+    {
+        std::lock_guard lock(subscription_mutex);
+
+        uint64_t const id = next_id++;
+        subscriptions.push_back(Subscription{
+            .id = id, .name = std::string(name), .handler = std::make_shared<AppEventHandler>(std::move(handler))});
+        return id;
+    }
+
+    auto AppMonitor::unsubscribe(uint64_t const id) -> void
+    {
+        std::lock_guard lock(subscription_mutex);
+        std::erase_if(subscriptions, [&](auto const& subscription) { return subscription.id == id; });
+    }
+
+    auto AppMonitor::processes() const -> std::vector<AppProcess>
+    {
+        std::lock_guard lock(mutex);
+
+        std::vector<AppProcess> out;
+        out.reserve(table.size());
+        for (auto const& [pid, process] : table)
+        {
+            out.push_back(process);
+        }
+        return out;
+    }
+
+    auto AppMonitor::running(std::string_view const name) const -> bool
+    {
+        std::lock_guard lock(mutex);
+        return std::ranges::any_of(table, [&](auto const& process) { return process.second.name == name; });
+    }
+
+    auto AppMonitor::ready() const -> bool
+    {
+        std::lock_guard lock(mutex);
+        return has_snapshot;
+    }
+
+    auto AppMonitor::wait_ready(std::chrono::milliseconds const timeout) const -> bool
+    {
+        std::unique_lock lock(mutex);
+        return loaded.wait_for(lock, timeout, [&]() { return has_snapshot; });
+    }
+
+    auto AppMonitor::stats() const -> AppMonitorStats
+    {
+        std::lock_guard lock(mutex);
+        return counters;
+    }
+
+    auto AppMonitor::run(std::stop_token const stop_token) -> void
+    {
+        while (!stop_token.stop_requested())
+        {
+            try
+            {
+                stream(stop_token);
+            }
+            catch (error const&)
+            {
+                // The shell could not be spawned, it is retried after the delay
+            }
+
+            std::unique_lock lock(mutex);
+            loaded.wait_for(lock, stop_token, options.reconnect_delay, []() { return false; });
+        }
+    }
+
+    auto AppMonitor::stream(std::stop_token const stop_token) -> void
+    {
+        internal::Process process(command, true);
+        {
+            std::lock_guard lock(mutex);
+            ++counters.connections;
+        }
+
+        if (!process.write(std::span<uint8_t const>(reinterpret_cast<uint8_t const*>(internal::monitor_script.data()),
+                                                    internal::monitor_script.size())))
+        {
+            return;
+        }
+
+        enum class Section
+        {
+            Banner,
+            Snapshot,
+            Events
+        };
+
+        Section section = Section::Banner;
+        std::map<int32_t, AppProcess> snapshot;
+        std::string pending;
+        std::array<uint8_t, 16 * 1024> chunk;
+
+        while (!stop_token.stop_requested())
+        {
+            // Short timeout lets the thread notice the stop request
+            auto const read_bytes = process.read(chunk, std::chrono::milliseconds(50));
+            if (!read_bytes)
+            {
+                continue;
+            }
+            else if (read_bytes.value() == 0)
+            {
+                return;
+            }
+            pending.append(reinterpret_cast<char const*>(chunk.data()), read_bytes.value());
+
+            size_t start = 0;
+            for (size_t end = pending.find('\n'); end != std::string::npos; end = pending.find('\n', start))
+            {
+                std::string_view line(pending.data() + start, end - start);
+                start = end + 1;
+                if (line.ends_with('\r'))
+                {
+                    line.remove_suffix(1);
+                }
+
+                // Markers are matched as whole lines, so the echo of the script by the terminal is ignored
+                if (section == Section::Banner && line == internal::snapshot_marker)
+                {
+                    section = Section::Snapshot;
+                }
+                else if (section == Section::Snapshot && line == internal::events_marker)
+                {
+                    apply_snapshot(std::move(snapshot));
+                    section = Section::Events;
+                }
+                else if (section == Section::Snapshot)
+                {
+                    if (auto const process_row = internal::parse_process_row(line))
+                    {
+                        snapshot.emplace(process_row->pid, AppProcess{.pid = process_row->pid,
+                                                                      .name = std::string(process_row->name),
+                                                                      .ppid = process_row->ppid,
+                                                                      .rss = process_row->rss,
+                                                                      .state = process_row->state});
+                    }
+                }
+                else if (section == Section::Events)
+                {
+                    if (auto event = internal::parse_app_event(line))
+                    {
+                        apply_event(std::move(event.value()));
+                    }
+                }
+            }
+            pending.erase(0, start);
+        }
+    }
+
+    auto AppMonitor::apply_snapshot(std::map<int32_t, AppProcess> snapshot) -> void
+    {
+        std::vector<AppEvent> changes;
+        {
+            std::lock_guard lock(mutex);
+
+            // The processes that changed while the channel was down are reported after the reconnect
+            if (has_snapshot)
+            {
+                auto const now = std::chrono::system_clock::now();
+                for (auto const& [pid, process] : table)
+                {
+                    auto const found = snapshot.find(pid);
+                    if (found == snapshot.end() || found->second.name != process.name)
+                    {
+                        changes.push_back(AppEvent{
+                            .type = AppEventType::Died, .pid = pid, .name = process.name, .detail = {}, .time = now});
+                    }
+                }
+                for (auto const& [pid, process] : snapshot)
+                {
+                    auto const found = table.find(pid);
+                    if (found == table.end() || found->second.name != process.name)
+                    {
+                        changes.push_back(AppEvent{.type = AppEventType::Started,
+                                                   .pid = pid,
+                                                   .name = process.name,
+                                                   .detail = {},
+                                                   .time = now});
+                    }
+                }
+            }
+
+            table = std::move(snapshot);
+            has_snapshot = true;
+            counters.events += changes.size();
+        }
+        loaded.notify_all();
+
+        for (auto const& event : changes)
+        {
+            publish(event);
+        }
+    }
+
+    auto AppMonitor::apply_event(AppEvent event) -> void
+    {
+        {
+            std::lock_guard lock(mutex);
+
+            auto const found = table.find(event.pid);
+            bool const known = found != table.end() && found->second.name == event.name;
+            if (event.type == AppEventType::Started)
+            {
+                // Events replayed from the time of the snapshot are already in the table
+                if (known)
+                {
+                    return;
+                }
+                table.insert_or_assign(
+                    event.pid, AppProcess{.pid = event.pid, .name = event.name, .ppid = -1, .rss = 0, .state = '?'});
+            }
+            else if (!known)
+            {
+                return;
+            }
+            else if (event.type == AppEventType::Died)
+            {
+                table.erase(found);
+            }
+            ++counters.events;
+        }
+
+        publish(event);
+    }
+
+    auto AppMonitor::publish(AppEvent const& event) -> void
+    {
+        std::vector<std::shared_ptr<AppEventHandler>> handlers;
+        {
+            std::lock_guard lock(subscription_mutex);
+            for (auto const& subscription : subscriptions)
+            {
+                if (subscription.name.empty() || subscription.name == event.name)
+                {
+                    handlers.push_back(subscription.handler);
+                }
+            }
+        }
+
+        // Handlers run without the lock, so they may subscribe or unsubscribe
+        for (auto const& handler : handlers)
+        {
+            try
+            {
+                (*handler)(event);
+            }
+            catch (...)
+            {
+                // The exception of the handler must not stop the monitor
+            }
+        }
+    }
+} // namespace memucpp
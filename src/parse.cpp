@@ -0,0 +1,280 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "parse.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        /*!
+            \brief Calls the function for every line of the output without the line break (LF or CRLF)
+        */
+        template <typename Function>
+        auto for_each_line(std::string_view const output, Function&& function) -> void
+        {
+            size_t start = 0;
+            while (start < output.size())
+            {
+                size_t const end = std::min(output.find('\n', start), output.size());
+
+                std::string_view line = output.substr(start, end - start);
+                if (line.ends_with('\r'))
+                {
+                    line.remove_suffix(1);
+                }
+                function(line);
+                start = end + 1;
+            }
+        }
+
+        template <typename Type>
+        auto parse_number(std::string_view const source) -> std::optional<Type>
+        {
+            Type out;
+            auto const result = std::from_chars(source.data(), source.data() + source.size(), out);
+            if (result.ec != std::errc() || result.ptr != source.data() + source.size())
+            {
+                return std::nullopt;
+            }
+            return out;
+        }
+
+        auto is_ascii(std::span<uint8_t const> const source) -> bool
+        {
+            // Eight bytes at once, the tail byte by byte
+            size_t i = 0;
+            for (; i + sizeof(uint64_t) <= source.size(); i += sizeof(uint64_t))
+            {
+                uint64_t block;
+                std::memcpy(&block, source.data() + i, sizeof(block));
+                if (block & 0x8080808080808080)
+                {
+                    return false;
+                }
+            }
+            for (; i < source.size(); ++i)
+            {
+                if (source[i] & 0x80)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        auto parse_process_row(std::string_view const line) -> std::optional<ProcessRow>
+        {
+            // WCHAN is blank for the running processes, so the state and the name are taken from the end
+            std::array<std::string_view, 5> head;
+            std::string_view previous;
+            std::string_view last;
+            size_t count = 0;
+
+            size_t position = line.find_first_not_of(' ');
+            while (position != std::string_view::npos)
+            {
+                size_t const end = std::min(line.find(' ', position), line.size());
+                std::string_view const column = line.substr(position, end - position);
+
+                if (count < head.size())
+                {
+                    head[count] = column;
+                }
+                ++count;
+                previous = last;
+                last = column;
+                position = line.find_first_not_of(' ', end);
+            }
+
+            if (count < 3)
+            {
+                return std::nullopt;
+            }
+
+            auto const pid = parse_number<int32_t>(head[1]);
+            if (!pid)
+            {
+                return std::nullopt;
+            }
+
+            // Short layouts (e.g. USER PID PPID NAME) have no memory and state
+            bool const full = count >= 7;
+            return ProcessRow{.pid = pid.value(),
+                              .ppid = count > 3 ? parse_number<int32_t>(head[2]).value_or(0) : 0,
+                              .rss = full ? parse_number<uint64_t>(head[4]).value_or(0) : 0,
+                              .state = full && previous.size() == 1 ? previous[0] : '?',
+                              .name = last};
+        }
+
+        auto parse_vms(std::string_view const output, std::vector<VMInfo>& out) -> void
+        {
+            size_t count = 0;
+
+            for_each_line(output, [&](std::string_view const line) {
+                if (line.empty())
+                {
+                    return;
+                }
+
+                // index,title,window handle,running,pid
+                std::array<std::string_view, 5> fields;
+                size_t fields_count = 0;
+                for (size_t start = 0; start <= line.size() && fields_count < fields.size();)
+                {
+                    size_t const end = std::min(line.find(',', start), line.size());
+                    fields[fields_count++] = line.substr(start, end - start);
+                    start = end + 1;
+                }
+
+                if (fields_count < 4)
+                {
+                    throw error("List of the VMs is malformed");
+                }
+
+                // Elements are reused, so their names keep the allocated storage
+                if (count == out.size())
+                {
+                    out.emplace_back();
+                }
+                auto& vm_info = out[count++];
+                vm_info.index = stoi<uint16_t>(fields[0]);
+                vm_info.name.assign(fields[1]);
+                vm_info.enabled = static_cast<bool>(stoi<uint16_t>(fields[3]));
+            });
+            out.resize(count);
+        }
+
+        auto parse_processes(std::string_view const output, std::vector<ProcessInfo>& out) -> void
+        {
+            auto application = [](ProcessRow const& row) { return row.name.find("com.") != std::string_view::npos; };
+
+            // The first and the last application processes (system UI and launcher) are not listed,
+            // so the rows are counted before they are copied
+            size_t total = 0;
+            for_each_line(output, [&](std::string_view const line) {
+                auto const row = parse_process_row(line);
+                total += row && application(row.value());
+            });
+
+            size_t index = 0;
+            size_t count = 0;
+            for_each_line(output, [&](std::string_view const line) {
+                auto const row = parse_process_row(line);
+                if (!row || !application(row.value()))
+                {
+                    return;
+                }
+                if (index++ == 0 || index == total)
+                {
+                    return;
+                }
+
+                if (count == out.size())
+                {
+                    out.emplace_back();
+                }
+                auto& process_info = out[count++];
+                process_info.name.assign(row->name);
+                process_info.pid = row->pid;
+                process_info.ppid = row->ppid;
+                process_info.rss = row->rss;
+                process_info.state = row->state;
+            });
+            out.resize(count);
+        }
+
+        auto parse_touch_device(std::string_view const output) -> std::optional<TouchDevice>
+        {
+            // add device 1: /dev/input/event2
+            //   events:
+            //     ABS (0003): 002f  : value 0, min 0, max 9, fuzz 0, flat 0, resolution 0
+            //                 0035  : value 0, min 0, max 719, fuzz 0, flat 0, resolution 0
+            std::optional<TouchDevice> found;
+            TouchDevice device{};
+            bool position_x = false;
+            bool position_y = false;
+            bool absolute = false;
+            bool has_device = false;
+            bool is_64_bit = false;
+
+            auto finish = [&]() {
+                if (!found && has_device && position_x && position_y)
+                {
+                    found = device;
+                }
+            };
+
+            for_each_line(output, [&](std::string_view line) {
+                if (line.starts_with("add device"))
+                {
+                    finish();
+                    size_t const separator = line.find(": ");
+                    device = TouchDevice{.path = separator == std::string_view::npos
+                                                     ? std::string()
+                                                     : std::string(line.substr(separator + 2)),
+                                         .max_x = 0,
+                                         .max_y = 0,
+                                         .screen_width = 0,
+                                         .screen_height = 0,
+                                         .slots = 0,
+                                         .event_size = is_64_bit ? 24u : 16u};
+                    has_device = true;
+                    position_x = position_y = absolute = false;
+                    return;
+                }
+                if (!has_device)
+                {
+                    // ABI of the device (e.g. x86_64) precedes the devices
+                    is_64_bit = is_64_bit || line.find("64") != std::string_view::npos;
+                    return;
+                }
+
+                // Every type of the events starts its own block (e.g. KEY (0001):)
+                if (size_t const type = line.find("):"); type != std::string_view::npos)
+                {
+                    absolute = line.find("ABS (0003)") != std::string_view::npos;
+                    line.remove_prefix(type + 2);
+                }
+                else if (line.find(": value") == std::string_view::npos)
+                {
+                    // The axes are followed by the other lines of the device (e.g. input props:)
+                    absolute = false;
+                    return;
+                }
+
+                size_t const code_start = line.find_first_not_of(' ');
+                size_t const max = line.find("max ");
+                if (!absolute || code_start == std::string_view::npos || max == std::string_view::npos)
+                {
+                    return;
+                }
+
+                uint32_t code = 0;
+                std::string_view const code_text = line.substr(code_start, line.find(' ', code_start) - code_start);
+                std::from_chars(code_text.data(), code_text.data() + code_text.size(), code, 16);
+
+                std::string_view const max_text = line.substr(max + 4, line.find(',', max) - max - 4);
+                auto const value = parse_number<uint32_t>(max_text).value_or(0);
+
+                if (code == 0x2f)
+                {
+                    device.slots = value + 1;
+                }
+                else if (code == 0x35)
+                {
+                    device.max_x = value;
+                    position_x = true;
+                }
+                else if (code == 0x36)
+                {
+                    device.max_y = value;
+                    position_y = true;
+                }
+            });
+            finish();
+            return found;
+        }
+    } // namespace internal
+} // namespace memucpp
@@ -0,0 +1,50 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include "memucpp.hpp"
+
+namespace memucpp
+{
+    namespace internal
+    {
+        /*!
+            \brief Returns true if the output has no bytes above 0x7F (no code page conversion is needed)
+        */
+        auto is_ascii(std::span<uint8_t const> const source) -> bool;
+
+        /*!
+            \brief Row of ps, the fields view the output
+        */
+        struct ProcessRow
+        {
+            int32_t pid;
+            int32_t ppid;
+            uint64_t rss;
+            char state;
+            std::string_view name;
+        };
+
+        /*!
+            \brief Parses the row of ps (USER PID PPID VSZ RSS [WCHAN] ADDR S NAME), the header is skipped
+            \return row or std::nullopt if the line is not the process
+        */
+        auto parse_process_row(std::string_view const line) -> std::optional<ProcessRow>;
+
+        /*!
+            \brief Parses the output of listvms into the reusable container
+        */
+        auto parse_vms(std::string_view const output, std::vector<VMInfo>& out) -> void;
+
+        /*!
+            \brief Parses the application processes (com.*) of ps into the reusable container
+        */
+        auto parse_processes(std::string_view const output, std::vector<ProcessInfo>& out) -> void;
+
+        /*!
+            \brief Parses the ABI of the device followed by the output of getevent -p
+            \return the first device with the multi-touch position axes or std::nullopt (the screen size is not set)
+        */
+        auto parse_touch_device(std::string_view const output) -> std::optional<TouchDevice>;
+    } // namespace internal
+} // namespace memucpp
@@ -0,0 +1,491 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "pixel.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MEMUCPP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MEMUCPP_TARGET(isa)
+#else
+#define MEMUCPP_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace memucpp
+{
+    namespace internal
+    {
+        auto convert_row_scalar(uint8_t const* source, uint8_t* destination, uint32_t const width) -> void
+        {
+            for (uint32_t i = 0; i < width; ++i)
+            {
+                destination[i * 3 + 0] = source[i * 4 + 2];
+                destination[i * 3 + 1] = source[i * 4 + 1];
+                destination[i * 3 + 2] = source[i * 4 + 0];
+            }
+        }
+
+#ifdef MEMUCPP_X86
+        MEMUCPP_TARGET("ssse3")
+        auto convert_row_ssse3(uint8_t const* source, uint8_t* destination, uint32_t const width) -> void
+        {
+            __m128i const mask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+            // Every store writes 16 bytes of which 12 are valid, so the last 6 pixels are left to the scalar tail
+            uint32_t i = 0;
+            for (; i + 6 <= width; i += 4)
+            {
+                __m128i const pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(source + i * 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i * 3), _mm_shuffle_epi8(pixels, mask));
+            }
+            convert_row_scalar(source + i * 4, destination + i * 3, width - i);
+        }
+
+        MEMUCPP_TARGET("avx2")
+        auto convert_row_avx2(uint8_t const* source, uint8_t* destination, uint32_t const width) -> void
+        {
+            __m256i const mask = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6,
+                                                  5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+            __m256i const pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+            // Every store writes 32 bytes of which 24 are valid, so the last 11 pixels are left to the SSSE3 tail
+            uint32_t i = 0;
+            for (; i + 11 <= width; i += 8)
+            {
+                __m256i const pixels = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(source + i * 4));
+                __m256i const packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(pixels, mask), pack);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + i * 3), packed);
+            }
+            // Clears the upper halves, so the SSE tail does not pay the AVX-SSE transition penalty
+            _mm256_zeroupper();
+            convert_row_ssse3(source + i * 4, destination + i * 3, width - i);
+        }
+#endif
+
+        // Keys of the hash lanes (the first bytes of the xxHash secret)
+        constexpr HashLanes hash_keys{0xbe4ba423396cfeb8, 0x1cad21f72c81017c, 0xdb979083e96dd4de,
+                                      0x1f67b3b7a4a44072};
+        constexpr HashLanes scramble_keys{0x78e5c0cc4ee679cb, 0x2172ffcc7dd05a82, 0x8e2443f7744608b8,
+                                          0x4c263a81e69035e0};
+        constexpr uint64_t scramble_prime = 0x9e3779b1;
+        // The keys advance by the step every block, so the moved or swapped blocks of the row change the hash
+        constexpr uint64_t key_step = 0x9e3779b97f4a7c15;
+
+        auto hash_block_scalar(uint8_t const* data, size_t const block, HashLanes& lanes) -> void
+        {
+            HashLanes words;
+            std::memcpy(words.data(), data, sizeof(HashLanes));
+
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                uint64_t const key = words[i] ^ (hash_keys[i] + block * key_step);
+                lanes[i] += words[i ^ 1] + (key & 0xffffffff) * (key >> 32);
+            }
+        }
+
+#ifdef MEMUCPP_X86
+        // Accumulates the whole 32 byte blocks and returns the number of the consumed bytes
+        MEMUCPP_TARGET("sse2")
+        auto hash_blocks_sse2(uint8_t const* data, size_t const size, HashLanes& lanes) -> size_t
+        {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<__m128i const*>(lanes.data()));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<__m128i const*>(lanes.data() + 2));
+            __m128i key_low = _mm_loadu_si128(reinterpret_cast<__m128i const*>(hash_keys.data()));
+            __m128i key_high = _mm_loadu_si128(reinterpret_cast<__m128i const*>(hash_keys.data() + 2));
+            __m128i const step = _mm_set1_epi64x(static_cast<int64_t>(key_step));
+
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32)
+            {
+                __m128i const words_low = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i));
+                __m128i const words_high = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i + 16));
+                __m128i const mixed_low = _mm_xor_si128(words_low, key_low);
+                __m128i const mixed_high = _mm_xor_si128(words_high, key_high);
+
+                low = _mm_add_epi64(low, _mm_shuffle_epi32(words_low, _MM_SHUFFLE(1, 0, 3, 2)));
+                low = _mm_add_epi64(low, _mm_mul_epu32(mixed_low, _mm_srli_epi64(mixed_low, 32)));
+                high = _mm_add_epi64(high, _mm_shuffle_epi32(words_high, _MM_SHUFFLE(1, 0, 3, 2)));
+                high = _mm_add_epi64(high, _mm_mul_epu32(mixed_high, _mm_srli_epi64(mixed_high, 32)));
+                key_low = _mm_add_epi64(key_low, step);
+                key_high = _mm_add_epi64(key_high, step);
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes.data()), low);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes.data() + 2), high);
+            return i;
+        }
+
+        MEMUCPP_TARGET("avx2")
+        auto hash_blocks_avx2(uint8_t const* data, size_t const size, HashLanes& lanes) -> size_t
+        {
+            __m256i accumulator = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(lanes.data()));
+            __m256i key = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(hash_keys.data()));
+            __m256i const step = _mm256_set1_epi64x(static_cast<int64_t>(key_step));
+
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32)
+            {
+                __m256i const words = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + i));
+                __m256i const mixed = _mm256_xor_si256(words, key);
+
+                accumulator = _mm256_add_epi64(accumulator, _mm256_shuffle_epi32(words, _MM_SHUFFLE(1, 0, 3, 2)));
+                accumulator = _mm256_add_epi64(accumulator, _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32)));
+                key = _mm256_add_epi64(key, step);
+            }
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes.data()), accumulator);
+            return i;
+        }
+#endif
+
+        // Every fourth byte is alpha (or padding) that the matching ignores
+        constexpr auto is_color(uint32_t const index) -> bool
+        {
+            return (index & 3) != 3;
+        }
+
+        auto sad_row_scalar(uint8_t const* frame, uint8_t const* pattern, uint32_t const size) -> uint64_t
+        {
+            uint64_t sum = 0;
+            for (uint32_t i = 0; i < size; ++i)
+            {
+                if (is_color(i))
+                {
+                    sum += static_cast<uint32_t>(std::abs(frame[i] - pattern[i]));
+                }
+            }
+            return sum;
+        }
+
+        auto correlate_row_scalar(uint8_t const* frame, uint8_t const* pattern, uint32_t const size)
+            -> CorrelationSums
+        {
+            CorrelationSums sums{};
+            for (uint32_t i = 0; i < size; ++i)
+            {
+                if (is_color(i))
+                {
+                    uint32_t const value = frame[i];
+                    sums.sum += value;
+                    sums.squares += value * value;
+                    sums.products += value * pattern[i];
+                }
+            }
+            return sums;
+        }
+
+#ifdef MEMUCPP_X86
+        MEMUCPP_TARGET("sse2")
+        auto sad_row_sse2(uint8_t const* frame, uint8_t const* pattern, uint32_t const size) -> uint64_t
+        {
+            __m128i const mask = _mm_set1_epi32(0x00ffffff);
+            __m128i accumulator = _mm_setzero_si128();
+
+            uint32_t i = 0;
+            for (; i + 16 <= size; i += 16)
+            {
+                __m128i const pixels =
+                    _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(frame + i)), mask);
+                __m128i const expected = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pattern + i));
+                accumulator = _mm_add_epi64(accumulator, _mm_sad_epu8(pixels, expected));
+            }
+
+            std::array<uint64_t, 2> lanes;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes.data()), accumulator);
+            return lanes[0] + lanes[1] + sad_row_scalar(frame + i, pattern + i, size - i);
+        }
+
+        MEMUCPP_TARGET("avx2")
+        auto sad_row_avx2(uint8_t const* frame, uint8_t const* pattern, uint32_t const size) -> uint64_t
+        {
+            __m256i const mask = _mm256_set1_epi32(0x00ffffff);
+            __m256i accumulator = _mm256_setzero_si256();
+
+            uint32_t i = 0;
+            for (; i + 32 <= size; i += 32)
+            {
+                __m256i const pixels =
+                    _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(frame + i)), mask);
+                __m256i const expected = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pattern + i));
+                accumulator = _mm256_add_epi64(accumulator, _mm256_sad_epu8(pixels, expected));
+            }
+
+            std::array<uint64_t, 4> lanes;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes.data()), accumulator);
+            _mm256_zeroupper();
+            return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sad_row_sse2(frame + i, pattern + i, size - i);
+        }
+
+        MEMUCPP_TARGET("sse2")
+        auto correlate_row_sse2(uint8_t const* frame, uint8_t const* pattern, uint32_t const size) -> CorrelationSums
+        {
+            __m128i const mask = _mm_set1_epi32(0x00ffffff);
+            __m128i const zero = _mm_setzero_si128();
+            __m128i sum = _mm_setzero_si128();
+            __m128i squares = _mm_setzero_si128();
+            __m128i products = _mm_setzero_si128();
+
+            // 32 bit lanes of the products do not overflow for the rows shorter than 64 KiB
+            uint32_t i = 0;
+            for (; i + 16 <= size; i += 16)
+            {
+                __m128i const pixels =
+                    _mm_and_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(frame + i)), mask);
+                __m128i const expected = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pattern + i));
+
+                __m128i const pixels_low = _mm_unpacklo_epi8(pixels, zero);
+                __m128i const pixels_high = _mm_unpackhi_epi8(pixels, zero);
+                __m128i const expected_low = _mm_unpacklo_epi8(expected, zero);
+                __m128i const expected_high = _mm_unpackhi_epi8(expected, zero);
+
+                sum = _mm_add_epi64(sum, _mm_sad_epu8(pixels, zero));
+                squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(pixels_low, pixels_low),
+                                                               _mm_madd_epi16(pixels_high, pixels_high)));
+                products = _mm_add_epi32(products, _mm_add_epi32(_mm_madd_epi16(pixels_low, expected_low),
+                                                                 _mm_madd_epi16(pixels_high, expected_high)));
+            }
+
+            std::array<uint64_t, 2> sum_lanes;
+            std::array<uint32_t, 4> square_lanes;
+            std::array<uint32_t, 4> product_lanes;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sum_lanes.data()), sum);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(square_lanes.data()), squares);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(product_lanes.data()), products);
+
+            auto sums = correlate_row_scalar(frame + i, pattern + i, size - i);
+            sums.sum += sum_lanes[0] + sum_lanes[1];
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+                sums.squares += square_lanes[k];
+                sums.products += product_lanes[k];
+            }
+            return sums;
+        }
+
+        MEMUCPP_TARGET("avx2")
+        auto correlate_row_avx2(uint8_t const* frame, uint8_t const* pattern, uint32_t const size) -> CorrelationSums
+        {
+            __m256i const mask = _mm256_set1_epi32(0x00ffffff);
+            __m256i const zero = _mm256_setzero_si256();
+            __m256i sum = _mm256_setzero_si256();
+            __m256i squares = _mm256_setzero_si256();
+            __m256i products = _mm256_setzero_si256();
+
+            // Unpacking interleaves the 128 bit halves, which does not matter for the sums
+            uint32_t i = 0;
+            for (; i + 32 <= size; i += 32)
+            {
+                __m256i const pixels =
+                    _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(frame + i)), mask);
+                __m256i const expected = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pattern + i));
+
+                __m256i const pixels_low = _mm256_unpacklo_epi8(pixels, zero);
+                __m256i const pixels_high = _mm256_unpackhi_epi8(pixels, zero);
+                __m256i const expected_low = _mm256_unpacklo_epi8(expected, zero);
+                __m256i const expected_high = _mm256_unpackhi_epi8(expected, zero);
+
+                sum = _mm256_add_epi64(sum, _mm256_sad_epu8(pixels, zero));
+                squares = _mm256_add_epi32(squares, _mm256_add_epi32(_mm256_madd_epi16(pixels_low, pixels_low),
+                                                                     _mm256_madd_epi16(pixels_high, pixels_high)));
+                products =
+                    _mm256_add_epi32(products, _mm256_add_epi32(_mm256_madd_epi16(pixels_low, expected_low),
+                                                                _mm256_madd_epi16(pixels_high, expected_high)));
+            }
+
+            std::array<uint64_t, 4> sum_lanes;
+            std::array<uint32_t, 8> square_lanes;
+            std::array<uint32_t, 8> product_lanes;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(sum_lanes.data()), sum);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(square_lanes.data()), squares);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(product_lanes.data()), products);
+
+            _mm256_zeroupper();
+
+            auto sums = correlate_row_sse2(frame + i, pattern + i, size - i);
+            sums.sum += sum_lanes[0] + sum_lanes[1] + sum_lanes[2] + sum_lanes[3];
+            for (uint32_t k = 0; k < 8; ++k)
+            {
+                sums.squares += square_lanes[k];
+                sums.products += product_lanes[k];
+            }
+            return sums;
+        }
+#endif
+
+        auto simd_level() -> SimdLevel
+        {
+            static SimdLevel const level = []() {
+#if defined(MEMUCPP_X86) && defined(_MSC_VER)
+                std::array<int32_t, 4> info;
+                ::__cpuid(info.data(), 0);
+                int32_t const max_leaf = info[0];
+
+                ::__cpuid(info.data(), 1);
+                bool const ssse3 = (info[2] & (1 << 9)) != 0;
+                bool const os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+                                    (::_xgetbv(0) & 0x6) == 0x6;
+
+                bool avx2 = false;
+                if (max_leaf >= 7)
+                {
+                    ::__cpuidex(info.data(), 7, 0);
+                    avx2 = os_avx && (info[1] & (1 << 5)) != 0;
+                }
+                return avx2 ? SimdLevel::AVX2 : ssse3 ? SimdLevel::SSSE3 : SimdLevel::Scalar;
+#elif defined(MEMUCPP_X86)
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2")    ? SimdLevel::AVX2
+                       : __builtin_cpu_supports("ssse3") ? SimdLevel::SSSE3
+                                                         : SimdLevel::Scalar;
+#else
+                return SimdLevel::Scalar;
+#endif
+            }();
+            return level;
+        }
+
+        auto rgba_to_bgr24(std::span<uint8_t const> const source, uint32_t const width, uint32_t const height,
+                           uint32_t const source_stride, std::span<uint8_t> const destination,
+                           uint32_t const destination_stride, bool const flip, SimdLevel const level,
+                           uint32_t const threads) -> void
+        {
+            auto convert_row = &convert_row_scalar;
+#ifdef MEMUCPP_X86
+            switch (level)
+            {
+                case SimdLevel::AVX2:
+                    convert_row = &convert_row_avx2;
+                    break;
+                case SimdLevel::SSSE3:
+                    convert_row = &convert_row_ssse3;
+                    break;
+                default:
+                    break;
+            }
+#endif
+            uint32_t const padding = destination_stride - width * 3;
+
+            // Bitmap rows are stored bottom-up, so flipping makes the last source row the first one
+            auto convert_rows = [&](uint32_t const begin, uint32_t const end) {
+                for (uint32_t j = begin; j < end; ++j)
+                {
+                    uint32_t const y = flip ? height - 1 - j : j;
+                    uint8_t const* row = source.data() + static_cast<size_t>(y) * source_stride;
+                    uint8_t* out = destination.data() + static_cast<size_t>(j) * destination_stride;
+
+                    convert_row(row, out, width);
+                    std::memset(out + width * 3, 0, padding);
+                }
+            };
+
+            uint32_t const count = std::clamp(threads, 1u, std::max(height, 1u));
+            if (count == 1)
+            {
+                convert_rows(0, height);
+                return;
+            }
+
+            std::vector<std::jthread> workers;
+            workers.reserve(count - 1);
+
+            uint32_t const rows = (height + count - 1) / count;
+            for (uint32_t k = 1; k < count; ++k)
+            {
+                workers.emplace_back(convert_rows, std::min(k * rows, height), std::min((k + 1) * rows, height));
+            }
+            convert_rows(0, std::min(rows, height));
+        }
+
+        auto hash_begin() -> HashLanes
+        {
+            return HashLanes{0xc2b2ae3d27d4eb4f, 0x165667b19e3779f9, 0x85ebca77c2b2ae63, 0x27d4eb2f165667c5};
+        }
+
+        auto hash_row(std::span<uint8_t const> const data, HashLanes& lanes, SimdLevel const level) -> void
+        {
+            size_t i = 0;
+#ifdef MEMUCPP_X86
+            // The SSE2 kernel serves the SSSE3 level, as SSE2 is a part of every SSSE3 CPU
+            switch (level)
+            {
+                case SimdLevel::AVX2:
+                    i = hash_blocks_avx2(data.data(), data.size(), lanes);
+                    break;
+                case SimdLevel::SSSE3:
+                    i = hash_blocks_sse2(data.data(), data.size(), lanes);
+                    break;
+                default:
+                    break;
+            }
+#endif
+            for (; i + 32 <= data.size(); i += 32)
+            {
+                hash_block_scalar(data.data() + i, i / 32, lanes);
+            }
+
+            if (i < data.size())
+            {
+                std::array<uint8_t, sizeof(HashLanes)> block{};
+                std::memcpy(block.data(), data.data() + i, data.size() - i);
+                hash_block_scalar(block.data(), i / 32, lanes);
+            }
+
+            // Scrambles the lanes, so the equal blocks on the different rows do not cancel out
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+                lanes[k] = ((lanes[k] ^ (lanes[k] >> 47)) ^ scramble_keys[k]) * scramble_prime;
+            }
+        }
+
+        auto hash_end(HashLanes const& lanes) -> uint64_t
+        {
+            uint64_t hash = 0x27d4eb2f165667c5;
+            for (uint64_t const lane : lanes)
+            {
+                hash = (hash ^ lane) * 0x9e3779b185ebca87;
+                hash ^= hash >> 32;
+            }
+            return hash;
+        }
+
+        auto sad_row(SimdLevel const level) -> SadRow
+        {
+#ifdef MEMUCPP_X86
+            switch (level)
+            {
+                case SimdLevel::AVX2:
+                    return &sad_row_avx2;
+                case SimdLevel::SSSE3:
+                    return &sad_row_sse2;
+                default:
+                    break;
+            }
+#endif
+            return &sad_row_scalar;
+        }
+
+        auto correlate_row(SimdLevel const level) -> CorrelateRow
+        {
+#ifdef MEMUCPP_X86
+            switch (level)
+            {
+                case SimdLevel::AVX2:
+                    return &correlate_row_avx2;
+                case SimdLevel::SSSE3:
+                    return &correlate_row_sse2;
+                default:
+                    break;
+            }
+#endif
+            return &correlate_row_scalar;
+        }
+    } // namespace internal
+} // namespace memucpp
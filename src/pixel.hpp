@@ -0,0 +1,92 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        enum class SimdLevel : uint32_t
+        {
+            Scalar = 0,
+            SSSE3 = 1,
+            AVX2 = 2
+        };
+
+        /*!
+            \brief Returns the best instruction set supported by the CPU (detected once)
+        */
+        auto simd_level() -> SimdLevel;
+
+        /*!
+            \brief Returns the size of the 24 bit bitmap row aligned to 4 bytes
+        */
+        constexpr auto bitmap_row_size(uint32_t const width) -> uint32_t
+        {
+            return (width * 3 + 3) & ~3u;
+        }
+
+        /*!
+            \brief Converts RGBA rows into BGR rows (optionally bottom-up with zeroed padding, as bitmap pixel data)
+            \param source RGBA pixels (source_stride bytes per row)
+            \param destination BGR pixels (destination_stride bytes per row)
+            \param flip writes the last source row first
+            \param level the kernel to use (must be supported by the CPU)
+            \param threads number of threads that convert the rows (0 and 1 convert on the calling thread)
+        */
+        auto rgba_to_bgr24(std::span<uint8_t const> const source, uint32_t const width, uint32_t const height,
+                           uint32_t const source_stride, std::span<uint8_t> const destination,
+                           uint32_t const destination_stride, bool const flip, SimdLevel const level,
+                           uint32_t const threads) -> void;
+
+        using HashLanes = std::array<uint64_t, 4>;
+
+        /*!
+            \brief Returns the initial lanes of the hash
+        */
+        auto hash_begin() -> HashLanes;
+
+        /*!
+            \brief Accumulates the row of bytes into the hash lanes (every kernel gives the same lanes)
+            \param data the bytes of the row
+            \param lanes the lanes of the hash
+            \param level the kernel to use (must be supported by the CPU)
+        */
+        auto hash_row(std::span<uint8_t const> const data, HashLanes& lanes, SimdLevel const level) -> void;
+
+        /*!
+            \brief Folds the hash lanes into the 64 bit hash
+        */
+        auto hash_end(HashLanes const& lanes) -> uint64_t;
+
+        struct CorrelationSums
+        {
+            uint64_t sum;
+            uint64_t squares;
+            uint64_t products;
+        };
+
+        /*!
+            \brief Row kernels of the template matching over 4 byte pixels (the fourth byte of the frame is ignored)
+            \param frame the pixels of the frame
+            \param pattern the pixels of the template (the fourth byte must be zero)
+            \param size the number of bytes
+        */
+        using SadRow = uint64_t (*)(uint8_t const* frame, uint8_t const* pattern, uint32_t const size);
+        using CorrelateRow = CorrelationSums (*)(uint8_t const* frame, uint8_t const* pattern, uint32_t const size);
+
+        /*!
+            \brief Returns the kernel of the sum of the absolute differences
+        */
+        auto sad_row(SimdLevel const level) -> SadRow;
+
+        /*!
+            \brief Returns the kernel of the sums of the normalized cross-correlation
+        */
+        auto correlate_row(SimdLevel const level) -> CorrelateRow;
+    } // namespace internal
+} // namespace memucpp
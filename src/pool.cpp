@@ -0,0 +1,173 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/pool.hpp"
+#include "memucpp.hpp"
+#include <algorithm>
+
+namespace memucpp
+{
+    FramePool::FramePool(size_t const limit) : counters{.limit = limit}
+    {
+    }
+
+    FramePool::~FramePool() = default;
+
+    auto FramePool::Create(size_t const limit) -> std::shared_ptr<FramePool>
+    {
+        return std::shared_ptr<FramePool>(new FramePool(limit));
+    }
+
+    auto FramePool::Shared() -> std::shared_ptr<FramePool>
+    {
+        static std::shared_ptr<FramePool> const pool = Create();
+        return pool;
+    }
+
+    auto FramePool::acquire(size_t const size) -> FrameBuffer
+    {
+        std::unique_ptr<std::vector<uint8_t>> storage;
+        size_t bytes = size;
+        {
+            std::lock_guard lock(mutex);
+
+            // Takes the smallest idle buffer that fits
+            auto best = idle.end();
+            for (auto it = idle.begin(); it != idle.end(); ++it)
+            {
+                if (it->bytes >= size && (best == idle.end() || it->bytes < best->bytes))
+                {
+                    best = it;
+                }
+            }
+
+            if (best != idle.end())
+            {
+                storage = std::move(best->storage);
+                bytes = best->bytes;
+                *best = std::move(idle.back());
+                idle.pop_back();
+
+                --counters.idle_buffers;
+                ++counters.reuses;
+            }
+            else
+            {
+                evict(size);
+
+                if (counters.bytes + size > counters.limit)
+                {
+                    ++counters.rejections;
+                    throw error("Frame pool memory limit exceeded");
+                }
+
+                ++counters.buffers;
+                ++counters.allocations;
+                counters.bytes += size;
+                counters.peak_bytes = std::max(counters.peak_bytes, counters.bytes);
+            }
+            counters.in_use_bytes += bytes;
+        }
+
+        if (!storage)
+        {
+            // Allocates outside of the lock, so other VMs are not blocked by zero-filling
+            try
+            {
+                storage = std::make_unique<std::vector<uint8_t>>(size);
+            }
+            catch (...)
+            {
+                std::lock_guard lock(mutex);
+                --counters.buffers;
+                counters.bytes -= size;
+                counters.in_use_bytes -= size;
+                throw;
+            }
+        }
+        else
+        {
+            // The idle buffer is matched on its capacity, the previous writer may have shrunk it (no reallocation)
+            storage->resize(std::max(storage->size(), size));
+        }
+
+        return FrameBuffer(std::shared_ptr<std::vector<uint8_t>>(
+            storage.release(), [pool = weak_from_this(), bytes](std::vector<uint8_t>* storage) {
+                if (auto owner = pool.lock())
+                {
+                    owner->release(storage, bytes);
+                }
+                else
+                {
+                    delete storage;
+                }
+            }));
+    }
+
+    auto FramePool::set_limit(size_t const limit) -> void
+    {
+        std::lock_guard lock(mutex);
+        counters.limit = limit;
+        evict(0);
+    }
+
+    auto FramePool::trim() -> void
+    {
+        std::vector<Entry> entries;
+        {
+            std::lock_guard lock(mutex);
+            for (auto const& entry : idle)
+            {
+                counters.bytes -= entry.bytes;
+            }
+            counters.buffers -= idle.size();
+            counters.idle_buffers = 0;
+            entries = std::move(idle);
+            idle.clear();
+        }
+    }
+
+    auto FramePool::stats() const -> PoolStats
+    {
+        std::lock_guard lock(mutex);
+        return counters;
+    }
+
+    auto FramePool::release(std::vector<uint8_t>* storage, size_t const bytes) -> void
+    {
+        std::unique_ptr<std::vector<uint8_t>> entry(storage);
+        size_t const capacity = entry->capacity();
+
+        std::lock_guard lock(mutex);
+
+        // The writer may have grown the buffer while it was in use
+        counters.in_use_bytes -= bytes;
+        counters.bytes = counters.bytes - bytes + capacity;
+        counters.peak_bytes = std::max(counters.peak_bytes, counters.bytes);
+
+        if (counters.bytes > counters.limit)
+        {
+            --counters.buffers;
+            counters.bytes -= capacity;
+            return;
+        }
+
+        idle.push_back(Entry{.storage = std::move(entry), .bytes = capacity});
+        ++counters.idle_buffers;
+    }
+
+    auto FramePool::evict(size_t const required) -> void
+    {
+        // Frees the largest idle buffers first
+        while (!idle.empty() && counters.bytes + required > counters.limit)
+        {
+            auto largest = std::ranges::max_element(idle, {}, &Entry::bytes);
+
+            counters.bytes -= largest->bytes;
+            --counters.buffers;
+            --counters.idle_buffers;
+
+            *largest = std::move(idle.back());
+            idle.pop_back();
+        }
+    }
+} // namespace memucpp
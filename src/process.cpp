@@ -0,0 +1,544 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "process.hpp"
+#include "memucpp.hpp"
+#include <thread>
+#include <utility>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#undef NOMINMAX
+#else
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace memucpp
+{
+    namespace internal
+    {
+#ifdef _WIN32
+        auto quote_argument(std::string_view const argument) -> std::wstring
+        {
+            int32_t const size = ::MultiByteToWideChar(CP_ACP, 0, argument.data(),
+                                                       static_cast<int32_t>(argument.size()), nullptr, 0);
+            std::wstring wargument(size, L'\0');
+            ::MultiByteToWideChar(CP_ACP, 0, argument.data(), static_cast<int32_t>(argument.size()),
+                                  wargument.data(), size);
+
+            if (!wargument.empty() && wargument.find_first_of(L" \t\n\v\"") == std::wstring::npos)
+            {
+                return wargument;
+            }
+
+            // Follows the CommandLineToArgvW rules for backslashes before quotes
+            std::wstring out = L"\"";
+            for (auto it = wargument.begin();; ++it)
+            {
+                size_t backslashes = 0;
+                while (it != wargument.end() && *it == L'\\')
+                {
+                    ++it;
+                    ++backslashes;
+                }
+
+                if (it == wargument.end())
+                {
+                    out.append(backslashes * 2, L'\\');
+                    break;
+                }
+                else if (*it == L'"')
+                {
+                    out.append(backslashes * 2 + 1, L'\\');
+                    out.push_back(*it);
+                }
+                else
+                {
+                    out.append(backslashes, L'\\');
+                    out.push_back(*it);
+                }
+            }
+            out.push_back(L'"');
+            return out;
+        }
+
+        Process::Process(std::span<std::string const> const arguments, bool const redirect_input)
+            : process_handle(nullptr), input_handle(nullptr), output_handle(nullptr)
+        {
+            std::wstring command_line;
+            for (auto const& argument : arguments)
+            {
+                if (!command_line.empty())
+                {
+                    command_line.push_back(L' ');
+                }
+                command_line += quote_argument(argument);
+            }
+
+            SECURITY_ATTRIBUTES attributes{
+                .nLength = sizeof(SECURITY_ATTRIBUTES), .lpSecurityDescriptor = nullptr, .bInheritHandle = TRUE};
+
+            HANDLE output_read = nullptr;
+            HANDLE output_write = nullptr;
+            HANDLE input_read = nullptr;
+            HANDLE input_write = nullptr;
+            HANDLE error_write = nullptr;
+
+            auto release = [&]() {
+                for (HANDLE handle : {output_read, output_write, input_read, input_write, error_write})
+                {
+                    if (handle && handle != INVALID_HANDLE_VALUE)
+                    {
+                        ::CloseHandle(handle);
+                    }
+                }
+            };
+
+            if (!::CreatePipe(&output_read, &output_write, &attributes, 1024 * 1024) ||
+                !::CreatePipe(&input_read, &input_write, &attributes, 0))
+            {
+                release();
+                throw error("An error occurred when creating the process pipes");
+            }
+            ::SetHandleInformation(output_read, HANDLE_FLAG_INHERIT, 0);
+            ::SetHandleInformation(input_write, HANDLE_FLAG_INHERIT, 0);
+
+            error_write = ::CreateFileW(L"NUL", GENERIC_WRITE, FILE_SHARE_WRITE, &attributes, OPEN_EXISTING, 0,
+                                        nullptr);
+
+            // Only the pipe ends are inherited, otherwise concurrent spawns would leak each other's pipes
+            std::array<HANDLE, 3> inherited{input_read, output_write, error_write};
+
+            SIZE_T list_size = 0;
+            ::InitializeProcThreadAttributeList(nullptr, 1, 0, &list_size);
+            std::vector<uint8_t> list_buffer(list_size);
+            auto attribute_list = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(list_buffer.data());
+            ::InitializeProcThreadAttributeList(attribute_list, 1, 0, &list_size);
+            ::UpdateProcThreadAttribute(attribute_list, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited.data(),
+                                        inherited.size() * sizeof(HANDLE), nullptr, nullptr);
+
+            STARTUPINFOEXW startup_info{};
+            startup_info.StartupInfo.cb = sizeof(STARTUPINFOEXW);
+            startup_info.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+            startup_info.StartupInfo.hStdInput = input_read;
+            startup_info.StartupInfo.hStdOutput = output_write;
+            startup_info.StartupInfo.hStdError = error_write;
+            startup_info.lpAttributeList = attribute_list;
+
+            PROCESS_INFORMATION process_info{};
+            BOOL const created = ::CreateProcessW(nullptr, command_line.data(), nullptr, nullptr, TRUE,
+                                                  CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT, nullptr, nullptr,
+                                                  &startup_info.StartupInfo, &process_info);
+            ::DeleteProcThreadAttributeList(attribute_list);
+
+            if (!created)
+            {
+                release();
+                throw error("An error occurred when starting the process");
+            }
+
+            ::CloseHandle(process_info.hThread);
+            ::CloseHandle(input_read);
+            ::CloseHandle(output_write);
+            ::CloseHandle(error_write);
+
+            process_handle = process_info.hProcess;
+            output_handle = output_read;
+            input_handle = input_write;
+
+            if (!redirect_input)
+            {
+                close_input();
+            }
+        }
+
+        auto Process::write(std::span<uint8_t const> const data) -> bool
+        {
+            size_t offset = 0;
+            while (offset < data.size())
+            {
+                DWORD written = 0;
+                if (!input_handle || !::WriteFile(input_handle, data.data() + offset,
+                                                  static_cast<DWORD>(data.size() - offset), &written, nullptr))
+                {
+                    return false;
+                }
+                offset += written;
+            }
+            return true;
+        }
+
+        auto Process::read(std::span<uint8_t> const buffer, std::chrono::milliseconds const timeout)
+            -> std::optional<size_t>
+        {
+            auto const start = std::chrono::steady_clock::now();
+
+            // Anonymous pipes do not support overlapped I/O, so the timeout polls for available bytes
+            while (timeout != std::chrono::milliseconds::max())
+            {
+                DWORD available = 0;
+                if (!::PeekNamedPipe(output_handle, nullptr, 0, nullptr, &available, nullptr))
+                {
+                    return 0;
+                }
+
+                if (available > 0)
+                {
+                    break;
+                }
+
+                if (std::chrono::steady_clock::now() - start >= timeout)
+                {
+                    return std::nullopt;
+                }
+                ::Sleep(1);
+            }
+
+            DWORD read_bytes = 0;
+            if (!::ReadFile(output_handle, buffer.data(), static_cast<DWORD>(buffer.size()), &read_bytes, nullptr))
+            {
+                return 0;
+            }
+            return read_bytes;
+        }
+
+        auto Process::close_input() -> void
+        {
+            if (input_handle)
+            {
+                ::CloseHandle(input_handle);
+                input_handle = nullptr;
+            }
+        }
+
+        auto Process::wait(std::chrono::milliseconds const timeout) -> std::optional<int32_t>
+        {
+            if (!exit_code)
+            {
+                DWORD const milliseconds =
+                    timeout == std::chrono::milliseconds::max() ? INFINITE : static_cast<DWORD>(timeout.count());
+
+                if (::WaitForSingleObject(process_handle, milliseconds) != WAIT_OBJECT_0)
+                {
+                    return std::nullopt;
+                }
+
+                DWORD code = 0;
+                ::GetExitCodeProcess(process_handle, &code);
+                exit_code = static_cast<int32_t>(code);
+            }
+            return exit_code;
+        }
+
+        auto Process::kill() -> void
+        {
+            if (process_handle && !exit_code)
+            {
+                ::TerminateProcess(process_handle, 1);
+            }
+        }
+
+        auto Process::close() -> void
+        {
+            close_input();
+
+            if (output_handle)
+            {
+                ::CloseHandle(output_handle);
+                output_handle = nullptr;
+            }
+
+            if (process_handle)
+            {
+                if (!exit_code)
+                {
+                    ::TerminateProcess(process_handle, 1);
+                    ::WaitForSingleObject(process_handle, INFINITE);
+                }
+                ::CloseHandle(process_handle);
+                process_handle = nullptr;
+            }
+        }
+
+        Process::Process(Process&& other)
+            : process_handle(std::exchange(other.process_handle, nullptr)),
+              input_handle(std::exchange(other.input_handle, nullptr)),
+              output_handle(std::exchange(other.output_handle, nullptr)), exit_code(other.exit_code)
+        {
+        }
+
+        auto Process::operator=(Process&& other) -> Process&
+        {
+            close();
+            process_handle = std::exchange(other.process_handle, nullptr);
+            input_handle = std::exchange(other.input_handle, nullptr);
+            output_handle = std::exchange(other.output_handle, nullptr);
+            exit_code = other.exit_code;
+            return *this;
+        }
+#else
+        auto create_pipe(std::array<int32_t, 2>& fds) -> bool
+        {
+#ifdef __linux__
+            return ::pipe2(fds.data(), O_CLOEXEC) == 0;
+#else
+            if (::pipe(fds.data()) != 0)
+            {
+                return false;
+            }
+            ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+            return true;
+#endif
+        }
+
+        Process::Process(std::span<std::string const> const arguments, bool const redirect_input)
+            : process_id(-1), input_fd(-1), output_fd(-1)
+        {
+            std::array<int32_t, 2> output_pipe{-1, -1};
+            std::array<int32_t, 2> input_pipe{-1, -1};
+
+            auto release = [&]() {
+                for (int32_t const fd : {output_pipe[0], output_pipe[1], input_pipe[0], input_pipe[1]})
+                {
+                    if (fd != -1)
+                    {
+                        ::close(fd);
+                    }
+                }
+            };
+
+            if (!create_pipe(output_pipe) || !create_pipe(input_pipe))
+            {
+                release();
+                throw error("An error occurred when creating the process pipes");
+            }
+
+            std::vector<char*> argv;
+            for (auto const& argument : arguments)
+            {
+                argv.push_back(const_cast<char*>(argument.c_str()));
+            }
+            argv.push_back(nullptr);
+
+            // Pipe ends are close-on-exec, dup2 clears the flag only for the child's standard streams
+            posix_spawn_file_actions_t actions;
+            ::posix_spawn_file_actions_init(&actions);
+            ::posix_spawn_file_actions_adddup2(&actions, output_pipe[1], STDOUT_FILENO);
+            ::posix_spawn_file_actions_adddup2(&actions, input_pipe[0], STDIN_FILENO);
+
+            // Own process group lets kill() reach the grandchildren (e.g. adb started by memuc)
+            posix_spawnattr_t attributes;
+            ::posix_spawnattr_init(&attributes);
+            ::posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+            ::posix_spawnattr_setpgroup(&attributes, 0);
+
+            pid_t pid;
+            int32_t const result = ::posix_spawnp(&pid, argv[0], &actions, &attributes, argv.data(), environ);
+            ::posix_spawn_file_actions_destroy(&actions);
+            ::posix_spawnattr_destroy(&attributes);
+
+            if (result != 0)
+            {
+                release();
+                throw error("An error occurred when starting the process");
+            }
+
+            ::close(output_pipe[1]);
+            ::close(input_pipe[0]);
+
+#ifdef __linux__
+            // Larger pipe lets the child write a whole screen capture with fewer context switches
+            ::fcntl(output_pipe[0], F_SETPIPE_SZ, 1024 * 1024);
+#endif
+
+            process_id = pid;
+            output_fd = output_pipe[0];
+            input_fd = input_pipe[1];
+
+            if (!redirect_input)
+            {
+                close_input();
+            }
+        }
+
+        auto Process::write(std::span<uint8_t const> const data) -> bool
+        {
+            if (input_fd == -1)
+            {
+                return false;
+            }
+
+            // A closed pipe must not kill the whole application with SIGPIPE
+            sigset_t pipe_set;
+            sigset_t old_set;
+            sigset_t pending_set;
+            ::sigemptyset(&pipe_set);
+            ::sigaddset(&pipe_set, SIGPIPE);
+            ::pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+            ::sigpending(&pending_set);
+            bool const was_pending = ::sigismember(&pending_set, SIGPIPE);
+
+            size_t offset = 0;
+            bool success = true;
+            while (offset < data.size())
+            {
+                ssize_t const written = ::write(input_fd, data.data() + offset, data.size() - offset);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    success = false;
+                    break;
+                }
+                offset += static_cast<size_t>(written);
+            }
+
+            if (!success && !was_pending)
+            {
+                ::sigpending(&pending_set);
+                if (::sigismember(&pending_set, SIGPIPE))
+                {
+                    int32_t signal;
+                    ::sigwait(&pipe_set, &signal);
+                }
+            }
+            ::pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+            return success;
+        }
+
+        auto Process::read(std::span<uint8_t> const buffer, std::chrono::milliseconds const timeout)
+            -> std::optional<size_t>
+        {
+            int32_t const milliseconds =
+                timeout == std::chrono::milliseconds::max() ? -1 : static_cast<int32_t>(timeout.count());
+
+            while (true)
+            {
+                pollfd descriptor{.fd = output_fd, .events = POLLIN, .revents = 0};
+                int32_t const ready = ::poll(&descriptor, 1, milliseconds);
+                if (ready < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (ready == 0)
+                {
+                    return std::nullopt;
+                }
+
+                ssize_t const read_bytes = ::read(output_fd, buffer.data(), buffer.size());
+                if (read_bytes < 0)
+                {
+                    if (errno == EINTR || errno == EAGAIN)
+                    {
+                        continue;
+                    }
+                    return 0;
+                }
+                return static_cast<size_t>(read_bytes);
+            }
+        }
+
+        auto Process::close_input() -> void
+        {
+            if (input_fd != -1)
+            {
+                ::close(input_fd);
+                input_fd = -1;
+            }
+        }
+
+        auto Process::wait(std::chrono::milliseconds const timeout) -> std::optional<int32_t>
+        {
+            auto const start = std::chrono::steady_clock::now();
+            auto interval = std::chrono::microseconds(100);
+
+            while (!exit_code && process_id != -1)
+            {
+                int32_t status = 0;
+                bool const blocking = timeout == std::chrono::milliseconds::max();
+                pid_t const result = ::waitpid(process_id, &status, blocking ? 0 : WNOHANG);
+
+                if (result == process_id)
+                {
+                    exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                }
+                else if (result < 0 && errno != EINTR)
+                {
+                    exit_code = -1;
+                }
+                else if (result == 0)
+                {
+                    if (std::chrono::steady_clock::now() - start >= timeout)
+                    {
+                        return std::nullopt;
+                    }
+                    std::this_thread::sleep_for(interval);
+                    interval = std::min<std::chrono::microseconds>(interval * 2, std::chrono::milliseconds(10));
+                }
+            }
+            return exit_code;
+        }
+
+        auto Process::kill() -> void
+        {
+            if (process_id != -1 && !exit_code)
+            {
+                ::kill(-process_id, SIGKILL);
+            }
+        }
+
+        auto Process::output_descriptor() const -> int32_t
+        {
+            return output_fd;
+        }
+
+        auto Process::close() -> void
+        {
+            close_input();
+
+            if (output_fd != -1)
+            {
+                ::close(output_fd);
+                output_fd = -1;
+            }
+
+            if (process_id != -1)
+            {
+                kill();
+                wait(std::chrono::milliseconds::max());
+                process_id = -1;
+            }
+        }
+
+        Process::Process(Process&& other)
+            : process_id(std::exchange(other.process_id, -1)), input_fd(std::exchange(other.input_fd, -1)),
+              output_fd(std::exchange(other.output_fd, -1)), exit_code(other.exit_code)
+        {
+        }
+
+        auto Process::operator=(Process&& other) -> Process&
+        {
+            close();
+            process_id = std::exchange(other.process_id, -1);
+            input_fd = std::exchange(other.input_fd, -1);
+            output_fd = std::exchange(other.output_fd, -1);
+            exit_code = other.exit_code;
+            return *this;
+        }
+#endif
+
+        Process::~Process()
+        {
+            close();
+        }
+    } // namespace internal
+} // namespace memucpp
@@ -0,0 +1,90 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        /*!
+            \brief Child process with piped standard output (and optionally standard input)
+        */
+        class Process
+        {
+          public:
+            /*!
+                \brief Spawns the process without shell quoting
+                \param arguments executable path followed by its arguments
+                \param redirect_input keeps the standard input pipe open for writing
+            */
+            Process(std::span<std::string const> const arguments, bool const redirect_input);
+
+            ~Process();
+
+            Process(Process const&) = delete;
+
+            Process(Process&& other);
+
+            auto operator=(Process const&) -> Process& = delete;
+
+            auto operator=(Process&& other) -> Process&;
+
+            /*!
+                \brief Writes data to the standard input
+                \return false if the pipe is closed
+            */
+            auto write(std::span<uint8_t const> const data) -> bool;
+
+            /*!
+                \brief Reads the available output into the buffer
+                \param timeout maximum time to wait (milliseconds::max() waits forever)
+                \return number of bytes read (0 is end of stream) or std::nullopt on timeout
+            */
+            auto read(std::span<uint8_t> const buffer, std::chrono::milliseconds const timeout)
+                -> std::optional<size_t>;
+
+            /*!
+                \brief Closes the standard input pipe
+            */
+            auto close_input() -> void;
+
+            /*!
+                \brief Waits for the process exit
+                \return exit code or std::nullopt on timeout
+            */
+            auto wait(std::chrono::milliseconds const timeout) -> std::optional<int32_t>;
+
+            /*!
+                \brief Forcibly terminates the process
+            */
+            auto kill() -> void;
+
+#ifndef _WIN32
+            /*!
+                \brief Returns the descriptor of the standard output pipe (to watch it with epoll or poll)
+            */
+            auto output_descriptor() const -> int32_t;
+#endif
+
+          private:
+#ifdef _WIN32
+            void* process_handle;
+            void* input_handle;
+            void* output_handle;
+#else
+            int32_t process_id;
+            int32_t input_fd;
+            int32_t output_fd;
+#endif
+            std::optional<int32_t> exit_code;
+
+            auto close() -> void;
+        };
+    } // namespace internal
+} // namespace memucpp
@@ -0,0 +1,416 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/record.hpp"
+#include "mapping.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        std::array<char, 8> constexpr record_magic{'M', 'E', 'M', 'U', 'R', 'E', 'C', '1'};
+
+        // The file: header, index ring, data ring (frames and commands aligned to 8 bytes)
+        struct RecordHeader
+        {
+            std::array<char, 8> magic;
+            uint32_t index_size;
+            uint32_t reserved;
+            uint64_t capacity;
+            // Number of the records written, published after the record and its entry
+            uint64_t count;
+            // End of the written data (grows past the capacity, the ring position is modulo capacity)
+            uint64_t written;
+            std::array<uint64_t, 3> padding;
+        };
+
+        struct RecordEntry
+        {
+            uint64_t sequence;
+            // Nanoseconds since the epoch
+            int64_t time;
+            uint64_t offset;
+            uint32_t size;
+            uint32_t kind;
+            uint32_t width;
+            uint32_t height;
+            uint32_t stride;
+            uint32_t format;
+        };
+
+        static_assert(sizeof(RecordHeader) == 64 && sizeof(RecordEntry) == 48);
+
+        // Kinds of the records
+        uint32_t constexpr frame_record = 0;
+        uint32_t constexpr input_record = 1;
+
+        auto data_offset(uint32_t const index_size) -> uint64_t
+        {
+            return (sizeof(RecordHeader) + static_cast<uint64_t>(index_size) * sizeof(RecordEntry) + 63) & ~63ull;
+        }
+
+        auto record_header(MappedFile const& file) -> RecordHeader&
+        {
+            return *reinterpret_cast<RecordHeader*>(file.data().data());
+        }
+
+        auto record_entry(MappedFile const& file, uint32_t const slot) -> RecordEntry&
+        {
+            return reinterpret_cast<RecordEntry*>(file.data().data() + sizeof(RecordHeader))[slot];
+        }
+
+        auto record_data(MappedFile const& file, RecordEntry const& entry) -> std::span<uint8_t const>
+        {
+            auto const& header = record_header(file);
+            return file.data().subspan(data_offset(header.index_size) + entry.offset % header.capacity, entry.size);
+        }
+
+        auto record_time(int64_t const time) -> std::chrono::system_clock::time_point
+        {
+            return std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(time)));
+        }
+
+        /*!
+            \brief Writes the record into the ring and publishes its index entry
+            \param fill writes the data into the destination of the size
+        */
+        template <typename Fill>
+        auto append_record(MappedFile& file, RecordEntry entry, Fill&& fill) -> void
+        {
+            auto& header = record_header(file);
+
+            uint64_t const size = (static_cast<uint64_t>(entry.size) + 7) & ~7ull;
+            if (size > header.capacity)
+            {
+                throw error("Record is larger than the capacity of the recorder");
+            }
+
+            // The record that does not fit the end of the ring starts at its beginning
+            uint64_t offset = header.written;
+            if (offset % header.capacity + size > header.capacity)
+            {
+                offset += header.capacity - offset % header.capacity;
+            }
+            fill(file.data().data() + data_offset(header.index_size) + offset % header.capacity);
+
+            uint64_t const count = std::atomic_ref(header.count).load(std::memory_order_relaxed);
+            entry.sequence = count;
+            entry.offset = offset;
+            entry.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+            record_entry(file, static_cast<uint32_t>(count % header.index_size)) = entry;
+
+            header.written = offset + size;
+            std::atomic_ref(header.count).store(count + 1, std::memory_order_release);
+        }
+
+        // Answer of the touch screen query of the replay: the ABI and the multi-touch device of MEmu (720x1280)
+        std::string_view constexpr replay_touch_device = "x86_64\r\n"
+                                                         "add device 1: /dev/input/event4\r\n"
+                                                         "  name:     \"Microvirt Virtual Input\"\r\n"
+                                                         "  events:\r\n"
+                                                         "    KEY (0001): 014a\r\n"
+                                                         "    ABS (0003): 002f  : value 0, min 0, max 9\r\n"
+                                                         "                0035  : value 0, min 0, max 719\r\n"
+                                                         "                0036  : value 0, min 0, max 1279\r\n"
+                                                         "                0039  : value 0, min 0, max 65535\r\n";
+    } // namespace internal
+
+    FrameRecorder::FrameRecorder(std::filesystem::path const& path, RecorderOptions const& options)
+    {
+        if (options.capacity == 0 || options.index_size == 0)
+        {
+            throw error("Recorder capacity must be positive");
+        }
+
+        file = std::make_unique<internal::MappedFile>(
+            internal::MappedFile::Create(path, internal::data_offset(options.index_size) + options.capacity));
+
+        auto& header = internal::record_header(*file);
+        header.magic = internal::record_magic;
+        header.index_size = options.index_size;
+        header.capacity = options.capacity;
+    }
+
+    FrameRecorder::~FrameRecorder()
+    {
+    }
+
+    auto FrameRecorder::record(Frame const& frame) -> void
+    {
+        std::lock_guard lock(mutex);
+
+        size_t const row_size = static_cast<size_t>(frame.width) * bytes_per_pixel(frame.format);
+        internal::RecordEntry const entry{.sequence = 0,
+                                          .time = 0,
+                                          .offset = 0,
+                                          .size = static_cast<uint32_t>(row_size * frame.height),
+                                          .kind = internal::frame_record,
+                                          .width = frame.width,
+                                          .height = frame.height,
+                                          .stride = static_cast<uint32_t>(row_size),
+                                          .format = static_cast<uint32_t>(frame.format)};
+
+        internal::append_record(*file, entry, [&](uint8_t* destination) {
+            if (frame.stride == row_size)
+            {
+                std::memcpy(destination, frame.data.data(), entry.size);
+                return;
+            }
+            for (uint32_t y = 0; y < frame.height; ++y)
+            {
+                std::memcpy(destination + y * row_size, frame.row(y).data(), row_size);
+            }
+        });
+    }
+
+    auto FrameRecorder::record_input(std::string_view const command) -> void
+    {
+        std::lock_guard lock(mutex);
+
+        internal::RecordEntry const entry{.sequence = 0,
+                                          .time = 0,
+                                          .offset = 0,
+                                          .size = static_cast<uint32_t>(command.size()),
+                                          .kind = internal::input_record,
+                                          .width = 0,
+                                          .height = 0,
+                                          .stride = 0,
+                                          .format = 0};
+
+        internal::append_record(*file, entry, [&](uint8_t* destination) {
+            std::memcpy(destination, command.data(), command.size());
+        });
+    }
+
+    auto FrameRecorder::records() const -> uint64_t
+    {
+        std::lock_guard lock(mutex);
+        return internal::record_header(*file).count;
+    }
+
+    auto FrameRecorder::flush() -> void
+    {
+        std::lock_guard lock(mutex);
+        file->flush();
+    }
+
+    FrameReplay::FrameReplay(std::filesystem::path const& path)
+        : file(std::make_unique<internal::MappedFile>(internal::MappedFile::Open(path)))
+    {
+        auto const data = file->data();
+        auto const& header = internal::record_header(*file);
+        if (data.size() < sizeof(internal::RecordHeader) || header.magic != internal::record_magic ||
+            header.index_size == 0 || header.capacity == 0 ||
+            data.size() < internal::data_offset(header.index_size) + header.capacity)
+        {
+            throw error("Recording is malformed");
+        }
+
+        uint64_t const count = std::atomic_ref(const_cast<uint64_t&>(header.count)).load(std::memory_order_acquire);
+        uint64_t const oldest = header.written > header.capacity ? header.written - header.capacity : 0;
+
+        // The entries that were reused or whose data was overwritten by the newer records are skipped
+        for (uint64_t sequence = count > header.index_size ? count - header.index_size : 0; sequence < count;
+             ++sequence)
+        {
+            auto const slot = static_cast<uint32_t>(sequence % header.index_size);
+            auto const& entry = internal::record_entry(*file, slot);
+            if (entry.sequence != sequence || entry.offset < oldest)
+            {
+                continue;
+            }
+            (entry.kind == internal::frame_record ? frame_entries : input_entries).push_back(slot);
+        }
+    }
+
+    FrameReplay::~FrameReplay()
+    {
+    }
+
+    auto FrameReplay::frame_count() const -> size_t
+    {
+        return frame_entries.size();
+    }
+
+    auto FrameReplay::frame(size_t const index) const -> RecordedFrame
+    {
+        auto const& entry = internal::record_entry(*file, frame_entries.at(index));
+        return RecordedFrame{.sequence = entry.sequence,
+                             .time = internal::record_time(entry.time),
+                             .frame = Frame{.data = internal::record_data(*file, entry),
+                                            .width = entry.width,
+                                            .height = entry.height,
+                                            .stride = entry.stride,
+                                            .format = static_cast<PixelFormat>(entry.format)}};
+    }
+
+    auto FrameReplay::inputs() const -> std::vector<RecordedInput>
+    {
+        std::vector<RecordedInput> out;
+        for (auto const slot : input_entries)
+        {
+            auto const& entry = internal::record_entry(*file, slot);
+            auto const data = internal::record_data(*file, entry);
+            out.push_back(RecordedInput{
+                .sequence = entry.sequence,
+                .time = internal::record_time(entry.time),
+                .command = std::string(reinterpret_cast<char const*>(data.data()), data.size())});
+        }
+        return out;
+    }
+
+    ReplayBackend::ReplayBackend(std::shared_ptr<FrameReplay> replay, bool const loop)
+        : replay(std::move(replay)), loop(loop), position(0)
+    {
+    }
+
+    auto ReplayBackend::execute(std::span<std::string const> const arguments, std::vector<uint8_t>& output,
+                                std::chrono::milliseconds const) -> ProcessResult
+    {
+        std::lock_guard lock(mutex);
+
+        auto const has = [&](std::string_view const argument) {
+            return std::ranges::find(arguments, argument) != arguments.end();
+        };
+
+        // memuc prints the banner of the adb connection before the output of the device
+        std::string_view constexpr banner = "already connected to 127.0.0.1:21503\r\n\r\n";
+
+        auto write = [&](std::initializer_list<std::span<uint8_t const>> const parts) {
+            size_t size = 0;
+            for (auto const& part : parts)
+            {
+                size += part.size();
+            }
+            if (output.size() < size)
+            {
+                output.resize(size);
+            }
+
+            size_t offset = 0;
+            for (auto const& part : parts)
+            {
+                std::memcpy(output.data() + offset, part.data(), part.size());
+                offset += part.size();
+            }
+            return ProcessResult{.exit_code = 0, .timed_out = false, .size = size};
+        };
+        auto text = [](std::string_view const source) {
+            return std::span<uint8_t const>(reinterpret_cast<uint8_t const*>(source.data()), source.size());
+        };
+
+        if (has("screencap"))
+        {
+            if (replay->frame_count() == 0)
+            {
+                throw error("Recording has no frames");
+            }
+
+            auto const recorded = replay->frame(std::min(position, replay->frame_count() - 1));
+            position = loop ? (position + 1) % replay->frame_count() : std::min(position + 1, replay->frame_count());
+
+            uint32_t code;
+            switch (recorded.frame.format)
+            {
+                case PixelFormat::RGBA8888:
+                    code = 1;
+                    break;
+                case PixelFormat::RGBX8888:
+                    code = 2;
+                    break;
+                case PixelFormat::RGB565:
+                    code = 4;
+                    break;
+                case PixelFormat::BGRA8888:
+                    code = 5;
+                    break;
+                default:
+                    throw error("Recorded frame format is not supported by the screencap");
+            }
+            std::array<uint32_t, 3> const header{recorded.frame.width, recorded.frame.height, code};
+            auto const header_bytes = std::as_bytes(std::span(header));
+
+            // Device side pipeline of the region capture: screencap | tail -c +N | head -c M
+            size_t skip = 0;
+            size_t limit = std::numeric_limits<size_t>::max();
+            for (auto it = arguments.begin(); it != arguments.end(); ++it)
+            {
+                if (*it == "tail" && it + 2 < arguments.end())
+                {
+                    skip = internal::stoi<size_t>(std::string_view(it[2]).substr(1)) - 1;
+                }
+                else if (*it == "head" && it + 2 < arguments.end())
+                {
+                    limit = internal::stoi<size_t>(it[2]);
+                }
+            }
+
+            std::span<uint8_t const> header_part(reinterpret_cast<uint8_t const*>(header_bytes.data()),
+                                                 header_bytes.size());
+            std::span<uint8_t const> pixels = recorded.frame.data;
+            size_t const header_skip = std::min(skip, header_part.size());
+            header_part = header_part.subspan(header_skip);
+            pixels = pixels.subspan(std::min(skip - header_skip, pixels.size()));
+            header_part = header_part.first(std::min(limit, header_part.size()));
+            pixels = pixels.first(std::min(limit - header_part.size(), pixels.size()));
+
+            return write({text(banner), header_part, pixels});
+        }
+        else if (has("adb"))
+        {
+            std::string command;
+            auto const shell = std::ranges::find(arguments, "shell");
+            for (auto it = shell == arguments.end() ? shell : shell + 1; it != arguments.end(); ++it)
+            {
+                command += command.empty() ? "" : " ";
+                command += *it;
+            }
+            auto const connected = text(banner.substr(0, banner.size() - 2));
+
+            // The touch screen of the gestures, then the guest is booted
+            if (command.find("getevent -p") != std::string::npos)
+            {
+                return write({connected, text(internal::replay_touch_device)});
+            }
+            if (command.starts_with("getprop"))
+            {
+                return write({connected, text("1\r\n")});
+            }
+            // The recording has no processes, the header alone is the empty list
+            if (command == "ps")
+            {
+                return write({connected, text("USER     PID   PPID  VSIZE  RSS     WCHAN    PC         NAME\r\n")});
+            }
+            // Only the input commands and the gestures (event reports written to the touch screen) of the bot are
+            // collected, the other queries have no output
+            if (command.starts_with("input ") || command.find("> /dev/input/") != std::string::npos)
+            {
+                issued.push_back(std::move(command));
+            }
+            return write({connected});
+        }
+        else if (has("getconfigex"))
+        {
+            return write({text("Value: \r\n")});
+        }
+        return write({text("SUCCESS: command completed\r\n")});
+    }
+
+    auto ReplayBackend::finished() const -> bool
+    {
+        std::lock_guard lock(mutex);
+        return !loop && position >= replay->frame_count();
+    }
+
+    auto ReplayBackend::inputs() const -> std::vector<std::string>
+    {
+        std::lock_guard lock(mutex);
+        return issued;
+    }
+} // namespace memucpp
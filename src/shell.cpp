@@ -0,0 +1,162 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/shell.hpp"
+#include "memucpp.hpp"
+#include "process.hpp"
+
+namespace memucpp
+{
+    ShellSession::ShellSession(std::vector<std::string> command, ShellOptions const& options)
+        : command(std::move(command)), options(options), sequence(0)
+    {
+    }
+
+    ShellSession::~ShellSession()
+    {
+        disconnect();
+    }
+
+    auto ShellSession::execute(std::string_view const command) -> ShellResult
+    {
+        std::lock_guard lock(mutex);
+
+        for (uint32_t attempt = 0;; ++attempt)
+        {
+            if (!process)
+            {
+                connect();
+            }
+
+            std::optional<ShellResult> result;
+            try
+            {
+                result = run(command);
+            }
+            catch (...)
+            {
+                // The shell state is unknown after a timeout, so the next command starts a new one
+                process.reset();
+                throw;
+            }
+
+            if (result)
+            {
+                return std::move(result.value());
+            }
+
+            // The command was not sent, so it runs once in the new shell
+            process.reset();
+
+            if (attempt >= options.reconnect_attempts)
+            {
+                throw error("The shell session was closed");
+            }
+        }
+    }
+
+    auto ShellSession::disconnect() -> void
+    {
+        std::lock_guard lock(mutex);
+
+        if (process)
+        {
+            // Lets the shell exit gracefully before it is terminated
+            process->close_input();
+            process->wait(std::chrono::milliseconds(100));
+            process.reset();
+        }
+    }
+
+    auto ShellSession::connected() const -> bool
+    {
+        std::lock_guard lock(mutex);
+        return process != nullptr;
+    }
+
+    auto ShellSession::connect() -> void
+    {
+        process = std::make_unique<internal::Process>(command, true);
+
+        // Skips any banner printed before the shell becomes ready
+        std::optional<ShellResult> result;
+        try
+        {
+            result = run("true");
+        }
+        catch (...)
+        {
+            process.reset();
+            throw;
+        }
+
+        if (!result)
+        {
+            process.reset();
+            throw error("An error occurred when opening the shell session");
+        }
+    }
+
+    auto ShellSession::run(std::string_view const command) -> std::optional<ShellResult>
+    {
+        ++sequence;
+
+        std::string const marker = std::format("\n__MEMUCPP_{}_", sequence);
+        std::string const script =
+            std::format("{{ {}\n}} </dev/null 2>&1; __status=$?; echo; echo {}${{__status}}__\n", command,
+                        std::string_view(marker).substr(1));
+
+        if (!process->write(std::span<uint8_t const>(reinterpret_cast<uint8_t const*>(script.data()), script.size())))
+        {
+            return std::nullopt;
+        }
+
+        buffer.clear();
+
+        std::array<uint8_t, 16 * 1024> chunk;
+        size_t scanned = 0;
+        auto const deadline = std::chrono::steady_clock::now() + options.timeout;
+
+        while (true)
+        {
+            std::string_view const data(reinterpret_cast<char const*>(buffer.data()), buffer.size());
+
+            size_t const position = data.find(marker, scanned);
+            if (position != std::string_view::npos)
+            {
+                size_t const status_begin = position + marker.size();
+                size_t const status_end = data.find("__", status_begin);
+
+                if (status_end != std::string_view::npos)
+                {
+                    return ShellResult{
+                        .exit_code = internal::stoi<int32_t>(data.substr(status_begin, status_end - status_begin)),
+                        .output = std::string(data.substr(0, position))};
+                }
+                scanned = position;
+            }
+            else
+            {
+                scanned = buffer.size() > marker.size() ? buffer.size() - marker.size() : 0;
+            }
+
+            auto const remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (remaining.count() <= 0)
+            {
+                throw error("The shell command timed out");
+            }
+
+            auto const read_bytes = process->read(chunk, remaining);
+            if (!read_bytes)
+            {
+                throw error("The shell command timed out");
+            }
+            else if (read_bytes.value() == 0)
+            {
+                // The command may have run already, repeating it could send the input twice
+                throw error("The shell session was closed while the command was running");
+            }
+            buffer.insert(buffer.end(), chunk.begin(), std::next(chunk.begin(), read_bytes.value()));
+        }
+    }
+} // namespace memucpp
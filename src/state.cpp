@@ -0,0 +1,218 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/state.hpp"
+#include "memucpp.hpp"
+#include <algorithm>
+#include <bit>
+
+namespace memucpp
+{
+    namespace internal
+    {
+        // Columns and rows of the hash grid (the adjacent columns give 8 bits per row)
+        uint32_t constexpr hash_columns = 9;
+        uint32_t constexpr hash_rows = 8;
+        // Samples per cell side, the cells of the large regions are subsampled
+        uint32_t constexpr cell_samples = 8;
+
+        struct LumaLayout
+        {
+            uint32_t pixel_size;
+            uint32_t red;
+            uint32_t green;
+            uint32_t blue;
+        };
+
+        auto luma_layout(PixelFormat const format) -> LumaLayout
+        {
+            switch (format)
+            {
+                case PixelFormat::RGBA8888:
+                case PixelFormat::RGBX8888:
+                    return {.pixel_size = 4, .red = 0, .green = 1, .blue = 2};
+                case PixelFormat::BGRA8888:
+                    return {.pixel_size = 4, .red = 2, .green = 1, .blue = 0};
+                case PixelFormat::BGR888:
+                    return {.pixel_size = 3, .red = 2, .green = 1, .blue = 0};
+                case PixelFormat::Gray8:
+                    return {.pixel_size = 1, .red = 0, .green = 0, .blue = 0};
+                default:
+                    throw error("Frame pixel format is not supported");
+            }
+        }
+
+        auto clip(Rect const& region, Frame const& frame) -> Rect
+        {
+            uint32_t const x = std::min(region.x, frame.width);
+            uint32_t const y = std::min(region.y, frame.height);
+            return Rect{.x = x,
+                        .y = y,
+                        .width = std::min(region.width, frame.width - x),
+                        .height = std::min(region.height, frame.height - y)};
+        }
+
+        auto hash_distance(std::span<uint64_t const> const first, std::span<uint64_t const> const second) -> uint32_t
+        {
+            uint32_t bits = 0;
+            for (size_t i = 0; i < first.size(); ++i)
+            {
+                bits += static_cast<uint32_t>(std::popcount(first[i] ^ second[i]));
+            }
+            return (bits + static_cast<uint32_t>(first.size()) / 2) / static_cast<uint32_t>(first.size());
+        }
+    } // namespace internal
+
+    auto perceptual_hash(Frame const& frame, Rect const& region) -> uint64_t
+    {
+        auto const layout = internal::luma_layout(frame.format);
+        auto const rect = internal::clip(region, frame);
+        if (rect.width < internal::hash_columns || rect.height < internal::hash_rows)
+        {
+            throw error("Region is too small for the perceptual hash");
+        }
+
+        // Mean luminance of the cells (BT.601 weights, the sum of the weights is 256)
+        std::array<uint32_t, internal::hash_columns * internal::hash_rows> means;
+        for (uint32_t row = 0; row < internal::hash_rows; ++row)
+        {
+            uint32_t const top = rect.y + row * rect.height / internal::hash_rows;
+            uint32_t const bottom = rect.y + (row + 1) * rect.height / internal::hash_rows;
+            uint32_t const step_y = std::max(1u, (bottom - top) / internal::cell_samples);
+
+            for (uint32_t column = 0; column < internal::hash_columns; ++column)
+            {
+                uint32_t const left = rect.x + column * rect.width / internal::hash_columns;
+                uint32_t const right = rect.x + (column + 1) * rect.width / internal::hash_columns;
+                uint32_t const step_x = std::max(1u, (right - left) / internal::cell_samples);
+
+                uint64_t sum = 0;
+                uint32_t count = 0;
+                for (uint32_t y = top; y < bottom; y += step_y)
+                {
+                    uint8_t const* pixels = frame.data.data() + static_cast<size_t>(y) * frame.stride;
+                    for (uint32_t x = left; x < right; x += step_x)
+                    {
+                        uint8_t const* pixel = pixels + static_cast<size_t>(x) * layout.pixel_size;
+                        sum += pixel[layout.red] * 77u + pixel[layout.green] * 150u + pixel[layout.blue] * 29u;
+                        ++count;
+                    }
+                }
+                means[row * internal::hash_columns + column] = static_cast<uint32_t>(sum / count);
+            }
+        }
+
+        // One bit per pair of the adjacent cells: the left one is brighter
+        uint64_t hash = 0;
+        for (uint32_t row = 0; row < internal::hash_rows; ++row)
+        {
+            for (uint32_t column = 0; column + 1 < internal::hash_columns; ++column)
+            {
+                uint32_t const cell = row * internal::hash_columns + column;
+                hash = (hash << 1) | (means[cell] > means[cell + 1] ? 1 : 0);
+            }
+        }
+        return hash;
+    }
+
+    ScreenStateIndex::ScreenStateIndex(StateIndexOptions const& options) : options(options)
+    {
+    }
+
+    auto ScreenStateIndex::add(std::string_view const label, Frame const& frame, std::vector<Rect> const& regions)
+        -> void
+    {
+        // The index is changed only after every region is hashed, the failed reference leaves nothing behind
+        std::vector<uint64_t> reference_hashes;
+        if (regions.empty())
+        {
+            reference_hashes.push_back(
+                perceptual_hash(frame, Rect{.x = 0, .y = 0, .width = frame.width, .height = frame.height}));
+        }
+        for (auto const& region : regions)
+        {
+            reference_hashes.push_back(perceptual_hash(frame, region));
+        }
+
+        Reference const reference{
+            .label = find_label(label), .layout = find_layout(regions), .offset = hashes.size()};
+        hashes.insert(hashes.end(), reference_hashes.begin(), reference_hashes.end());
+        references.push_back(reference);
+    }
+
+    auto ScreenStateIndex::add(std::string_view const label, std::span<uint8_t const> const bitmap,
+                               std::vector<Rect> const& regions) -> void
+    {
+        std::vector<uint8_t> pixels;
+        add(label, decode_bmp(bitmap, pixels), regions);
+    }
+
+    auto ScreenStateIndex::classify(Frame const& frame) const -> std::optional<StateMatch>
+    {
+        // Hashes of the frame for every set of the regions, in the order of the layouts
+        std::vector<uint64_t> frame_hashes;
+        std::vector<size_t> layout_offsets;
+        for (auto const& regions : layouts)
+        {
+            layout_offsets.push_back(frame_hashes.size());
+            if (regions.empty())
+            {
+                frame_hashes.push_back(
+                    perceptual_hash(frame, Rect{.x = 0, .y = 0, .width = frame.width, .height = frame.height}));
+            }
+            for (auto const& region : regions)
+            {
+                frame_hashes.push_back(perceptual_hash(frame, region));
+            }
+        }
+
+        Reference const* best = nullptr;
+        uint32_t best_distance = 0;
+        for (auto const& reference : references)
+        {
+            size_t const count = std::max<size_t>(1, layouts[reference.layout].size());
+            uint32_t const distance = internal::hash_distance(
+                std::span(hashes).subspan(reference.offset, count),
+                std::span(frame_hashes).subspan(layout_offsets[reference.layout], count));
+            if (!best || distance < best_distance)
+            {
+                best = &reference;
+                best_distance = distance;
+            }
+        }
+
+        if (!best || best_distance > options.max_distance)
+        {
+            return std::nullopt;
+        }
+        return StateMatch{.label = labels[best->label],
+                          .distance = best_distance,
+                          .confidence = std::max(0.0, 1.0 - best_distance / 32.0)};
+    }
+
+    auto ScreenStateIndex::size() const -> size_t
+    {
+        return references.size();
+    }
+
+    auto ScreenStateIndex::find_label(std::string_view const label) -> uint32_t
+    {
+        auto const found = std::ranges::find(labels, label);
+        if (found != labels.end())
+        {
+            return static_cast<uint32_t>(found - labels.begin());
+        }
+        labels.emplace_back(label);
+        return static_cast<uint32_t>(labels.size() - 1);
+    }
+
+    auto ScreenStateIndex::find_layout(std::vector<Rect> const& regions) -> uint32_t
+    {
+        auto const found = std::ranges::find(layouts, regions);
+        if (found != layouts.end())
+        {
+            return static_cast<uint32_t>(found - layouts.begin());
+        }
+        layouts.push_back(regions);
+        return static_cast<uint32_t>(layouts.size() - 1);
+    }
+} // namespace memucpp
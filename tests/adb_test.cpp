@@ -0,0 +1,296 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+/*!
+    \brief Local adb server that serves one device with screencap, ps and input
+*/
+class FakeAdbServer
+{
+  public:
+    FakeAdbServer(std::string serial) : serial(std::move(serial))
+    {
+        listener = ::socket(AF_INET, SOCK_STREAM, 0);
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        ::listen(listener, 64);
+
+        socklen_t size = sizeof(address);
+        ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &size);
+        port = ntohs(address.sin_port);
+
+        thread = std::jthread([this](std::stop_token const stop_token) {
+            while (!stop_token.stop_requested())
+            {
+                int32_t const client = ::accept(listener, nullptr, nullptr);
+                if (client < 0)
+                {
+                    return;
+                }
+                clients.emplace_back([this, client]() { serve(client); });
+            }
+        });
+    }
+
+    ~FakeAdbServer()
+    {
+        thread.request_stop();
+        ::shutdown(listener, SHUT_RDWR);
+        ::close(listener);
+    }
+
+    uint16_t port;
+
+    auto inputs() -> std::vector<std::string>
+    {
+        std::lock_guard lock(mutex);
+        return received_inputs;
+    }
+
+  private:
+    std::string serial;
+    int32_t listener;
+    std::mutex mutex;
+    std::vector<std::string> received_inputs;
+    std::vector<std::jthread> clients;
+    std::jthread thread;
+
+    static auto receive(int32_t const client, size_t const size) -> std::optional<std::string>
+    {
+        std::string out(size, '\0');
+        size_t offset = 0;
+        while (offset < size)
+        {
+            auto const received = ::recv(client, out.data() + offset, size - offset, 0);
+            if (received <= 0)
+            {
+                return std::nullopt;
+            }
+            offset += static_cast<size_t>(received);
+        }
+        return out;
+    }
+
+    static auto send(int32_t const client, std::string_view const data) -> void
+    {
+        size_t offset = 0;
+        while (offset < data.size())
+        {
+            auto const sent = ::send(client, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                return;
+            }
+            offset += static_cast<size_t>(sent);
+        }
+    }
+
+    auto serve(int32_t const client) -> void
+    {
+        bool transport = false;
+        while (auto const length = receive(client, 4))
+        {
+            auto const request = receive(client, std::stoul(*length, nullptr, 16));
+            if (!request)
+            {
+                break;
+            }
+
+            if (request->starts_with("host:transport:"))
+            {
+                if (request->substr(15) != serial)
+                {
+                    std::string_view const message = "device not found";
+                    send(client, std::format("FAIL{:04x}{}", message.size(), message));
+                    break;
+                }
+                send(client, "OKAY");
+                transport = true;
+            }
+            else if (transport && (request->starts_with("shell:") || request->starts_with("exec:")))
+            {
+                send(client, "OKAY");
+                send(client, execute(request->substr(request->find(':') + 1)));
+                break;
+            }
+            else
+            {
+                std::string_view const message = "unknown service";
+                send(client, std::format("FAIL{:04x}{}", message.size(), message));
+                break;
+            }
+        }
+        ::close(client);
+    }
+
+    auto execute(std::string_view const command) -> std::string
+    {
+        if (command.starts_with("input "))
+        {
+            std::lock_guard lock(mutex);
+            received_inputs.emplace_back(command);
+            return "";
+        }
+        if (command == "ps")
+        {
+            return "USER PID PPID NAME\n"
+                   "system 1 0 com.android.systemui\n"
+                   "u0_a1 2 1 com.example.first\n"
+                   "u0_a2 3 1 com.example.second\n"
+                   "shell 4 1 com.android.shell\n";
+        }
+        if (command.starts_with("screencap"))
+        {
+            // Android 10+ header with the color space, the green channel is the row index
+            uint32_t const width = 720;
+            uint32_t const height = 1280;
+            std::string output(4 * sizeof(uint32_t), '\0');
+            std::array<uint32_t, 4> const header{width, height, 1, 0};
+            std::memcpy(output.data(), header.data(), sizeof(header));
+
+            for (uint32_t j = 0; j < height; ++j)
+            {
+                for (uint32_t i = 0; i < width; ++i)
+                {
+                    output += static_cast<char>(i);
+                    output += static_cast<char>(j);
+                    output += static_cast<char>(i ^ j);
+                    output += static_cast<char>(255);
+                }
+            }
+
+            // screencap | tail -c +N | head -c M
+            size_t const tail = command.find("tail -c +");
+            if (tail != std::string_view::npos)
+            {
+                size_t const skip = std::stoul(std::string(command.substr(tail + 9))) - 1;
+                size_t const bytes = std::stoul(std::string(command.substr(command.find("head -c ") + 8)));
+                output = output.substr(skip, bytes);
+            }
+            return output;
+        }
+        return "/system/bin/sh: unknown command\n";
+    }
+};
+
+auto test_client(FakeAdbServer& server) -> void
+{
+    auto options = AdbOptions::Default();
+    options.port = server.port;
+
+    AdbClient client(AdbClient::vm_serial(0), options);
+    expect(client.serial() == "127.0.0.1:21503", "Serial of the VM is wrong");
+
+    std::vector<uint8_t> output;
+    size_t const size = client.exec("screencap", output);
+    expect(size == 16 + 720 * 1280 * 4, "Screencap is not streamed completely");
+
+    for (uint32_t i = 0; i < 50; ++i)
+    {
+        client.shell(std::format("input tap {} {}", i, i));
+    }
+    expect(server.inputs().size() == 50 && server.inputs().back() == "input tap 49 49", "Inputs are not delivered");
+
+    // Every request after the first one uses the connection opened in advance
+    auto const stats = client.stats();
+    expect(stats.requests == 51 && stats.reuses == 50, "Connections are not reused");
+    expect(stats.connections == 51 + options.connections, "Connection count is wrong");
+
+    AdbClient missing(AdbClient::vm_serial(7), options);
+    try
+    {
+        missing.shell("input tap 1 1");
+        throw std::runtime_error("Request to the missing device did not fail");
+    }
+    catch (error const& e)
+    {
+        expect(std::string_view(e.what()).find("device not found") != std::string_view::npos,
+               std::format("Unexpected error: {}", e.what()));
+    }
+}
+
+auto test_memuc(FakeAdbServer& server) -> void
+{
+    auto options = AdbOptions::Default();
+    options.port = server.port;
+
+    Memuc memuc(0, VMConfig::Default());
+    memuc.enable_adb_transport(true, options);
+
+    auto const frame = memuc.capture();
+    expect(frame.width == 720 && frame.height == 1280, "Frame size is wrong");
+    expect(frame.row(5)[1] == 5 && frame.row(5)[2] == 5, "Frame pixels are wrong");
+
+    auto const region = memuc.capture_region(Rect{.x = 10, .y = 50, .width = 200, .height = 80});
+    auto const repeated = memuc.capture_region(Rect{.x = 10, .y = 50, .width = 200, .height = 80});
+    for (uint32_t y = 0; y < 80; ++y)
+    {
+        expect(std::ranges::equal(region.frame.row(y), frame.row(50 + y).subspan(10 * 4, 200 * 4)) &&
+                   std::ranges::equal(repeated.frame.row(y), region.frame.row(y)),
+               std::format("Row {} of the region differs", y));
+    }
+
+    memuc.trigger_click({10, 20});
+    memuc.trigger_key(KeyCode::Back);
+    auto const inputs = server.inputs();
+    expect(inputs[inputs.size() - 2] == "input tap 10 20" && inputs.back() == "input keyevent 4",
+           "Inputs of the Memuc are not delivered");
+
+    expect(memuc.list_process().size() == 2, "List of the processes is wrong");
+
+    // Requests go over the local socket, without launching any process
+    auto const start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        memuc.trigger_click({i, i});
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    expect(elapsed < std::chrono::seconds(2),
+           std::format("Requests are slow ({})", std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)));
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: adb_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+
+        FakeAdbServer server(AdbClient::vm_serial(0));
+
+        test_client(server);
+        test_memuc(server);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <coroutine>
+#include <cstdlib>
+#include <future>
+#include <thread>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+template <typename Type>
+auto expect_error(AsyncResult<Type>& result, std::string_view const message) -> void
+{
+    try
+    {
+        result.get();
+    }
+    catch (error const& e)
+    {
+        expect(std::string_view(e.what()) == message, std::format("Unexpected error: {}", e.what()));
+        return;
+    }
+    throw std::runtime_error(std::format("Command did not fail with '{}'", message));
+}
+
+// Coroutine that starts at once and is resumed by the awaited commands
+struct Task
+{
+    struct promise_type
+    {
+        auto get_return_object() -> Task
+        {
+            return {};
+        }
+
+        auto initial_suspend() -> std::suspend_never
+        {
+            return {};
+        }
+
+        auto final_suspend() noexcept -> std::suspend_never
+        {
+            return {};
+        }
+
+        auto return_void() -> void
+        {
+        }
+
+        auto unhandled_exception() -> void
+        {
+            std::terminate();
+        }
+    };
+};
+
+auto test_results(Memuc& memuc) -> void
+{
+    auto vms = memuc.list_vms_async();
+    auto started = memuc.start_app_async("com.example.app");
+    auto frame = memuc.capture_async();
+
+    expect(vms.get().size() == 2, "List of the VMs is wrong");
+    started.get();
+
+    auto const captured = frame.get();
+    expect(captured.width == 720 && captured.height == 1280 && captured.buffer, "Captured frame is wrong");
+    expect(captured.row(3)[1] == 3, "Captured pixels are wrong");
+}
+
+auto test_in_flight(Memuc& memuc) -> void
+{
+    ::setenv("MEMUC_STUB_LATENCY_MS", "300", 1);
+
+    auto loop = EventLoop::Create();
+    memuc.set_event_loop(loop);
+
+    // One thread keeps every command in flight, so the latencies overlap
+    auto const start = std::chrono::steady_clock::now();
+
+    std::vector<AsyncResult<void>> results;
+    for (uint32_t i = 0; i < 200; ++i)
+    {
+        results.push_back(memuc.trigger_click_async({i, i}));
+    }
+    expect(loop->stats().in_flight > 100, "Commands are not in flight together");
+
+    for (auto& result : results)
+    {
+        result.get();
+    }
+
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    expect(elapsed < std::chrono::seconds(20), std::format("Commands did not overlap ({})",
+                                                           std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)));
+
+    auto const stats = loop->stats();
+    expect(stats.in_flight == 0 && stats.started == 200 && stats.completed == 200, "Loop counters are wrong");
+
+    memuc.set_event_loop(nullptr);
+    ::unsetenv("MEMUC_STUB_LATENCY_MS");
+}
+
+auto test_timeout_and_cancel(Memuc& memuc) -> void
+{
+    ::setenv("MEMUC_STUB_LATENCY_MS", "5000", 1);
+
+    auto const start = std::chrono::steady_clock::now();
+
+    auto slow = memuc.start_app_async("com.example.app", std::chrono::milliseconds(100));
+    auto cancelled = memuc.reboot_async();
+    cancelled.cancel();
+
+    expect_error(slow, "MEmuc command timed out");
+    expect_error(cancelled, "MEmuc command is cancelled");
+    expect(std::chrono::steady_clock::now() - start < std::chrono::seconds(3), "Commands were not killed");
+
+    ::unsetenv("MEMUC_STUB_LATENCY_MS");
+}
+
+auto click_and_capture(Memuc& memuc, std::promise<uint32_t>& done) -> Task
+{
+    try
+    {
+        co_await memuc.trigger_click_async({10, 20});
+        auto const frame = co_await memuc.capture_async();
+        done.set_value(frame.width);
+    }
+    catch (...)
+    {
+        done.set_exception(std::current_exception());
+    }
+}
+
+auto test_coroutine(Memuc& memuc) -> void
+{
+    std::promise<uint32_t> done;
+    auto future = done.get_future();
+
+    click_and_capture(memuc, done);
+    expect(future.get() == 720, "Coroutine did not complete");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: async_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        ::setenv("MEMUC_STUB_STILL", "1", 1);
+
+        Memuc memuc(0, VMConfig::Default());
+
+        test_results(memuc);
+        test_in_flight(memuc);
+        test_timeout_and_cancel(memuc);
+        test_coroutine(memuc);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <cstdlib>
+#include <thread>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto wait_frame(Memuc& memuc) -> CapturedFrame
+{
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        if (auto frame = memuc.latest_frame())
+        {
+            return *frame;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    throw std::runtime_error("Capture thread does not publish frames");
+}
+
+auto test_latest_frame() -> void
+{
+    Memuc memuc(0, VMConfig::Default());
+    expect(memuc.capture_stats().captured == 0, "Stats without capture are not empty");
+
+    memuc.start_capture(CaptureOptions{.target_fps = 200.0, .max_unconsumed = 2});
+
+    auto first = wait_frame(memuc);
+    expect(first.frame.width == 64 && first.frame.height == 32, "Captured frame has wrong size");
+
+    uint64_t previous = first.sequence;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        auto frame = wait_frame(memuc);
+        expect(frame.sequence >= previous, "Sequence goes backwards");
+        expect(frame.timestamp >= first.timestamp, "Timestamp goes backwards");
+        previous = frame.sequence;
+    }
+    expect(previous > first.sequence, "No new frames are published");
+
+    // The frame taken earlier stays valid while the thread captures new ones
+    expect(first.frame.data.size() >= first.frame.stride * first.frame.height && first.frame.data[3] == 255,
+           "Taken frame is invalidated");
+
+    auto stats = memuc.capture_stats();
+    expect(stats.captured >= stats.consumed && stats.consumed > 0 && stats.failures == 0, "Stats are wrong");
+
+    memuc.stop_capture();
+    bool thrown = false;
+    try
+    {
+        memuc.latest_frame();
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "Stopped capture still returns frames");
+}
+
+auto test_backpressure() -> void
+{
+    Memuc memuc(0, VMConfig::Default());
+    memuc.start_capture(CaptureOptions{.target_fps = 0.0, .max_unconsumed = 2});
+
+    // Nobody takes frames, so the thread stops after two of them
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto stats = memuc.capture_stats();
+    expect(stats.captured == 2 && stats.dropped == 1, "Back-pressure does not stop the capture");
+
+    wait_frame(memuc);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    expect(memuc.capture_stats().captured == 4, "Capture does not resume after the frame is taken");
+}
+
+auto test_target_fps() -> void
+{
+    Memuc memuc(0, VMConfig::Default());
+    memuc.start_capture(CaptureOptions{.target_fps = 10.0, .max_unconsumed = 0});
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    auto const captured = memuc.capture_stats().captured;
+    expect(captured >= 5 && captured <= 12, "Target FPS is not respected");
+}
+
+auto test_move() -> void
+{
+    Memuc memuc(0, VMConfig::Default());
+    memuc.start_capture(CaptureOptions{.target_fps = 100.0, .max_unconsumed = 0});
+    wait_frame(memuc);
+
+    // The capture thread follows the moved instance and stops with it
+    Memuc other(std::move(memuc));
+    auto const sequence = wait_frame(other).sequence;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    expect(wait_frame(other).sequence > sequence, "Moved capture does not continue");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: capture_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        ::setenv("MEMUC_STUB_SIZE", "64x32", 1);
+
+        test_latest_frame();
+        test_backpressure();
+        test_target_fps();
+        test_move();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include "pixel.hpp"
+#include <algorithm>
+#include <random>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto test_hash_kernels(std::mt19937& random) -> void
+{
+    std::vector<uint8_t> data(1024);
+    std::ranges::generate(data, [&]() { return static_cast<uint8_t>(random()); });
+
+    for (size_t const size : {0, 1, 7, 31, 32, 33, 64, 100, 128, 129, 1000})
+    {
+        auto const row = std::span<uint8_t const>(data).subspan(3, size);
+
+        auto expected = internal::hash_begin();
+        internal::hash_row(row, expected, internal::SimdLevel::Scalar);
+        internal::hash_row(row, expected, internal::SimdLevel::Scalar);
+
+        for (uint32_t level = 1; level <= static_cast<uint32_t>(internal::simd_level()); ++level)
+        {
+            auto lanes = internal::hash_begin();
+            internal::hash_row(row, lanes, static_cast<internal::SimdLevel>(level));
+            internal::hash_row(row, lanes, static_cast<internal::SimdLevel>(level));
+
+            expect(lanes == expected, std::format("Hash of {} bytes differs (level {})", size, level));
+        }
+    }
+
+    // Swapped rows give the different hash
+    std::array<uint8_t, 64> first{};
+    std::array<uint8_t, 64> second{};
+    second[5] = 1;
+
+    auto forward = internal::hash_begin();
+    internal::hash_row(first, forward, internal::simd_level());
+    internal::hash_row(second, forward, internal::simd_level());
+
+    auto backward = internal::hash_begin();
+    internal::hash_row(second, backward, internal::simd_level());
+    internal::hash_row(first, backward, internal::simd_level());
+
+    expect(internal::hash_end(forward) != internal::hash_end(backward), "Hash does not depend on the row order");
+
+    // Swapped blocks of the row give the different hash with every kernel
+    std::array<uint8_t, 128> blocks{};
+    std::ranges::generate(blocks, [&]() { return static_cast<uint8_t>(random()); });
+    auto swapped = blocks;
+    std::swap_ranges(swapped.begin(), swapped.begin() + 32, swapped.begin() + 64);
+    for (uint32_t level = 0; level <= static_cast<uint32_t>(internal::simd_level()); ++level)
+    {
+        auto original_lanes = internal::hash_begin();
+        internal::hash_row(blocks, original_lanes, static_cast<internal::SimdLevel>(level));
+        auto swapped_lanes = internal::hash_begin();
+        internal::hash_row(swapped, swapped_lanes, static_cast<internal::SimdLevel>(level));
+        expect(internal::hash_end(original_lanes) != internal::hash_end(swapped_lanes),
+               std::format("Hash does not depend on the block order (level {})", level));
+    }
+}
+
+auto test_differ(std::mt19937& random) -> void
+{
+    // 100x70 frame is 4x3 tiles of 32 pixels, the last column and row are cropped
+    uint32_t const width = 100;
+    uint32_t const height = 70;
+    std::vector<uint8_t> pixels(width * height * 4);
+    std::ranges::generate(pixels, [&]() { return static_cast<uint8_t>(random()); });
+
+    Frame const frame{.data = pixels, .width = width, .height = height, .stride = width * 4,
+                      .format = PixelFormat::RGBA8888};
+    auto set_pixel = [&](uint32_t const x, uint32_t const y) { ++pixels[(y * width + x) * 4 + 1]; };
+
+    FrameDiffer differ;
+
+    auto diff = differ.update(frame);
+    expect(diff.changed && diff.tiles == 12 && diff.changed_tiles == 12, "First frame is not changed entirely");
+    expect(diff.regions == std::vector<Rect>{{0, 0, 100, 70}}, "First frame region is wrong");
+
+    diff = differ.update(frame);
+    expect(!diff.changed && diff.regions.empty() && differ.hashes().size() == 12, "Same frame is changed");
+
+    set_pixel(40, 40);
+    diff = differ.update(frame);
+    expect(diff.changed_tiles == 1 && diff.regions == std::vector<Rect>{{32, 32, 32, 32}}, "Changed tile is wrong");
+    expect(diff.changed_in({60, 60, 10, 10}) && !diff.changed_in({0, 0, 32, 70}), "Region lookup is wrong");
+
+    // The sprite moved by 8 pixels within the row of the tile (one 32 byte block swapped with the next)
+    std::swap_ranges(pixels.begin() + (40 * width + 32) * 4, pixels.begin() + (40 * width + 40) * 4,
+                     pixels.begin() + (40 * width + 40) * 4);
+    diff = differ.update(frame);
+    expect(diff.changed_tiles == 1 && diff.regions == std::vector<Rect>{{32, 32, 32, 32}},
+           "Moved block is not changed");
+
+    // Adjacent tiles are merged, the edge tiles are cropped to the frame
+    set_pixel(70, 10);
+    set_pixel(99, 10);
+    set_pixel(64, 32);
+    set_pixel(98, 63);
+    set_pixel(70, 69);
+    set_pixel(99, 69);
+    set_pixel(0, 69);
+    diff = differ.update(frame);
+    expect(diff.changed_tiles == 7, "Changed tile count is wrong");
+    expect(diff.regions == std::vector<Rect>{{64, 0, 36, 70}, {0, 64, 32, 6}}, "Merged regions are wrong");
+
+    // Only the changed pixels are compared, so the padding of the stride is ignored
+    std::vector<uint8_t> padded(width * 4 * height + 64 * height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        std::ranges::copy(frame.row(y), padded.begin() + y * (width * 4 + 64));
+        padded[y * (width * 4 + 64) + width * 4] = static_cast<uint8_t>(y);
+    }
+    diff = differ.update(Frame{.data = padded, .width = width, .height = height, .stride = width * 4 + 64,
+                               .format = PixelFormat::RGBA8888});
+    expect(!diff.changed, "Stride padding is compared");
+
+    diff = differ.update(Frame{.data = pixels, .width = 50, .height = 70, .stride = width * 4,
+                               .format = PixelFormat::RGBA8888});
+    expect(diff.changed_tiles == 6 && diff.regions == std::vector<Rect>{{0, 0, 50, 70}}, "Resized frame is wrong");
+
+    differ.reset();
+    expect(differ.update(frame).changed_tiles == 12, "Reset differ does not change the frame entirely");
+}
+
+auto main() -> int32_t
+{
+    std::mt19937 random(42);
+
+    try
+    {
+        test_hash_kernels(random);
+        test_differ(random);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
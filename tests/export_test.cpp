@@ -0,0 +1,186 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+std::string const name = "memucpp_export_test";
+
+// Frame of the size whose every byte is the value
+auto filled_frame(std::vector<uint8_t>& pixels, uint32_t const width, uint32_t const height, uint8_t const value)
+    -> Frame
+{
+    pixels.assign(static_cast<size_t>(width) * height * 4, value);
+    return Frame{.data = pixels,
+                 .width = width,
+                 .height = height,
+                 .stride = width * 4,
+                 .format = PixelFormat::RGBA8888,
+                 .buffer = FrameBuffer()};
+}
+
+auto uniform(Frame const& frame, uint8_t const value) -> bool
+{
+    return std::ranges::all_of(frame.data, [value](uint8_t const pixel) { return pixel == value; });
+}
+
+auto test_ring() -> void
+{
+    FrameExporter exporter(name, 64 * 64 * 4, FrameExportOptions{.slots = 3});
+    FrameReader reader(name);
+    expect(!reader.latest() && !reader.next(), "Empty ring returns the frame");
+
+    std::vector<uint8_t> pixels;
+    expect(exporter.publish(filled_frame(pixels, 64, 32, 1)) == 0, "Sequence of the first frame is wrong");
+
+    auto const first = reader.next();
+    expect(first && first->sequence == 0 && first->frame.width == 64 && first->frame.height == 32 &&
+               first->frame.format == PixelFormat::RGBA8888 && uniform(first->frame, 1),
+           "Published frame is wrong");
+    expect(!reader.next(), "Frame is returned twice");
+
+    // The slow reader keeps the first frame while the writer laps the ring
+    for (uint8_t value = 2; value <= 6; ++value)
+    {
+        exporter.publish(filled_frame(pixels, 64, 64, value));
+    }
+    expect(!reader.valid(*first), "Reused slot is not detected");
+
+    auto const oldest = reader.next();
+    expect(oldest && oldest->sequence == 3 && uniform(oldest->frame, 4), "Oldest kept frame is wrong");
+    expect(reader.dropped() == 2, std::format("Dropped frames are not counted ({})", reader.dropped()));
+
+    auto const latest = reader.latest();
+    expect(latest && latest->sequence == 5 && uniform(latest->frame, 6) && reader.valid(*latest),
+           "Latest frame is wrong");
+
+    bool thrown = false;
+    try
+    {
+        exporter.publish(filled_frame(pixels, 128, 64, 7));
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "Frame larger than the slot is published");
+}
+
+auto test_concurrent() -> void
+{
+    FrameExporter exporter(name, 64 * 64 * 4, FrameExportOptions{.slots = 8});
+    FrameReader reader(name);
+
+    // The reader never waits for the writer, the frames it validates are never torn (how many it gets
+    // depends on the scheduling, so only the frames left after the writer are counted on)
+    std::atomic<bool> done = false;
+    std::thread writer([&] {
+        std::vector<uint8_t> pixels;
+        for (uint32_t i = 0; i < 2000; ++i)
+        {
+            exporter.publish(filled_frame(pixels, 64, 64, static_cast<uint8_t>(i)));
+        }
+        done = true;
+    });
+
+    uint64_t received = 0;
+    std::optional<uint64_t> previous;
+    auto const receive = [&] {
+        auto const frame = reader.next();
+        if (!frame)
+        {
+            return false;
+        }
+
+        uint8_t const first = frame->frame.data.front();
+        bool const same = uniform(frame->frame, first);
+        if (reader.valid(*frame))
+        {
+            expect(same && first == static_cast<uint8_t>(frame->sequence), "Torn frame is valid");
+            ++received;
+        }
+        expect(!previous || frame->sequence > *previous, "Frames are not ordered");
+        previous = frame->sequence;
+        return true;
+    };
+
+    while (!done)
+    {
+        receive();
+    }
+    writer.join();
+    while (receive())
+    {
+    }
+
+    auto const latest = reader.latest();
+    expect(latest && latest->sequence == 1999 && uniform(latest->frame, static_cast<uint8_t>(1999)),
+           "Last frame is not readable");
+    expect(previous == 1999, "Frames left in the ring are not received");
+    expect(received + reader.dropped() <= 2000, "Frames are counted twice");
+}
+
+auto test_memuc() -> void
+{
+    Memuc memuc(0, VMConfig::Default());
+    memuc.start_frame_export();
+
+    FrameReader reader(FrameExporter::vm_name(0));
+    auto const captured = memuc.capture();
+
+    auto const frame = reader.next();
+    expect(frame && frame->frame.width == 720 && frame->frame.height == 1280 &&
+               std::ranges::equal(frame->frame.data, captured.data),
+           "Exported capture is wrong");
+
+    memuc.stop_frame_export();
+    memuc.capture();
+    expect(!reader.next(), "Capture is exported after the stop");
+
+    bool thrown = false;
+    try
+    {
+        FrameReader removed(FrameExporter::vm_name(0));
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "Name of the stopped export is not removed");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: export_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        test_ring();
+        test_concurrent();
+        test_memuc();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp/fleet.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto test_order() -> void
+{
+    std::vector<uint16_t> const vm_indices{0, 1, 2, 3, 4, 5, 6, 7};
+    Fleet fleet(vm_indices, VMConfig::Default(), FleetOptions{.threads = 4});
+
+    // Commands of one VM never overlap, so the per-VM state needs no lock
+    std::vector<std::vector<uint32_t>> sequences(vm_indices.size());
+    std::vector<std::atomic<uint32_t>> active(vm_indices.size());
+    std::atomic<bool> overlapped = false;
+
+    for (uint32_t i = 0; i < 50; ++i)
+    {
+        for (uint16_t const vm_index : vm_indices)
+        {
+            fleet.submit(vm_index, [&, vm_index, i](Memuc&) {
+                overlapped = overlapped || active[vm_index].fetch_add(1) != 0;
+                sequences[vm_index].push_back(i);
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                active[vm_index].fetch_sub(1);
+            });
+        }
+    }
+    fleet.wait();
+
+    expect(!overlapped, "Commands of one VM overlap");
+    for (auto const& sequence : sequences)
+    {
+        expect(sequence.size() == 50 && std::ranges::is_sorted(sequence), "Commands of the VM are out of order");
+    }
+
+    auto const stats = fleet.stats();
+    expect(stats.machines == 8 && stats.threads == 4 && stats.queued == 0 && stats.running == 0,
+           "Fleet stats are wrong");
+    expect(stats.completed == stats.submitted && stats.completed == 8 + 400 && stats.failed == 0,
+           "Fleet counters are wrong");
+    expect(stats.throughput > 0, "Fleet throughput is not measured");
+}
+
+auto test_parallel() -> void
+{
+    std::vector<uint16_t> const vm_indices{0, 1, 2, 3, 4, 5, 6, 7};
+    Fleet fleet(vm_indices, VMConfig::Default(), FleetOptions{.threads = 8});
+
+    // 8 VMs run in parallel, the commands of one VM run in sequence
+    auto const start = std::chrono::steady_clock::now();
+    auto futures = fleet.broadcast([](Memuc&) { std::this_thread::sleep_for(std::chrono::milliseconds(200)); });
+    for (auto& future : futures)
+    {
+        future.get();
+    }
+    auto const parallel = std::chrono::steady_clock::now() - start;
+    expect(parallel < std::chrono::milliseconds(1000), "VMs do not run in parallel");
+
+    auto const serial_start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        fleet.submit(3, [](Memuc&) { std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+    }
+    fleet.wait();
+    expect(std::chrono::steady_clock::now() - serial_start >= std::chrono::milliseconds(200),
+           "Commands of one VM run in parallel");
+}
+
+auto test_commands() -> void
+{
+    std::vector<uint16_t> const vm_indices{3, 5};
+    Fleet fleet(vm_indices, VMConfig::Default(), FleetOptions{.threads = 2});
+
+    auto frames = fleet.capture();
+    expect(frames.size() == 2, "Capture is not broadcast");
+    for (auto& future : frames)
+    {
+        auto const frame = future.get();
+        expect(frame.width == 64 && frame.height == 32, "Captured frame is wrong");
+    }
+
+    for (auto& future : fleet.start_app("com.example"))
+    {
+        future.get();
+    }
+
+    auto value = fleet.submit(5, [](Memuc&) { return 42; });
+    expect(value.get() == 42, "Command result is lost");
+
+    // The thrown exception goes to the future and the next command still runs
+    auto failure = fleet.submit(3, [](Memuc&) -> int32_t { throw error("Command failed"); });
+    auto next = fleet.submit(3, [](Memuc&) { return true; });
+
+    bool thrown = false;
+    try
+    {
+        failure.get();
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown && next.get(), "Command exception is lost");
+    expect(fleet.stats().failed == 1, "Failed command is not counted");
+
+    // The blocked VM keeps its queue, the other VM is not blocked
+    std::promise<void> started;
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    fleet.submit(3, [&started, released](Memuc&) {
+        started.set_value();
+        released.wait();
+    });
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        fleet.submit(3, [](Memuc&) {});
+    }
+    started.get_future().wait();
+
+    expect(fleet.submit(5, [](Memuc&) { return 1; }).get() == 1, "Blocked VM blocks the other VM");
+    expect(fleet.queue_depth(3) == 3 && fleet.queue_depth(5) == 0, "Queue depth is wrong");
+
+    release.set_value();
+    fleet.wait();
+    expect(fleet.queue_depth(3) == 0, "Queue is not drained");
+
+    thrown = false;
+    try
+    {
+        fleet.submit(7, [](Memuc&) {});
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "Command of the unknown VM is accepted");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: fleet_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        ::setenv("MEMUC_STUB_SIZE", "64x32", 1);
+
+        test_order();
+        test_parallel();
+        test_commands();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto test_encoders() -> void
+{
+    // 3x2 RGBA frame cropped out of a 4 pixels wide buffer
+    std::vector<uint8_t> const pixels{255, 0,   0,  255, 0,   255, 0,   255, 0,  0,  255, 255, 9, 9, 9, 9,
+                                      255, 255, 255, 255, 0,  0,   0,   255, 10, 20, 30,  255, 9, 9, 9, 9};
+    Frame const frame{.data = pixels, .width = 3, .height = 2, .stride = 16, .format = PixelFormat::RGBA8888};
+
+    std::vector<uint8_t> output;
+
+    auto bitmap = encode_bmp(frame, output);
+    expect(bitmap.size() == 54 + 12 * 2 && bitmap[0] == 'B' && bitmap[1] == 'M', "Bitmap header is wrong");
+
+    uint32_t value;
+    std::memcpy(&value, bitmap.data() + 2, sizeof(uint32_t));
+    expect(value == bitmap.size(), "Bitmap file size is wrong");
+    std::memcpy(&value, bitmap.data() + 18, sizeof(uint32_t));
+    expect(value == 3, "Bitmap width is wrong");
+
+    // The bottom row comes first, BGR with 3 bytes of padding
+    std::vector<uint8_t> const expected_bitmap{255, 255, 255, 0, 0, 0, 30, 20,  10, 0, 0, 0,
+                                               0,   0,   255, 0, 255, 0, 255, 0, 0, 0, 0, 0};
+    expect(std::ranges::equal(bitmap.subspan(54), expected_bitmap), "Bitmap pixels are wrong");
+
+    auto bgr = encode_bgr(frame, output);
+    std::vector<uint8_t> const expected_bgr{0, 0, 255, 0, 255, 0, 255, 0, 0, 255, 255, 255, 0, 0, 0, 30, 20, 10};
+    expect(bgr.format == PixelFormat::BGR888 && bgr.stride == 9 && std::ranges::equal(bgr.data, expected_bgr),
+           "BGR pixels are wrong");
+
+    auto gray = encode_grayscale(frame, output);
+    std::vector<uint8_t> const expected_gray{77, 149, 29, 255, 0, 18};
+    expect(gray.format == PixelFormat::Gray8 && std::ranges::equal(gray.data, expected_gray),
+           "Grayscale pixels are wrong");
+
+    auto small = downscale(frame, 2, output);
+    expect(small.width == 1 && small.height == 1, "Downscaled size is wrong");
+    expect(small.data[0] == 128 && small.data[1] == 128 && small.data[2] == 64 && small.data[3] == 255,
+           "Downscaled pixels are wrong");
+}
+
+#ifndef _WIN32
+auto test_capture() -> void
+{
+    auto const script_path = std::filesystem::temp_directory_path() / "memucpp_frame_test.sh";
+    {
+        std::ofstream fs(script_path);
+        fs << "#!/bin/sh\n"
+              "case \"$*\" in\n"
+              "  *screencap*)\n"
+              "    printf 'already connected to 127.0.0.1:21503\\r\\n\\r\\n'\n"
+              "    printf '\\002\\000\\000\\000\\002\\000\\000\\000\\001\\000\\000\\000'\n"
+              "    [ -n \"$MEMUCPP_DATASPACE\" ] && printf '\\000\\000\\000\\000'\n"
+              "    printf '\\001\\002\\003\\377\\004\\005\\006\\377\\007\\010\\011\\377\\012\\013\\014\\377'\n"
+              "    ;;\n"
+              "  *) echo SUCCESS ;;\n"
+              "esac\n";
+    }
+    std::filesystem::permissions(script_path, std::filesystem::perms::owner_all);
+
+    memuc_path = script_path;
+    Memuc memuc(0, VMConfig::Default());
+
+    for (bool const dataspace : {false, true})
+    {
+        if (dataspace)
+        {
+            ::setenv("MEMUCPP_DATASPACE", "1", 1);
+        }
+
+        auto frame = memuc.capture();
+        expect(frame.width == 2 && frame.height == 2 && frame.stride == 8 && frame.format == PixelFormat::RGBA8888,
+               "Captured frame size is wrong");
+        expect(frame.data.size() == 16 && frame.data[0] == 1 && frame.data[15] == 255,
+               "Captured frame pixels are wrong");
+
+        // Frames stay valid while the next ones are captured
+        auto next = memuc.capture();
+        expect(frame.data.data() != next.data.data() && frame.data[0] == 1, "Captured frame is overwritten");
+
+        auto bitmap = memuc.screen_cap();
+        expect(bitmap.size() == 54 + 8 * 2 && bitmap[54] == 9 && bitmap[55] == 8 && bitmap[56] == 7,
+               "Screen capture bitmap is wrong");
+    }
+
+    ::unsetenv("MEMUCPP_DATASPACE");
+    std::filesystem::remove(script_path);
+}
+#endif
+
+auto main() -> int32_t
+{
+    try
+    {
+        test_encoders();
+#ifndef _WIN32
+        test_capture();
+#endif
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,309 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+std::filesystem::path const directory = std::filesystem::temp_directory_path() / "memucpp_gesture_test";
+
+auto write_file(std::filesystem::path const& path, std::string_view const data) -> void
+{
+    std::ofstream stream(path, std::ios::trunc);
+    stream << data;
+}
+
+struct InputEvent
+{
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+};
+
+/*!
+    \brief Reads the events written into the touch screen (a plain file stands in for the device)
+*/
+auto read_events(TouchDevice const& device) -> std::vector<InputEvent>
+{
+    std::ifstream stream(device.path, std::ios::binary);
+    std::string const data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    expect(data.size() % device.event_size == 0, "Events are truncated");
+
+    std::vector<InputEvent> out;
+    for (size_t offset = 0; offset < data.size(); offset += device.event_size)
+    {
+        InputEvent event;
+        std::memcpy(&event, data.data() + offset + device.event_size - 8, sizeof(event));
+        out.push_back(event);
+    }
+    return out;
+}
+
+auto count_events(std::vector<InputEvent> const& events, uint16_t const type, uint16_t const code) -> size_t
+{
+    return std::ranges::count_if(events, [&](auto const& event) { return event.type == type && event.code == code; });
+}
+
+/*!
+    \brief Runs the compiled gesture by the host shell
+    \return time of the command
+*/
+auto play(CompiledGesture const& gesture) -> std::chrono::milliseconds
+{
+    write_file(directory / "gesture.sh", gesture.command);
+
+    auto const start = std::chrono::steady_clock::now();
+    expect(std::system(std::format("sh '{}'", (directory / "gesture.sh").string()).c_str()) == 0,
+           "Gesture command failed");
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+}
+
+/*!
+    \brief Returns the times of the waits of the compiled command (milliseconds since its start)
+*/
+auto wait_times(CompiledGesture const& gesture) -> std::vector<int64_t>
+{
+    std::vector<int64_t> out;
+    std::string_view const call = "__wait ";
+    for (size_t position = gesture.command.find(call); position != std::string::npos;
+         position = gesture.command.find(call, position + call.size()))
+    {
+        auto const end = gesture.command.find(';', position);
+        out.push_back(std::stoll(gesture.command.substr(position + call.size(), end - position - call.size())));
+    }
+    return out;
+}
+
+auto test_timing() -> void
+{
+    TouchDevice const device{.path = (directory / "event5").string(),
+                             .max_x = 719,
+                             .max_y = 1279,
+                             .screen_width = 720,
+                             .screen_height = 1280,
+                             .slots = 10,
+                             .event_size = 24};
+
+    // A report every 10 ms, the launches of the commands must not add to the duration
+    GestureScript script;
+    script.swipe({{0, 0}, {700, 1200}}, std::chrono::milliseconds(1000)).wait(std::chrono::milliseconds(50));
+    auto const gesture = script.compile(device);
+
+    // The start is taken once and every wait is the time since it, so the schedule cannot drift
+    auto const waits = wait_times(gesture);
+    expect(gesture.command.starts_with("{ read __t __ </proc/uptime; __start=") &&
+               gesture.command.find("__start=", 1) == gesture.command.rfind("__start="),
+           "Start of the gesture is not taken once");
+    expect(waits.size() > 90 && std::ranges::adjacent_find(waits, std::greater_equal<>()) == waits.end() &&
+               waits.back() == script.duration().count() && gesture.duration == script.duration(),
+           "Waits of the gesture do not add up to its duration");
+
+    // The waits are never early (the loaded host may make them late, that is not checked)
+    auto const elapsed = play(gesture);
+    expect(elapsed >= std::chrono::milliseconds(1050), std::format("Gesture ends early ({} ms)", elapsed.count()));
+}
+
+auto test_protocol_b() -> void
+{
+    // Axes have the double resolution of the screen
+    TouchDevice const device{.path = (directory / "event2").string(),
+                             .max_x = 1439,
+                             .max_y = 2559,
+                             .screen_width = 720,
+                             .screen_height = 1280,
+                             .slots = 10,
+                             .event_size = 24};
+
+    GestureScript script;
+    script.tap({100, 200})
+        .wait(std::chrono::milliseconds(100))
+        .swipe({{0, 0}, {100, 0}, {100, 100}}, std::chrono::milliseconds(200))
+        .touch({TouchStroke{.path = {{300, 600}, {100, 400}},
+                            .start = std::chrono::milliseconds(0),
+                            .duration = std::chrono::milliseconds(100)},
+                TouchStroke{.path = {{400, 700}, {600, 900}},
+                            .start = std::chrono::milliseconds(20),
+                            .duration = std::chrono::milliseconds(100)}});
+    expect(script.duration() == std::chrono::milliseconds(460), "Duration of the script is wrong");
+
+    auto const gesture = script.compile(device);
+    auto const elapsed = play(gesture);
+    expect(elapsed >= std::chrono::milliseconds(460), std::format("Gesture is played too fast ({} ms)", elapsed.count()));
+
+    auto const events = read_events(device);
+    expect(count_events(events, 0, 0) == gesture.reports, "Number of the reports is wrong");
+
+    // Press of the tap: slot, tracking id, position, touch key, report
+    expect(events.size() > 6 && events[0].code == 0x2f && events[0].value == 0 && events[1].code == 0x39 &&
+               events[1].value == 1 && events[2].code == 0x35 && events[2].value == 200 && events[3].code == 0x36 &&
+               events[3].value == 400 && events[4].type == 1 && events[4].code == 0x14a && events[4].value == 1 &&
+               events[5].type == 0,
+           "Press of the tap is wrong");
+
+    // The swipe passes the corner of its path at the half of its time
+    bool corner = false;
+    for (size_t i = 1; i < events.size(); ++i)
+    {
+        corner = corner || (events[i - 1].code == 0x35 && events[i - 1].value == 200 && events[i].code == 0x36 &&
+                            events[i].value == 0);
+    }
+    expect(corner, "Swipe does not follow its path");
+
+    // Both fingers of the last step are pressed at once
+    auto const pressed = std::ranges::find_if(events, [](auto const& event) {
+        return event.code == 0x39 && event.value == 3;
+    });
+    auto const second = std::ranges::find_if(events, [](auto const& event) {
+        return event.code == 0x2f && event.value == 1;
+    });
+    auto const released = std::find_if(pressed, events.end(), [](auto const& event) {
+        return event.code == 0x39 && event.value == -1;
+    });
+    expect(pressed < second && second < released, "Fingers are not pressed at once");
+    expect(count_events(events, 3, 0x39) == 8, "Tracking of the touches is wrong");
+    auto const& key = events[events.size() - 2];
+    expect(events.back().type == 0 && key.code == 0x14a && key.value == 0, "Touch is not released at the end");
+
+    bool thrown = false;
+    try
+    {
+        script.compile(TouchDevice{device.path, device.max_x, device.max_y, 720, 1280, 1, 24});
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "Touches above the slots of the device are compiled");
+}
+
+auto test_protocol_a() -> void
+{
+    TouchDevice const device{.path = (directory / "event3").string(),
+                             .max_x = 719,
+                             .max_y = 1279,
+                             .screen_width = 720,
+                             .screen_height = 1280,
+                             .slots = 0,
+                             .event_size = 16};
+
+    GestureScript script(GestureOptions{.move_interval = std::chrono::milliseconds(50),
+                                        .tap_duration = std::chrono::milliseconds(20)});
+    script.tap({10, 20}).hold({30, 40}, std::chrono::milliseconds(60));
+
+    auto const gesture = script.compile(device);
+    play(gesture);
+
+    // Every report lists the pressed contacts, the release sends the empty one
+    auto const events = read_events(device);
+    expect(gesture.reports == 4 && count_events(events, 0, 0) == 4 && count_events(events, 0, 2) == 4,
+           "Reports of the protocol A are wrong");
+    expect(count_events(events, 3, 0x2f) == 0 && count_events(events, 3, 0x39) == 0,
+           "Protocol A uses the slots");
+}
+
+auto test_memuc() -> void
+{
+    std::filesystem::create_directories(directory / "bin");
+    write_file(directory / "bin" / "getprop", "#!/bin/sh\necho x86_64\n");
+    write_file(directory / "bin" / "getevent",
+               std::format("#!/bin/sh\n"
+                           "cat <<EOF\n"
+                           "add device 1: /dev/input/event1\n"
+                           "  name:     \"Power Button\"\n"
+                           "  events:\n"
+                           "    KEY (0001): 0074\n"
+                           "add device 2: {}\n"
+                           "  name:     \"Microvirt Virtual Input\"\n"
+                           "  events:\n"
+                           "    KEY (0001): 014a\n"
+                           "    ABS (0003): 002f  : value 0, min 0, max 9, fuzz 0, flat 0, resolution 0\n"
+                           "                0035  : value 0, min 0, max 1439, fuzz 0, flat 0, resolution 0\n"
+                           "                0036  : value 0, min 0, max 2559, fuzz 0, flat 0, resolution 0\n"
+                           "                0039  : value 0, min 0, max 65535, fuzz 0, flat 0, resolution 0\n"
+                           "  input props:\n"
+                           "    INPUT_PROP_DIRECT\n"
+                           "EOF\n",
+                           (directory / "event4").string()));
+    for (auto const* name : {"getprop", "getevent"})
+    {
+        std::filesystem::permissions(directory / "bin" / name, std::filesystem::perms::owner_all);
+    }
+    auto const path = std::getenv("PATH");
+    ::setenv("PATH", std::format("{}:{}", (directory / "bin").string(), path ? path : "").c_str(), 1);
+
+    Memuc memuc(0, VMConfig::Default());
+    memuc.enable_shell_session(true);
+
+    auto const& device = memuc.touch_device();
+    expect(device.path == (directory / "event4").string() && device.max_x == 1439 && device.max_y == 2559 &&
+               device.slots == 10 && device.event_size == 24 && device.screen_width == 720,
+           "Touch screen is parsed wrong");
+
+    // The combo of taps is one shell command
+    GestureScript script;
+    for (uint32_t i = 0; i < 20; ++i)
+    {
+        script.tap({i * 10, i * 20});
+    }
+    memuc.play_gesture(script);
+    expect(count_events(read_events(device), 1, 0x14a) == 40, "Gesture is not played on the VM");
+
+    // The compiled gesture is reused without compiling it again
+    auto const compiled = GestureScript().tap({5, 5}).compile(device);
+    memuc.play_gesture(compiled);
+    expect(count_events(read_events(device), 0, 0) == 2, "Compiled gesture is not played on the VM");
+
+    auto other = compiled;
+    other.device.max_x = 719;
+    bool thrown = false;
+    try
+    {
+        memuc.play_gesture(other);
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "Gesture of the other touch screen is played");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: gesture_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+
+        test_protocol_b();
+        test_protocol_a();
+        test_timing();
+        test_memuc();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
@@ -2,24 +2,26 @@
 
 #include "memucpp.hpp"
 #include <fstream>
-#include <thread>
 
 using namespace memucpp;
 
-auto main(uint32_t argc, char** argv) -> int32_t
+auto main(int32_t argc, char** argv) -> int32_t
 {
-    memucpp::memuc_path = "D:/Program Files/Microvirt/MEmu/memuc.exe";
-    Memuc memuc(0, VMConfig::Default());
+    memucpp::memuc_path = argc > 1 ? argv[1] : "D:/Program Files/Microvirt/MEmu/memuc.exe";
+    Memuc memuc(0, VMConfig::Default(), ProvisionOptions::Default());
 
     for (auto const& vm : memuc.list_vms())
     {
         std::cout << std::format("VM: {} {} {}", vm.index, vm.name, vm.enabled) << std::endl;
     }
 
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-
+    auto const start = std::chrono::steady_clock::now();
     auto buffer = memuc.screen_cap();
+    auto const elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    std::cout << std::format("Screen capture: {} bytes in {} us", buffer.size(), elapsed.count()) << std::endl;
 
     std::basic_ofstream<uint8_t> fs("test.bmp", std::ios::binary);
     fs.write(buffer.data(), buffer.size());
-}
\ No newline at end of file
+}
@@ -0,0 +1,134 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include "pixel.hpp"
+#include <cmath>
+#include <random>
+
+using namespace memucpp;
+
+// Exhaustive per-byte NCC over the full frame, the way the matching is written without the library
+auto find_reference(Frame const& frame, Frame const& pattern) -> Match
+{
+    double const samples = 3.0 * pattern.width * pattern.height;
+    double pattern_sum = 0;
+    double pattern_squares = 0;
+    for (uint32_t j = 0; j < pattern.height; ++j)
+    {
+        for (uint32_t i = 0; i < pattern.width * 4; ++i)
+        {
+            if (i % 4 != 3)
+            {
+                pattern_sum += pattern.row(j)[i];
+                pattern_squares += pattern.row(j)[i] * pattern.row(j)[i];
+            }
+        }
+    }
+
+    Match best{.rect = {0, 0, pattern.width, pattern.height}, .score = -1.0};
+    for (uint32_t y = 0; y + pattern.height <= frame.height; ++y)
+    {
+        for (uint32_t x = 0; x + pattern.width <= frame.width; ++x)
+        {
+            double sum = 0;
+            double squares = 0;
+            double products = 0;
+            for (uint32_t j = 0; j < pattern.height; ++j)
+            {
+                auto const row = frame.row(y + j).subspan(x * 4);
+                auto const expected = pattern.row(j);
+                for (uint32_t i = 0; i < pattern.width * 4; ++i)
+                {
+                    if (i % 4 != 3)
+                    {
+                        sum += row[i];
+                        squares += row[i] * row[i];
+                        products += row[i] * expected[i];
+                    }
+                }
+            }
+
+            double const score = (products - sum * pattern_sum / samples) /
+                                 std::sqrt((squares - sum * sum / samples) *
+                                           (pattern_squares - pattern_sum * pattern_sum / samples));
+            if (score > best.score)
+            {
+                best = Match{.rect = {x, y, pattern.width, pattern.height}, .score = score};
+            }
+        }
+    }
+    return best;
+}
+
+template <typename Function>
+auto measure(std::string_view const name, uint32_t const iterations, Function&& function) -> void
+{
+    std::optional<Match> match;
+
+    auto const start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        match = function();
+    }
+    auto const elapsed =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start) / iterations;
+
+    std::cout << std::format("{}: {} us, match {}x{} score {:.4f}", name, elapsed.count(),
+                             match ? match->rect.x : 0, match ? match->rect.y : 0, match ? match->score : 0.0)
+              << std::endl;
+}
+
+auto main() -> int32_t
+{
+    std::mt19937 random(42);
+
+    // Synthetic screen: gradients with noise and the button of 64x48 pixels
+    uint32_t const width = 720;
+    uint32_t const height = 1280;
+    std::vector<uint8_t> pixels(width * height * 4);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint8_t* pixel = pixels.data() + (y * width + x) * 4;
+            pixel[0] = static_cast<uint8_t>(x / 3 + (random() & 31));
+            pixel[1] = static_cast<uint8_t>(y / 5 + (random() & 31));
+            pixel[2] = static_cast<uint8_t>(((x / 16) ^ (y / 16)) * 8 + (random() & 31));
+            pixel[3] = 255;
+        }
+    }
+    Frame const frame{.data = pixels, .width = width, .height = height, .stride = width * 4,
+                      .format = PixelFormat::RGBA8888};
+
+    Rect const button{.x = 517, .y = 1011, .width = 64, .height = 48};
+    Template const pattern(frame, button);
+    Frame const pattern_frame{.data = frame.data.subspan(button.y * frame.stride + button.x * 4),
+                              .width = button.width,
+                              .height = button.height,
+                              .stride = frame.stride,
+                              .format = frame.format};
+
+    std::cout << std::format("Frame {}x{}, template {}x{} at {}x{}, kernels level {}", width, height, button.width,
+                             button.height, button.x, button.y, static_cast<uint32_t>(internal::simd_level()))
+              << std::endl;
+
+    measure("Scalar reference (exhaustive NCC)", 1,
+            [&]() -> std::optional<Match> { return find_reference(frame, pattern_frame); });
+
+    for (auto const method : {MatchMethod::SAD, MatchMethod::NCC})
+    {
+        auto const name = method == MatchMethod::SAD ? "SAD" : "NCC";
+
+        TemplateMatcher exhaustive(
+            MatchOptions{.method = method, .threshold = 0.0, .pyramid_levels = 0, .candidates = 1});
+        measure(std::format("{} exhaustive", name), 1, [&]() { return exhaustive.find(frame, pattern); });
+
+        TemplateMatcher pyramid(MatchOptions{.method = method, .threshold = 0.0, .pyramid_levels = 2, .candidates = 4});
+        measure(std::format("{} pyramid", name), 20, [&]() { return pyramid.find(frame, pattern); });
+
+        measure(std::format("{} pyramid in region", name), 20, [&]() {
+            return pyramid.find(frame, pattern, Rect{.x = 360, .y = 900, .width = 360, .height = 380});
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include "pixel.hpp"
+#include <algorithm>
+#include <random>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto test_kernels(std::mt19937& random) -> void
+{
+    std::vector<uint8_t> frame(4096);
+    std::vector<uint8_t> pattern(4096);
+    std::ranges::generate(frame, [&]() { return static_cast<uint8_t>(random()); });
+    std::ranges::generate(pattern, [&]() { return static_cast<uint8_t>(random()); });
+    for (size_t i = 3; i < pattern.size(); i += 4)
+    {
+        pattern[i] = 0;
+    }
+
+    for (uint32_t const size : {4u, 12u, 16u, 28u, 32u, 36u, 64u, 100u, 256u, 4092u})
+    {
+        auto const expected_sad = internal::sad_row(internal::SimdLevel::Scalar)(frame.data(), pattern.data(), size);
+        auto const expected_sums =
+            internal::correlate_row(internal::SimdLevel::Scalar)(frame.data(), pattern.data(), size);
+
+        for (uint32_t level = 1; level <= static_cast<uint32_t>(internal::simd_level()); ++level)
+        {
+            auto const simd = static_cast<internal::SimdLevel>(level);
+            expect(internal::sad_row(simd)(frame.data(), pattern.data(), size) == expected_sad,
+                   std::format("SAD of {} bytes differs (level {})", size, level));
+
+            auto const sums = internal::correlate_row(simd)(frame.data(), pattern.data(), size);
+            expect(sums.sum == expected_sums.sum && sums.squares == expected_sums.squares &&
+                       sums.products == expected_sums.products,
+                   std::format("Correlation of {} bytes differs (level {})", size, level));
+        }
+    }
+}
+
+auto test_find(std::mt19937& random) -> void
+{
+    // Smooth noise, so the downscaled levels keep the structure of the full frame
+    uint32_t const width = 320;
+    uint32_t const height = 240;
+    std::vector<uint8_t> pixels(width * height * 4);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint8_t* pixel = pixels.data() + (y * width + x) * 4;
+            pixel[0] = static_cast<uint8_t>(x * 3 + (random() & 15));
+            pixel[1] = static_cast<uint8_t>(y * 5 + (random() & 15));
+            pixel[2] = static_cast<uint8_t>((x ^ y) + (random() & 15));
+            pixel[3] = static_cast<uint8_t>(random());
+        }
+    }
+    Frame const frame{.data = pixels, .width = width, .height = height, .stride = width * 4,
+                      .format = PixelFormat::RGBA8888};
+
+    Rect const button{.x = 203, .y = 117, .width = 40, .height = 24};
+    Template const pattern(frame, button);
+    expect(pattern.width() == 40 && pattern.height() == 24, "Template size is wrong");
+
+    for (auto const method : {MatchMethod::SAD, MatchMethod::NCC})
+    {
+        for (uint32_t const levels : {0u, 2u})
+        {
+            TemplateMatcher matcher(MatchOptions{.method = method, .threshold = 0.95, .pyramid_levels = levels,
+                                                 .candidates = 4});
+
+            auto match = matcher.find(frame, pattern);
+            expect(match && match->rect == button && match->score > 0.999,
+                   std::format("Template is not found (method {}, levels {})", static_cast<uint32_t>(method),
+                               levels));
+            expect(match->center() == std::tuple<uint32_t, uint32_t>{223, 129}, "Match center is wrong");
+
+            // The region of interest limits the search
+            match = matcher.find(frame, pattern, Rect{.x = 150, .y = 100, .width = 120, .height = 60});
+            expect(match && match->rect == button, "Template is not found in the region");
+            expect(!matcher.find(frame, pattern, Rect{.x = 0, .y = 0, .width = 200, .height = 240}),
+                   "Template is found outside of the region");
+        }
+    }
+
+    // Brighter screen is still matched by the correlation
+    std::vector<uint8_t> brighter(pixels);
+    std::ranges::transform(brighter, brighter.begin(), [](uint8_t const value) { return value / 2 + 60; });
+    Frame const dimmed{.data = brighter, .width = width, .height = height, .stride = width * 4,
+                       .format = PixelFormat::RGBX8888};
+
+    auto match = TemplateMatcher().find(dimmed, pattern);
+    expect(match && match->rect == button, "Correlation does not tolerate the brightness");
+
+    bool thrown = false;
+    try
+    {
+        TemplateMatcher().find(Frame{.data = pixels, .width = width, .height = height, .stride = width * 4,
+                                     .format = PixelFormat::BGRA8888},
+                               pattern);
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "Different channel order is accepted");
+}
+
+auto main() -> int32_t
+{
+    std::mt19937 random(42);
+
+    try
+    {
+        test_kernels(random);
+        test_find(random);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+// Benchmarks of the MEmuc commands against memuc_stub, one JSON object per line:
+//   {"benchmark": name, "parameters": {...}, "iterations": n, "mean_us", "p50_us", "p90_us", "p99_us", "min_us",
+//    "max_us", "ops_per_second", "bytes_per_second", "stages": {stage: microseconds per iteration}}
+// Stages come from memucpp::Metrics, the command time left after the stages is the parsing and the conversion.
+// The stub latency is set by MEMUC_STUB_LATENCY_MS (0 measures the library and the process overhead only).
+
+#include "memucpp.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+using namespace memucpp;
+
+using Parameters = std::vector<std::pair<std::string_view, uint32_t>>;
+
+std::ostream* output = &std::cout;
+
+/*!
+    \brief Runs the function the number of times and writes the result line
+    \param function returns the number of bytes processed by one call (0 for the text commands)
+*/
+template <typename Function>
+auto measure(std::string_view const name, Parameters const& parameters, uint32_t const iterations,
+             Function&& function) -> void
+{
+    // The first call warms up the buffers and the page cache of the stub
+    function();
+    Metrics::reset();
+
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    size_t bytes = 0;
+
+    auto const start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        auto const begin = std::chrono::steady_clock::now();
+        bytes += function();
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+    }
+    double const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto const snapshot = Metrics::snapshot();
+
+    std::ranges::sort(samples);
+    auto percentile = [&](double const fraction) {
+        return samples[std::min(static_cast<size_t>(fraction * samples.size()), samples.size() - 1)];
+    };
+
+    std::string line = std::format("{{\"benchmark\":\"{}\",\"parameters\":{{", name);
+    for (size_t i = 0; i < parameters.size(); ++i)
+    {
+        line += std::format("{}\"{}\":{}", i > 0 ? "," : "", parameters[i].first, parameters[i].second);
+    }
+    line += std::format("}},\"iterations\":{},\"mean_us\":{:.2f},\"p50_us\":{:.2f},\"p90_us\":{:.2f},\"p99_us\":{:.2f},"
+                        "\"min_us\":{:.2f},\"max_us\":{:.2f},\"ops_per_second\":{:.2f},\"bytes_per_second\":{:.0f},"
+                        "\"stages\":{{",
+                        iterations, elapsed * 1e6 / iterations, percentile(0.5), percentile(0.9), percentile(0.99),
+                        samples.front(), samples.back(), iterations / elapsed, bytes / elapsed);
+
+    bool first = true;
+    for (auto metric = static_cast<uint32_t>(Metric::ProcessSpawn); metric < static_cast<uint32_t>(Metric::Count);
+         ++metric)
+    {
+        auto const stats = snapshot.total(static_cast<Metric>(metric));
+        if (stats.count > 0)
+        {
+            line += std::format("{}\"{}\":{:.2f}", first ? "" : ",", metric_name(static_cast<Metric>(metric)),
+                                std::chrono::duration<double, std::micro>(stats.total).count() / iterations);
+            first = false;
+        }
+    }
+    line += "}}";
+
+    *output << line << std::endl;
+    std::cerr << std::format("{} {}: {:.1f} us", name, parameters.empty() ? 0 : parameters.front().second,
+                             elapsed * 1e6 / iterations)
+              << std::endl;
+}
+
+auto benchmark_process() -> void
+{
+    std::vector<std::string> const arguments{memuc_path.string(), "version"};
+    std::vector<uint8_t> buffer;
+
+    measure("process_round_trip", {}, 200, [&]() {
+        return process_backend->execute(arguments, buffer, process_timeout).size;
+    });
+}
+
+auto benchmark_text(Memuc& memuc) -> void
+{
+    for (uint32_t const count : {2, 32, 256})
+    {
+        ::setenv("MEMUC_STUB_VMS", std::to_string(count).c_str(), 1);
+        measure("list_vms", {{"vms", count}}, 100, [&]() {
+            auto const vms = memuc.list_vms();
+            if (vms.size() != count)
+            {
+                throw std::runtime_error("List of the VMs is wrong");
+            }
+            return size_t(0);
+        });
+    }
+    ::unsetenv("MEMUC_STUB_VMS");
+
+    for (uint32_t const count : {8, 64, 512})
+    {
+        ::setenv("MEMUC_STUB_PROCESSES", std::to_string(count).c_str(), 1);
+        measure("list_process", {{"processes", count}}, 100, [&]() {
+            auto const processes = memuc.list_process();
+            if (processes.size() != count)
+            {
+                throw std::runtime_error("List of the processes is wrong");
+            }
+            return size_t(0);
+        });
+    }
+    ::unsetenv("MEMUC_STUB_PROCESSES");
+}
+
+auto benchmark_screen(uint32_t const width, uint32_t const height) -> void
+{
+    ::setenv("MEMUC_STUB_SIZE", std::format("{}x{}", width, height).c_str(), 1);
+
+    Memuc memuc(0, VMConfig{.width = width, .height = height, .dpi = 240});
+    Parameters const parameters{{"width", width}, {"height", height}};
+
+    measure("capture", parameters, 30, [&]() { return memuc.capture().data.size(); });
+    measure("screen_cap", parameters, 30, [&]() { return memuc.screen_cap().size(); });
+
+    // Conversions of one captured frame, without the process
+    auto const frame = memuc.capture();
+    std::vector<uint8_t> buffer;
+
+    measure("encode_bmp", parameters, 100, [&]() {
+        encode_bmp(frame, buffer);
+        return frame.data.size();
+    });
+    measure("encode_bgr", parameters, 100, [&]() {
+        encode_bgr(frame, buffer);
+        return frame.data.size();
+    });
+    measure("encode_grayscale", parameters, 100, [&]() {
+        encode_grayscale(frame, buffer);
+        return frame.data.size();
+    });
+    measure("downscale", parameters, 100, [&]() {
+        downscale(frame, 2, buffer);
+        return frame.data.size();
+    });
+
+    ::unsetenv("MEMUC_STUB_SIZE");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: memuc_benchmark <memuc stub> [output file]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        ::setenv("MEMUC_STUB_STILL", "1", 1);
+
+        std::ofstream file;
+        if (argc > 2)
+        {
+            file.open(argv[2]);
+            output = &file;
+        }
+
+        Metrics::enable(true);
+
+        benchmark_process();
+        {
+            Memuc memuc(0, VMConfig::Default());
+            benchmark_text(memuc);
+        }
+        for (auto const& [width, height] : {std::pair{540u, 960u}, {720u, 1280u}, {1080u, 1920u}})
+        {
+            benchmark_screen(width, height);
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+// Stand-in for memuc.exe that answers the commands used by memucpp without an emulator
+//   MEMUC_STUB_SIZE        screen size of the capture (WxH, 720x1280 is default)
+//   MEMUC_STUB_LATENCY_MS  delay before every answer
+//   MEMUC_STUB_DATASPACE   appends the color space to the screencap header (Android 10+)
+//   MEMUC_STUB_STILL       keeps the screen the same between the captures
+//   MEMUC_STUB_CONFIG      values of getconfigex (key=value,...), VMConfig::Default() otherwise
+//   MEMUC_STUB_BOOTED_AT   wall clock (milliseconds since epoch) after which the guest reports boot completed
+//   MEMUC_STUB_LOG         file that receives every command line
+//   MEMUC_STUB_VMS         number of the VMs in listvms (2 is default, VM 0 is running, the others are stopped)
+//   MEMUC_STUB_PROCESSES   number of the application processes in ps (8 is default)
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+auto environment(char const* name, std::string_view const fallback) -> std::string
+{
+    char const* value = std::getenv(name);
+    return value ? std::string(value) : std::string(fallback);
+}
+
+auto write(std::string_view const data) -> void
+{
+    std::fwrite(data.data(), 1, data.size(), stdout);
+}
+
+auto screencap() -> std::string
+{
+    auto const size = environment("MEMUC_STUB_SIZE", "720x1280");
+    uint32_t const width = std::stoul(size.substr(0, size.find('x')));
+    uint32_t const height = std::stoul(size.substr(size.find('x') + 1));
+
+    // Header of the screencap (width, height, RGBA_8888 and the optional color space)
+    std::string output(3 * sizeof(uint32_t), '\0');
+    std::array<uint32_t, 3> const header{width, height, 1};
+    std::memcpy(output.data(), header.data(), sizeof(header));
+    if (!environment("MEMUC_STUB_DATASPACE", "").empty())
+    {
+        output.append(sizeof(uint32_t), '\0');
+    }
+
+    // Gradient that moves with the wall clock, so successive captures differ
+    uint32_t const shift =
+        environment("MEMUC_STUB_STILL", "").empty()
+            ? static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                        std::chrono::system_clock::now().time_since_epoch())
+                                        .count() /
+                                    16)
+            : 0;
+
+    size_t const offset = output.size();
+    output.resize(offset + static_cast<size_t>(width) * height * 4);
+    for (uint32_t j = 0; j < height; ++j)
+    {
+        char* row = output.data() + offset + static_cast<size_t>(j) * width * 4;
+        for (uint32_t i = 0; i < width; ++i)
+        {
+            row[i * 4 + 0] = static_cast<char>(i + shift);
+            row[i * 4 + 1] = static_cast<char>(j);
+            row[i * 4 + 2] = static_cast<char>(i ^ j);
+            row[i * 4 + 3] = static_cast<char>(255);
+        }
+    }
+    return output;
+}
+
+auto config_value(std::string_view const key) -> std::string
+{
+    auto overrides = environment("MEMUC_STUB_CONFIG", "");
+    overrides.insert(overrides.begin(), ',');
+    overrides.push_back(',');
+
+    std::string pattern(key);
+    pattern.insert(pattern.begin(), ',');
+    pattern.push_back('=');
+    size_t const found = overrides.find(pattern);
+    if (found != std::string::npos)
+    {
+        size_t const start = found + key.size() + 2;
+        return overrides.substr(start, overrides.find(',', start) - start);
+    }
+
+    if (key == "is_customed_resolution")
+    {
+        return "1";
+    }
+    if (key == "resolution_width")
+    {
+        return "720";
+    }
+    if (key == "resolution_height")
+    {
+        return "1280";
+    }
+    return key == "vbox_dpi" ? "240" : "";
+}
+
+auto listvms() -> std::string
+{
+    uint32_t const count = std::stoul(environment("MEMUC_STUB_VMS", "2"));
+
+    std::string output;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        output += i == 0 ? "0,MEmu,0,1,1234\r\n" : std::to_string(i) + ",MEmu_" + std::to_string(i) + ",0,0,0\r\n";
+    }
+    return output;
+}
+
+auto ps() -> std::string
+{
+    uint32_t const count = std::stoul(environment("MEMUC_STUB_PROCESSES", "8"));
+
+    // Toolbox ps of Android 7 with the system processes around the applications
+    std::string output = "USER      PID   PPID  VSIZE  RSS   WCHAN              PC  NAME\r\n"
+                         "root      1     0     9228   1684  SyS_epoll_ 00000000 S /init\r\n"
+                         "system    1421  1203  1568800 148312 SyS_epoll_ 00000000 S system_server\r\n"
+                         "u0_a20    1601  1203  1012304 96124 SyS_epoll_ 00000000 S com.android.systemui\r\n";
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        output += "u0_a" + std::to_string(60 + i) + "    " + std::to_string(2000 + i) +
+                  "  1203  1003316 71088 SyS_epoll_ 00000000 S com.example.app" + std::to_string(i) + "\r\n";
+    }
+    output += "u0_a9     2801  1203  987412 52204 SyS_epoll_ 00000000 S com.android.launcher3\r\n"
+              "shell     3120  3114  4460   1864           0 00000000 R ps\r\n";
+    return output;
+}
+
+auto boot_completed() -> bool
+{
+    auto const now =
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
+    return now.count() >= std::stoll(environment("MEMUC_STUB_BOOTED_AT", "0"));
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    std::vector<std::string_view> const arguments(argv + 1, argv + argc);
+
+    if (auto const log = environment("MEMUC_STUB_LOG", ""); !log.empty())
+    {
+        std::ofstream stream(log, std::ios::app);
+        for (auto const& argument : arguments)
+        {
+            stream << argument << ' ';
+        }
+        stream << std::endl;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::stoul(environment("MEMUC_STUB_LATENCY_MS", "0"))));
+
+    auto has = [&](std::string_view const argument) {
+        return std::find(arguments.begin(), arguments.end(), argument) != arguments.end();
+    };
+
+    if (has("listvms"))
+    {
+        write(listvms());
+    }
+    else if (has("getconfigex"))
+    {
+        write("Value: ");
+        write(config_value(arguments.back()));
+        write("\r\n");
+    }
+    else if (has("getprop"))
+    {
+        write("already connected to 127.0.0.1:21503\r\n");
+        write(boot_completed() ? "1\r\n" : "\r\n");
+    }
+    else if (has("screencap"))
+    {
+        auto output = screencap();
+
+        // Device side pipeline: screencap | tail -c +N | head -c M
+        for (auto it = arguments.begin(); it != arguments.end(); ++it)
+        {
+            if (*it == "tail" && it + 2 < arguments.end())
+            {
+                output.erase(0, std::min<size_t>(std::stoul(std::string(it[2].substr(1))) - 1, output.size()));
+            }
+            else if (*it == "head" && it + 2 < arguments.end())
+            {
+                output.resize(std::min<size_t>(std::stoul(std::string(it[2])), output.size()));
+            }
+        }
+
+        // 40 bytes banner of memuc adb
+        write("already connected to 127.0.0.1:21503\r\n\r\n");
+        write(output);
+    }
+    else if (has("adb") && has("ps"))
+    {
+        write("already connected to 127.0.0.1:21503\r\n\r\n");
+        write(ps());
+    }
+    else if (has("adb"))
+    {
+        write("already connected to 127.0.0.1:21503\r\n");
+        std::fflush(stdout);
+#ifndef _WIN32
+        // Interactive adb shell is served by the host shell
+        if (arguments.back() == "shell")
+        {
+            ::execl("/bin/sh", "sh", nullptr);
+        }
+#endif
+    }
+    else
+    {
+        write("SUCCESS: command completed\r\n");
+    }
+    return 0;
+}
@@ -0,0 +1,169 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <cstdlib>
+#include <sstream>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto find(MetricsSnapshot const& snapshot, Metric const metric, std::optional<uint16_t> const vm_index)
+    -> std::optional<LatencyStats>
+{
+    for (auto const& entry : snapshot.entries)
+    {
+        if (entry.metric == metric && entry.vm_index == vm_index)
+        {
+            return entry.stats;
+        }
+    }
+    return std::nullopt;
+}
+
+auto test_disabled(Memuc& memuc) -> void
+{
+    expect(!Metrics::enabled(), "Metrics are enabled by default");
+
+    memuc.trigger_click({10, 10});
+    expect(Metrics::snapshot().entries.empty(), "Disabled metrics are collected");
+}
+
+auto test_counters(Memuc& memuc) -> void
+{
+    Metrics::enable(true);
+
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        memuc.capture();
+    }
+    memuc.trigger_click({10, 10});
+    memuc.trigger_click({20, 20});
+    auto const bitmap = memuc.screen_cap();
+
+    auto const snapshot = Metrics::snapshot();
+
+    auto const capture = find(snapshot, Metric::Capture, 0);
+    expect(capture && capture->count == 5 && capture->errors == 0, "Captures are not counted for the VM");
+    expect(capture->bytes == 5 * 720 * 1280 * 4, "Captured bytes are wrong");
+    expect(capture->max >= capture->mean() && capture->mean() > std::chrono::nanoseconds(0),
+           "Capture latency is wrong");
+    expect(capture->percentile(0.5) <= capture->percentile(0.99) && capture->percentile(0.99) <= capture->max,
+           "Capture percentiles are wrong");
+
+    auto const click = find(snapshot, Metric::TriggerClick, 0);
+    expect(click && click->count == 2, "Clicks are not counted");
+
+    auto const encode = find(snapshot, Metric::BmpEncode, 0);
+    expect(encode && encode->count == 1 && encode->bytes == bitmap.size(), "Encoding of the bitmap is not counted");
+
+    // Stages run inside the commands are counted for their VM
+    auto const transfer = snapshot.total(Metric::PipeTransfer);
+    expect(transfer.count >= 8 && transfer.bytes >= 6 * 720 * 1280 * 4, "Pipe transfers are not counted");
+    expect(snapshot.total(Metric::ProcessSpawn).count == transfer.count, "Process spawns are not counted");
+    expect(find(snapshot, Metric::ProcessWait, 0).has_value(), "Process waits are not counted for the VM");
+
+    expect(snapshot.throughput(Metric::Capture) > 0.0, "Capture throughput is wrong");
+
+    Metrics::reset();
+    expect(Metrics::snapshot().entries.empty(), "Counters are not cleared");
+}
+
+auto test_errors(Memuc& memuc) -> void
+{
+    ::setenv("MEMUC_STUB_LATENCY_MS", "2000", 1);
+    process_timeout = std::chrono::milliseconds(200);
+
+    try
+    {
+        memuc.trigger_key(KeyCode::Back);
+        throw std::runtime_error("Command did not time out");
+    }
+    catch (error const&)
+    {
+    }
+
+    auto failed = memuc.start_app_async("com.example.app");
+    try
+    {
+        failed.get();
+        throw std::runtime_error("Asynchronous command did not time out");
+    }
+    catch (error const&)
+    {
+    }
+
+    process_timeout = std::chrono::milliseconds::max();
+    ::unsetenv("MEMUC_STUB_LATENCY_MS");
+
+    auto const snapshot = Metrics::snapshot();
+    auto const key = find(snapshot, Metric::TriggerKey, 0);
+    expect(key && key->count == 1 && key->errors == 1, "Failed command is not counted");
+
+    auto const started = find(snapshot, Metric::StartApp, 0);
+    expect(started && started->count == 1 && started->errors == 1, "Failed asynchronous command is not counted");
+    expect(snapshot.total(Metric::PipeTransfer).errors >= 1, "Timed out pipe transfer is not counted as failed");
+}
+
+auto test_trace(Memuc& memuc) -> void
+{
+    Metrics::start_trace();
+    memuc.trigger_click({30, 30});
+    memuc.capture();
+    Metrics::stop_trace();
+
+    // Not recorded after the trace is stopped
+    memuc.trigger_click({40, 40});
+
+    std::stringstream stream;
+    Metrics::write_trace(stream);
+    auto const trace = stream.str();
+
+    expect(trace.starts_with("{\"traceEvents\":[{") && trace.ends_with("],\"displayTimeUnit\":\"ms\"}"),
+           "Trace is not the Chrome trace");
+    expect(trace.find("\"name\":\"capture\",\"cat\":\"memucpp\",\"ph\":\"X\"") != std::string::npos,
+           "Capture is not traced");
+
+    size_t clicks = 0;
+    for (size_t offset = trace.find("trigger_click"); offset != std::string::npos;
+         offset = trace.find("trigger_click", offset + 1))
+    {
+        ++clicks;
+    }
+    expect(clicks == 1, "Trace is not stopped");
+
+    Metrics::enable(false);
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: metrics_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+
+        Memuc memuc(0, VMConfig::Default());
+
+        test_disabled(memuc);
+        test_counters(memuc);
+        test_errors(memuc);
+        test_trace(memuc);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,234 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+std::filesystem::path const directory = std::filesystem::temp_directory_path() / "memucpp_monitor_test";
+
+auto write_file(std::filesystem::path const& path, std::string_view const data, bool const append = false) -> void
+{
+    std::ofstream stream(path, append ? std::ios::app : std::ios::trunc);
+    stream << data;
+}
+
+auto write_ps(std::string_view const rows) -> void
+{
+    write_file(directory / "ps.txt",
+               std::format("USER      PID   PPID  VSIZE  RSS   WCHAN              PC  NAME\n"
+                           "root      1     0     9228   1684  SyS_epoll_ 00000000 S /init\n"
+                           "u0_a20    1601  1203  1012304 96124 SyS_epoll_ 00000000 S com.android.systemui\n"
+                           "{}"
+                           "u0_a9     2801  1203  987412 52204 SyS_epoll_ 00000000 S com.android.launcher3\n",
+                           rows));
+}
+
+auto append_event(std::string_view const line) -> void
+{
+    write_file(directory / "events.log", std::format("{}\n", line), true);
+}
+
+/*!
+    \brief Replaces ps and logcat of the shell, logcat follows events.log
+    (the EXIT line drops the channel once, while the drop file exists)
+*/
+auto install_device() -> void
+{
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "bin");
+
+    write_file(directory / "bin" / "ps", std::format("#!/bin/sh\ncat '{}'\n", (directory / "ps.txt").string()));
+    write_file(directory / "bin" / "logcat",
+               std::format("#!/bin/sh\n"
+                           "directory='{}'\n"
+                           "tail -n +1 -f \"$directory/events.log\" | while IFS= read -r line; do\n"
+                           "    if [ \"$line\" = EXIT ] && [ -e \"$directory/drop\" ]; then\n"
+                           "        rm \"$directory/drop\"; kill 0\n"
+                           "    fi\n"
+                           "    printf '%s\\n' \"$line\"\n"
+                           "done\n",
+                           directory.string()));
+    for (auto const* name : {"ps", "logcat"})
+    {
+        std::filesystem::permissions(directory / "bin" / name, std::filesystem::perms::owner_all);
+    }
+
+    write_ps("u0_a60    2000  1203  1003316 71088 SyS_epoll_ 00000000 S com.example.first\n"
+             "u0_a61    2001  1203  1003316 71088 SyS_epoll_ 00000000 S com.example.second\n");
+
+    // Replayed start of the listed process and death of the unknown one are not reported
+    write_file(directory / "events.log",
+               "I/am_proc_start( 1421): [0,2000,10060,com.example.first,activity,com.example.first/.Main]\n"
+               "I/am_proc_died( 1421): [0,1999,com.example.old]\n");
+
+    auto const path = std::getenv("PATH");
+    ::setenv("PATH", std::format("{}:{}", (directory / "bin").string(), path ? path : "").c_str(), 1);
+}
+
+class Recorder
+{
+  public:
+    auto handler() -> AppEventHandler
+    {
+        return [this](AppEvent const& event) {
+            std::lock_guard lock(mutex);
+            events.push_back(event);
+            changed.notify_all();
+        };
+    }
+
+    auto wait(size_t const count) -> std::vector<AppEvent>
+    {
+        std::unique_lock lock(mutex);
+        changed.wait_for(lock, std::chrono::seconds(5), [&]() { return events.size() >= count; });
+        return events;
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<AppEvent> events;
+};
+
+/*!
+    \brief Waits until the process table of the monitor has the process or not
+*/
+auto wait_running(AppMonitor const& monitor, std::string_view const name, bool const running) -> void
+{
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (monitor.running(name) != running)
+    {
+        expect(std::chrono::steady_clock::now() < deadline, std::format("Table does not follow {}", name));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+auto test_events() -> void
+{
+    AppMonitor monitor({"/bin/sh"}, AppMonitorOptions{.reconnect_delay = std::chrono::milliseconds(100)});
+
+    Recorder all;
+    Recorder target;
+    monitor.subscribe("", all.handler());
+    monitor.subscribe("com.example.target", target.handler());
+
+    expect(monitor.wait_ready(std::chrono::seconds(5)), "Process snapshot is not loaded");
+    auto const processes = monitor.processes();
+    expect(processes.size() == 5 && processes[2].pid == 2000 && processes[2].name == "com.example.first",
+           "Process table is wrong");
+
+    append_event("I/am_proc_start( 1421): [0,3000,10070,com.example.target,activity,com.example.target/.Main]");
+    append_event("I/am_crash( 1421): [0,3000,com.example.target,948485700,java.lang.IllegalStateException,boom,"
+                 "Main.java,12]");
+    append_event("I/am_anr  ( 1421): [0,2000,com.example.first,952745540,Input dispatching timed out (Waiting, "
+                 "because the window is busy)]");
+    append_event("I/am_proc_died( 1421): [0,3000,com.example.target]");
+
+    auto const events = all.wait(4);
+    expect(events.size() == 4, std::format("Events are not delivered ({})", events.size()));
+    expect(events[0].type == AppEventType::Started && events[0].pid == 3000 && events[0].name == "com.example.target",
+           "Start event is wrong");
+    expect(events[1].type == AppEventType::Crashed && events[1].pid == 3000 &&
+               events[1].detail == "java.lang.IllegalStateException",
+           "Crash event is wrong");
+    expect(events[2].type == AppEventType::NotResponding && events[2].pid == 2000 &&
+               events[2].detail == "Input dispatching timed out (Waiting, because the window is busy)",
+           "ANR event is wrong");
+    expect(events[3].type == AppEventType::Died && !monitor.running("com.example.target"), "Death event is wrong");
+    expect(target.wait(3).size() == 3, "Subscription of the process is not filtered");
+
+    // Changes made while the channel is down are reported after the reconnect
+    write_ps("u0_a60    2000  1203  1003316 71088 SyS_epoll_ 00000000 S com.example.first\n"
+             "u0_a62    2500  1203  1003316 71088 SyS_epoll_ 00000000 S com.example.new\n");
+    write_file(directory / "drop", "");
+    append_event("EXIT");
+
+    auto const reconnected = all.wait(6);
+    expect(reconnected.size() == 6 && reconnected[4].type == AppEventType::Died && reconnected[4].pid == 2001 &&
+               reconnected[5].type == AppEventType::Started && reconnected[5].name == "com.example.new",
+           "Changes of the dropped channel are not reported");
+    expect(monitor.stats().connections == 2 && monitor.stats().events == 6, "Monitor stats are wrong");
+
+    // The snapshot gives the parent, memory and state, the started process has them unknown
+    append_event("I/am_proc_start( 1421): [0,3100,10071,com.example.late,activity,com.example.late/.Main]");
+    wait_running(monitor, "com.example.late", true);
+    auto const table = monitor.processes();
+    auto const snapshot_row = std::ranges::find(table, 2500, &AppProcess::pid);
+    auto const started_row = std::ranges::find(table, 3100, &AppProcess::pid);
+    expect(snapshot_row != table.end() && snapshot_row->ppid == 1203 && snapshot_row->rss == 71088 &&
+               snapshot_row->state == 'S',
+           "Fields of the snapshot are wrong");
+    expect(started_row != table.end() && started_row->ppid == -1 && started_row->rss == 0 &&
+               started_row->state == '?',
+           "Fields of the started process are not unknown");
+    append_event("I/am_proc_died( 1421): [0,3100,com.example.late]");
+    wait_running(monitor, "com.example.late", false);
+}
+
+auto test_memuc() -> void
+{
+    Memuc memuc(0, VMConfig::Default());
+
+    bool thrown = false;
+    try
+    {
+        memuc.app_monitor();
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "App monitor is returned before it is started");
+
+    auto& monitor = memuc.start_app_monitor();
+    expect(monitor.wait_ready(std::chrono::seconds(5)), "Process snapshot of the VM is not loaded");
+
+    // The table answers without running ps, with the same selection and fields as the parsed output
+    auto const processes = memuc.list_process();
+    expect(processes.size() == 2 && processes[0].name == "com.example.first" &&
+               processes[1].name == "com.example.new",
+           "List of the processes is not answered from the table");
+    expect(processes[0].pid == 2000 && processes[0].ppid == 1203 && processes[0].rss == 71088 &&
+               processes[0].state == 'S',
+           "Fields of the snapshot are not kept in the table");
+
+    memuc.stop_app_monitor();
+    expect(memuc.list_process().size() == 8, "List of the processes is not read after the monitor stops");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: monitor_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        install_device();
+
+        test_events();
+        test_memuc();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include "parse.hpp"
+#include <cstdlib>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto test_ascii() -> void
+{
+    std::string_view const text = "0,MEmu,0,1,1234\r\n1,MEmu_1,0,0,0\r\n";
+    std::span<uint8_t const> const bytes(reinterpret_cast<uint8_t const*>(text.data()), text.size());
+    expect(internal::is_ascii(bytes), "ASCII output is not detected");
+
+    // The byte above 0x7F in the tail and in the middle of the block
+    std::vector<uint8_t> encoded(bytes.begin(), bytes.end());
+    encoded.back() = 0xC2;
+    expect(!internal::is_ascii(encoded), "Code page byte in the tail is not detected");
+    encoded.back() = '\n';
+    encoded[9] = 0xE0;
+    expect(!internal::is_ascii(encoded), "Code page byte in the block is not detected");
+}
+
+auto test_vms() -> void
+{
+    std::vector<VMInfo> vms;
+    internal::parse_vms("0,MEmu_with_a_long_name_0,0,1,1234\r\n1,MEmu_with_a_long_name_1,0,0,0\r\n\r\n", vms);
+    expect(vms.size() == 2 && vms[0].index == 0 && vms[0].enabled && vms[1].name == "MEmu_with_a_long_name_1" &&
+               !vms[1].enabled,
+           "VMs are parsed wrong");
+
+    // The container and the names keep their storage when they are filled again
+    auto const* names = vms[1].name.data();
+    internal::parse_vms("0,MEmu_with_a_long_name_0,0,0,0\n1,MEmu_with_a_long_name_x,0,1,4321\n", vms);
+    expect(vms.size() == 2 && vms[1].name.data() == names && vms[1].name == "MEmu_with_a_long_name_x" &&
+               vms[1].enabled && !vms[0].enabled,
+           "Container of the VMs is not reused");
+
+    internal::parse_vms("", vms);
+    expect(vms.empty(), "Empty list of the VMs is wrong");
+}
+
+auto test_process_rows() -> void
+{
+    // Toolbox ps (Android 7 and older) with the blank WCHAN of the running process
+    auto row = internal::parse_process_row("u0_a60    2000  1203  1003316 71088 SyS_epoll_ 00000000 S com.example.app");
+    expect(row && row->pid == 2000 && row->ppid == 1203 && row->rss == 71088 && row->state == 'S' &&
+               row->name == "com.example.app",
+           "Toolbox row is parsed wrong");
+
+    row = internal::parse_process_row("shell     3120  3114  4460   1864           0 00000000 R ps");
+    expect(row && row->pid == 3120 && row->rss == 1864 && row->state == 'R' && row->name == "ps",
+           "Row without WCHAN is parsed wrong");
+
+    // Toybox ps (Android 8 and newer)
+    row = internal::parse_process_row("u0_a61         3345  1721 1420372  98376 0          0 Z com.example.game");
+    expect(row && row->pid == 3345 && row->ppid == 1721 && row->rss == 98376 && row->state == 'Z',
+           "Toybox row is parsed wrong");
+
+    expect(!internal::parse_process_row("USER      PID   PPID  VSIZE  RSS   WCHAN              PC  NAME"),
+           "Header is parsed as the process");
+    expect(!internal::parse_process_row(""), "Empty line is parsed as the process");
+}
+
+auto test_processes() -> void
+{
+    std::string_view const output = "USER      PID   PPID  VSIZE  RSS   WCHAN              PC  NAME\r\n"
+                                    "root      1     0     9228   1684  SyS_epoll_ 00000000 S /init\r\n"
+                                    "u0_a20    1601  1203  1012304 96124 SyS_epoll_ 00000000 S com.android.systemui\r\n"
+                                    "u0_a60    2000  1203  1003316 71088 SyS_epoll_ 00000000 S com.example.first\r\n"
+                                    "u0_a61    2001  1203  1003316 52044 futex_wait 00000000 D com.example.second\r\n"
+                                    "u0_a9     2801  1203  987412 52204 SyS_epoll_ 00000000 S com.android.launcher3\r\n"
+                                    "shell     3120  3114  4460   1864           0 00000000 R ps\r\n";
+
+    std::vector<ProcessInfo> processes;
+    internal::parse_processes(output, processes);
+    expect(processes.size() == 2, "Application processes are selected wrong");
+    expect(processes[0].name == "com.example.first" && processes[0].pid == 2000 && processes[0].rss == 71088,
+           "First process is parsed wrong");
+    expect(processes[1].name == "com.example.second" && processes[1].ppid == 1203 && processes[1].state == 'D',
+           "Second process is parsed wrong");
+
+    auto const* storage = processes.data();
+    internal::parse_processes(output, processes);
+    expect(processes.data() == storage && processes.size() == 2, "Container of the processes is not reused");
+}
+
+auto main() -> int32_t
+{
+    try
+    {
+        test_ascii();
+        test_vms();
+        test_process_rows();
+        test_processes();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
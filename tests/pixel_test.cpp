@@ -0,0 +1,84 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include "pixel.hpp"
+#include <algorithm>
+#include <random>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+// Per-byte conversion of screen_cap before the kernels (starting at the last source row)
+auto convert_reference(std::vector<uint8_t> const& source, uint32_t const width, uint32_t const height)
+    -> std::vector<uint8_t>
+{
+    std::vector<uint8_t> out(internal::bitmap_row_size(width) * height);
+
+    uint32_t const align_width = internal::bitmap_row_size(width);
+    uint64_t offset = static_cast<uint64_t>(width) * (height - 1) * 4;
+    size_t position = 0;
+
+    for (uint32_t j = 0; j < height; ++j)
+    {
+        for (uint32_t const i : std::views::iota(0u, width))
+        {
+            out[position++] = source[offset + i * 4 + 2];
+            out[position++] = source[offset + i * 4 + 1];
+            out[position++] = source[offset + i * 4 + 0];
+        }
+        position += align_width - width * 3;
+
+        offset -= width * 4;
+    }
+    return out;
+}
+
+auto main() -> int32_t
+{
+    std::mt19937 random(42);
+
+    std::vector<std::tuple<uint32_t, uint32_t>> const sizes{{1, 1},    {2, 3},     {5, 7},     {6, 2},
+                                                            {11, 4},   {13, 9},    {31, 17},   {33, 5},
+                                                            {720, 16}, {721, 11},  {1280, 8},  {720, 1280},
+                                                            {1080, 1920}};
+
+    try
+    {
+        for (auto const& [width, height] : sizes)
+        {
+            std::vector<uint8_t> source(static_cast<size_t>(width) * height * 4);
+            std::ranges::generate(source, [&]() { return static_cast<uint8_t>(random()); });
+
+            auto const expected = convert_reference(source, width, height);
+
+            for (uint32_t level = 0; level <= static_cast<uint32_t>(internal::simd_level()); ++level)
+            {
+                for (uint32_t const threads : {1u, 3u})
+                {
+                    // Poisoned destination checks the padding is written as well
+                    std::vector<uint8_t> destination(expected.size(), 0xCD);
+                    internal::rgba_to_bgr24(source, width, height, width * 4, destination,
+                                            internal::bitmap_row_size(width), true,
+                                            static_cast<internal::SimdLevel>(level), threads);
+
+                    expect(destination == expected,
+                           std::format("Conversion of {}x{} differs (level {}, threads {})", width, height, level,
+                                       threads));
+                }
+            }
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
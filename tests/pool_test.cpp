@@ -0,0 +1,74 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto main() -> int32_t
+{
+    try
+    {
+        auto pool = FramePool::Create(10 * 1024);
+
+        uint8_t* data;
+        {
+            auto first = pool->acquire(4096);
+            auto copy = first;
+            data = first.data();
+            expect(first.size() >= 4096 && copy.use_count() == 2, "Buffer handle is not shared");
+
+            auto stats = pool->stats();
+            expect(stats.buffers == 1 && stats.in_use_bytes == 4096 && stats.allocations == 1, "Stats are wrong");
+        }
+
+        auto stats = pool->stats();
+        expect(stats.idle_buffers == 1 && stats.in_use_bytes == 0, "Buffer is not returned to the pool");
+
+        // The best fitting idle buffer is recycled
+        auto second = pool->acquire(2048);
+        expect(second.data() == data && pool->stats().reuses == 1, "Buffer is not recycled");
+
+        auto third = pool->acquire(4096);
+        bool rejected = false;
+        try
+        {
+            auto fourth = pool->acquire(4096);
+        }
+        catch (error const&)
+        {
+            rejected = true;
+        }
+        expect(rejected && pool->stats().rejections == 1, "Memory limit is not applied");
+
+        // The recycled buffer spans the requested bytes even if the previous writer shrank it
+        third.storage().resize(100);
+        third = FrameBuffer();
+        third = pool->acquire(4096);
+        expect(third.size() >= 4096 && pool->stats().reuses == 2, "Recycled buffer is shorter than requested");
+
+        // Idle buffers are freed to make room for the larger one
+        third = FrameBuffer();
+        auto large = pool->acquire(6 * 1024);
+        stats = pool->stats();
+        expect(stats.buffers == 2 && stats.bytes == 10 * 1024 && stats.peak_bytes == 10 * 1024,
+               "Idle buffers are not evicted");
+
+        // Handles outlive the pool
+        pool.reset();
+        large.storage()[0] = 1;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto main() -> int32_t
+{
+    try
+    {
+        SpawnBackend backend;
+        std::vector<uint8_t> output;
+
+        // Arguments reach the child as is, without shell quoting
+        std::vector<std::string> arguments{"/bin/sh", "-c", "printf '%s|' \"$@\"; exit 3", "sh", "a b", "\"c\"", "$d"};
+        auto result = backend.execute(arguments, output, std::chrono::seconds(5));
+        expect(!result.timed_out && result.exit_code == 3, "Exit status is wrong");
+        expect(std::string_view(reinterpret_cast<char const*>(output.data()), result.size) == "a b|\"c\"|$d|",
+               "Arguments are not passed as is");
+
+        // Large output is read without losing bytes and the buffer is reused for the next command
+        arguments = {"/bin/sh", "-c", "head -c 3686400 /dev/zero | tr '\\000' '\\001'"};
+        result = backend.execute(arguments, output, std::chrono::seconds(5));
+        expect(result.size == 3686400 && output[0] == 1 && output[result.size - 1] == 1, "Large output is lost");
+
+        size_t const capacity = output.capacity();
+        uint8_t const* data = output.data();
+        result = backend.execute(arguments, output, std::chrono::seconds(5));
+        expect(output.capacity() == capacity && output.data() == data, "Output buffer is reallocated");
+
+        arguments = {"/bin/sh", "-c", "sleep 5"};
+        auto const start = std::chrono::steady_clock::now();
+        result = backend.execute(arguments, output, std::chrono::milliseconds(200));
+        expect(result.timed_out && std::chrono::steady_clock::now() - start < std::chrono::seconds(2),
+               "Timeout is not detected");
+
+        bool failed = false;
+        try
+        {
+            arguments = {"/nonexistent/memuc"};
+            backend.execute(arguments, output, std::chrono::seconds(5));
+        }
+        catch (error const&)
+        {
+            failed = true;
+        }
+        expect(failed, "Missing executable is not reported");
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+std::filesystem::path const log_path = std::filesystem::temp_directory_path() / "memucpp_provision_test.log";
+
+// Returns the command lines received by the stub since the previous call
+auto take_log() -> std::vector<std::string>
+{
+    std::vector<std::string> lines;
+    {
+        std::ifstream stream(log_path);
+        for (std::string line; std::getline(stream, line);)
+        {
+            lines.push_back(line);
+        }
+    }
+    std::filesystem::remove(log_path);
+    return lines;
+}
+
+auto count(std::vector<std::string> const& lines, std::string_view const command) -> size_t
+{
+    return std::ranges::count_if(lines, [&](auto const& line) { return line.find(command) != std::string::npos; });
+}
+
+auto booted_at(std::chrono::milliseconds const delay) -> std::string
+{
+    return std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+                              (std::chrono::system_clock::now() + delay).time_since_epoch())
+                              .count());
+}
+
+auto test_attach() -> void
+{
+    take_log();
+    {
+        // VM 0 of the stub is running with the default config
+        Memuc memuc(0, VMConfig::Default(), ProvisionOptions::Default());
+        expect(!memuc.owns_vm(), "Attached VM is owned");
+    }
+    auto const lines = take_log();
+    expect(count(lines, "getconfigex") == 4, "Config is not read");
+    expect(count(lines, "setconfigex") == 0 && count(lines, "start") == 0 && count(lines, "reboot") == 0,
+           "Attached VM is configured or started");
+    expect(count(lines, "stop") == 0, "Attached VM is stopped");
+
+    // Only the changed value is written, the running VM is rebooted to apply it
+    ::setenv("MEMUC_STUB_CONFIG", "vbox_dpi=160", 1);
+    {
+        Memuc memuc(0, VMConfig::Default(), ProvisionOptions::Default());
+    }
+    ::unsetenv("MEMUC_STUB_CONFIG");
+
+    auto const changed = take_log();
+    expect(count(changed, "setconfigex") == 1 && count(changed, "setconfigex -i 0 vbox_dpi 240") == 1,
+           "Changed value is not written");
+    expect(count(changed, "reboot") == 1 && count(changed, "start") == 0, "Changed VM is not rebooted");
+}
+
+auto test_start() -> void
+{
+    take_log();
+    {
+        // VM 1 of the stub is stopped
+        auto options = ProvisionOptions::Default();
+        options.stop_on_exit = true;
+
+        Memuc memuc(1, VMConfig::Default(), options);
+        expect(memuc.owns_vm(), "Started VM is not owned");
+
+        // The moved-from instance does not stop the VM
+        Memuc moved(std::move(memuc));
+    }
+    auto const lines = take_log();
+    expect(count(lines, "start -i 1") == 1 && count(lines, "setconfigex") == 0, "VM is not started");
+    expect(count(lines, "stop -i 1") == 1, "VM is not stopped once");
+
+    {
+        Memuc memuc(1, VMConfig::Default());
+    }
+    auto const legacy = take_log();
+    expect(count(legacy, "setconfigex") == 4 && count(legacy, "start -i 1") == 1 && count(legacy, "stop -i 1") == 1,
+           "Default constructor changed its behavior");
+}
+
+auto test_boot_wait() -> void
+{
+    ::setenv("MEMUC_STUB_BOOTED_AT", booted_at(std::chrono::milliseconds(500)).c_str(), 1);
+
+    auto const start = std::chrono::steady_clock::now();
+    Memuc memuc(1, VMConfig::Default(), ProvisionOptions::Default());
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    expect(elapsed >= std::chrono::milliseconds(400) && elapsed < std::chrono::seconds(3),
+           std::format("Boot is not waited ({})", std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)));
+
+    ::setenv("MEMUC_STUB_BOOTED_AT", booted_at(std::chrono::hours(1)).c_str(), 1);
+    try
+    {
+        memuc.wait_boot(std::chrono::milliseconds(300), std::chrono::milliseconds(50));
+        throw std::runtime_error("Boot wait did not time out");
+    }
+    catch (error const& e)
+    {
+        expect(std::string_view(e.what()) == "VM boot timed out", std::format("Unexpected error: {}", e.what()));
+    }
+    ::unsetenv("MEMUC_STUB_BOOTED_AT");
+}
+
+auto test_parallel() -> void
+{
+    ::setenv("MEMUC_STUB_LATENCY_MS", "100", 1);
+
+    // listvms, getconfigex (at once), start and getprop take 400 ms per VM
+    std::vector<uint16_t> const vm_indices{0, 1, 2, 3, 4, 5, 6, 7};
+    auto const start = std::chrono::steady_clock::now();
+    auto const vms = Memuc::Provision(vm_indices, VMConfig::Default());
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    expect(vms.size() == 8 && !vms[0].owns_vm(), "Provisioned VMs are wrong");
+    expect(elapsed < std::chrono::milliseconds(2500),
+           std::format("VMs are not provisioned in parallel ({})",
+                       std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)));
+
+    ::unsetenv("MEMUC_STUB_LATENCY_MS");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: provision_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        ::setenv("MEMUC_STUB_LOG", log_path.c_str(), 1);
+
+        test_attach();
+        test_start();
+        test_boot_wait();
+        test_parallel();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
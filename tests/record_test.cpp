@@ -0,0 +1,131 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include "memucpp/record.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+std::filesystem::path const path = std::filesystem::temp_directory_path() / "memucpp_record_test.rec";
+
+size_t constexpr frame_size = 720 * 1280 * 4;
+
+auto same_pixels(Frame const& frame, std::vector<uint8_t> const& pixels) -> bool
+{
+    return std::ranges::equal(frame.data, pixels);
+}
+
+auto test_record() -> std::vector<std::vector<uint8_t>>
+{
+    // Room for three frames, so the fourth one overwrites the first frame and its click
+    auto recorder = std::make_shared<FrameRecorder>(
+        path, RecorderOptions{.capacity = 3 * frame_size + 1024, .index_size = 64});
+
+    std::vector<std::vector<uint8_t>> captured;
+    {
+        Memuc memuc(0, VMConfig::Default());
+        memuc.set_recorder(recorder);
+
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            auto const frame = memuc.capture();
+            captured.emplace_back(frame.data.begin(), frame.data.end());
+            memuc.trigger_click({i, i * 2});
+
+            // The screen of the stub moves with the wall clock
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    recorder->flush();
+    expect(recorder->records() == 8, "Records are not appended");
+
+    FrameReplay const replay(path);
+    expect(replay.frame_count() == 3, std::format("Oldest frame is not overwritten ({})", replay.frame_count()));
+    for (size_t i = 0; i < replay.frame_count(); ++i)
+    {
+        auto const recorded = replay.frame(i);
+        expect(recorded.sequence == 2 * (i + 1) && recorded.frame.width == 720 && recorded.frame.height == 1280 &&
+                   recorded.frame.format == PixelFormat::RGBA8888,
+               "Recorded frame is wrong");
+        expect(same_pixels(recorded.frame, captured[i + 1]), "Pixels of the recorded frame are wrong");
+    }
+    expect(replay.frame(0).time <= replay.frame(1).time, "Time of the frames is wrong");
+
+    auto const inputs = replay.inputs();
+    expect(inputs.size() == 3 && inputs[0].command == "input tap 1 2" && inputs[2].command == "input tap 3 6" &&
+               inputs[2].sequence == 7,
+           "Recorded input commands are wrong");
+    return captured;
+}
+
+auto test_replay(std::vector<std::vector<uint8_t>> const& captured) -> void
+{
+    auto backend = std::make_shared<ReplayBackend>(std::make_shared<FrameReplay>(path));
+    process_backend = backend;
+
+    Memuc memuc(0, VMConfig::Default());
+    expect(same_pixels(memuc.capture(), captured[1]), "Replayed frame is wrong");
+
+    // The first region capture reads the whole screen, the next one cuts the rows of the recorded frame
+    Rect const region{.x = 10, .y = 50, .width = 200, .height = 80};
+    for (size_t k = 2; k < 4; ++k)
+    {
+        auto const part = memuc.capture_region(region);
+        for (uint32_t y = 0; y < part.frame.height; ++y)
+        {
+            auto const expected = std::span(captured[k]).subspan((region.y + y) * 720 * 4 + region.x * 4, 200 * 4);
+            expect(std::ranges::equal(part.frame.row(y), expected), "Replayed region is wrong");
+        }
+    }
+    expect(backend->finished(), "Replay is not finished");
+    expect(same_pixels(memuc.capture(), captured[3]), "Last frame is not repeated");
+
+    memuc.trigger_click({7, 8});
+    expect(memuc.list_process().empty(), "Replay lists processes");
+    expect(memuc.touch_device().path == "/dev/input/event4", "Touch screen of the replay is not found");
+    memuc.play_gesture(GestureScript().tap({5, 5}));
+    auto const inputs = backend->inputs();
+    expect(inputs.size() == 2 && inputs[0] == "input tap 7 8" && inputs[1].ends_with("> /dev/input/event4"),
+           "Input commands of the replay are not collected");
+
+    // The looping replay starts over
+    process_backend = std::make_shared<ReplayBackend>(std::make_shared<FrameReplay>(path), true);
+    for (size_t k = 1; k < 5; ++k)
+    {
+        expect(same_pixels(memuc.capture(), captured[k < 4 ? k : 1]), "Looping replay is wrong");
+    }
+    process_backend = std::make_shared<SpawnBackend>();
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: record_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        test_replay(test_record());
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::filesystem::remove(path);
+    return EXIT_SUCCESS;
+}
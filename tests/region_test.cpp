@@ -0,0 +1,86 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <cstdlib>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto test_region(bool const dataspace) -> void
+{
+    if (dataspace)
+    {
+        ::setenv("MEMUC_STUB_DATASPACE", "1", 1);
+    }
+    else
+    {
+        ::unsetenv("MEMUC_STUB_DATASPACE");
+    }
+
+    Memuc memuc(0, VMConfig::Default());
+    auto const full = memuc.capture();
+
+    // The first region capture learns the layout, the next ones cut the rows on the device
+    for (uint32_t k = 0; k < 2; ++k)
+    {
+        Rect const region{.x = 10, .y = 50, .width = 200, .height = 80};
+        auto const part = memuc.capture_region(region);
+
+        expect(part.region == region && part.factor == 1, "Region is wrong");
+        expect(part.frame.width == 200 && part.frame.height == 80, "Region frame size is wrong");
+        for (uint32_t y = 0; y < part.frame.height; ++y)
+        {
+            expect(std::ranges::equal(part.frame.row(y), full.row(region.y + y).subspan(region.x * 4, 200 * 4)),
+                   std::format("Row {} of the region differs (pass {}, dataspace {})", y, k, dataspace));
+        }
+        expect(part.to_screen(std::tuple<uint32_t, uint32_t>{5, 7}) == std::tuple<uint32_t, uint32_t>{15, 57},
+               "Position mapping is wrong");
+    }
+
+    // The downscaled region maps to the center of the block
+    auto const small = memuc.capture_region(Rect{.x = 100, .y = 200, .width = 64, .height = 40}, 4);
+    expect(small.frame.width == 16 && small.frame.height == 10, "Downscaled region size is wrong");
+    expect(small.to_screen(std::tuple<uint32_t, uint32_t>{1, 2}) == std::tuple<uint32_t, uint32_t>{106, 210},
+           "Downscaled position mapping is wrong");
+    expect(small.to_screen(Rect{.x = 1, .y = 1, .width = 2, .height = 2}) ==
+               Rect{.x = 104, .y = 204, .width = 8, .height = 8},
+           "Downscaled rectangle mapping is wrong");
+
+    // Green channel of the stub is the row index, so the block average is known
+    expect(small.frame.row(0)[1] == 202 && small.frame.row(1)[1] == 206, "Downscaled pixels are wrong");
+
+    // The region is clipped to the screen
+    auto const edge = memuc.capture_region(Rect{.x = 700, .y = 1270, .width = 100, .height = 100});
+    expect(edge.region == Rect{.x = 700, .y = 1270, .width = 20, .height = 10}, "Region is not clipped");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: region_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        ::setenv("MEMUC_STUB_STILL", "1", 1);
+
+        test_region(false);
+        test_region(true);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
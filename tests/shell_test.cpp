@@ -0,0 +1,95 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include "memucpp/shell.hpp"
+#include <fstream>
+#include <thread>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+auto main() -> int32_t
+{
+    // Stand-in for memuc adb shell: prints the memuc banner and then serves commands
+    auto const script_path = std::filesystem::temp_directory_path() / "memucpp_shell_test.sh";
+    auto const marker_path = std::filesystem::temp_directory_path() / "memucpp_shell_test.marker";
+    {
+        std::ofstream fs(script_path);
+        fs << "#!/bin/sh\necho \"already connected to 127.0.0.1:21503\"\nexec /bin/sh\n";
+    }
+    std::filesystem::permissions(script_path, std::filesystem::perms::owner_all);
+    std::filesystem::remove(marker_path);
+
+    try
+    {
+        ShellSession session({script_path.string()},
+                             ShellOptions{.timeout = std::chrono::milliseconds(500), .reconnect_attempts = 1});
+
+        auto result = session.execute("echo hello");
+        expect(result.exit_code == 0 && result.output == "hello\n", "Output of the command is wrong");
+
+        result = session.execute("printf 'a\\nb'");
+        expect(result.output == "a\nb", "Output without the trailing new line is wrong");
+
+        result = session.execute("echo error >&2; false");
+        expect(result.exit_code == 1 && result.output == "error\n", "Exit status of the command is wrong");
+
+        for (uint32_t const i : std::views::iota(0u, 100u))
+        {
+            result = session.execute(std::format("input tap {} {}", i, i));
+            expect(result.exit_code == 127, "Commands are not processed in sequence");
+        }
+
+        // The command that kills the shell is not repeated
+        bool closed = false;
+        try
+        {
+            session.execute(std::format("if [ -e {} ]; then echo repeated; else touch {}; kill -9 $$; fi",
+                                        marker_path.string(), marker_path.string()));
+        }
+        catch (error const&)
+        {
+            closed = true;
+        }
+        expect(closed && !session.connected(), "The closed shell is not reported");
+
+        result = session.execute("echo reopened");
+        expect(result.output == "reopened\n", "The session is not reopened after the close");
+
+        // The shell closed between the commands is reconnected, the command is sent once
+        session.execute("{ sleep 0.1; kill -9 $$; } >/dev/null 2>&1 &");
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        result = session.execute("echo recovered");
+        expect(result.output == "recovered\n", "The session is not reconnected");
+
+        bool timed_out = false;
+        try
+        {
+            session.execute("sleep 5");
+        }
+        catch (error const&)
+        {
+            timed_out = true;
+        }
+        expect(timed_out && !session.connected(), "The command timeout is not detected");
+
+        result = session.execute("echo again");
+        expect(result.output == "again\n", "The session is not reopened after the timeout");
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::filesystem::remove(script_path);
+    std::filesystem::remove(marker_path);
+    return 0;
+}
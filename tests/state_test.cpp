@@ -0,0 +1,188 @@
+// Copyright © 2020-2024 Dmitriy Lukovenko. All rights reserved.
+
+#include "memucpp.hpp"
+#include <bit>
+#include <cstdlib>
+
+using namespace memucpp;
+
+auto expect(bool const condition, std::string_view const message) -> void
+{
+    if (!condition)
+    {
+        throw std::runtime_error(std::string(message));
+    }
+}
+
+uint32_t constexpr width = 360;
+uint32_t constexpr height = 640;
+
+/*!
+    \brief Fills the RGBA frame with the pixel function
+*/
+template <typename Pixel>
+auto make_frame(std::vector<uint8_t>& pixels, Pixel&& pixel) -> Frame
+{
+    pixels.resize(static_cast<size_t>(width) * height * 4);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint8_t const value = pixel(x, y);
+            uint8_t* out = pixels.data() + (static_cast<size_t>(y) * width + x) * 4;
+            out[0] = value;
+            out[1] = value;
+            out[2] = static_cast<uint8_t>(255 - value);
+            out[3] = 255;
+        }
+    }
+    return Frame{
+        .data = pixels, .width = width, .height = height, .stride = width * 4, .format = PixelFormat::RGBA8888};
+}
+
+// Lobby: diagonal stripes, dialog: the lobby dimmed with a bright box in the middle
+auto lobby(uint32_t const x, uint32_t const y) -> uint8_t
+{
+    return static_cast<uint8_t>(((x + y) / 45 % 2) * 160 + x % 60);
+}
+
+auto dialog(uint32_t const x, uint32_t const y) -> uint8_t
+{
+    bool const box = x >= 60 && x < 300 && y >= 200 && y < 440;
+    return box ? static_cast<uint8_t>(240 - y % 80) : static_cast<uint8_t>(lobby(x, y) / 4);
+}
+
+auto test_hash() -> void
+{
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> second;
+    Rect const screen{.x = 0, .y = 0, .width = width, .height = height};
+
+    auto const reference = perceptual_hash(make_frame(first, lobby), screen);
+    auto const brighter = perceptual_hash(
+        make_frame(second, [](uint32_t x, uint32_t y) { return static_cast<uint8_t>(lobby(x, y) * 9 / 10 + 20); }),
+        screen);
+    expect(std::popcount(reference ^ brighter) <= 2, "Hash is sensitive to the brightness");
+
+    auto const other = perceptual_hash(make_frame(second, dialog), screen);
+    expect(std::popcount(reference ^ other) > 10, "Hashes of the different screens are close");
+
+    // The bitmap of the frame gives the same hash (BMP stores BGR rows bottom-up)
+    std::vector<uint8_t> bitmap;
+    std::vector<uint8_t> decoded;
+    auto const frame = decode_bmp(encode_bmp(make_frame(first, lobby), bitmap), decoded);
+    expect(frame.width == width && frame.height == height && frame.format == PixelFormat::BGR888 &&
+               frame.data[0] == 255 - lobby(0, 0) && frame.data[2] == lobby(0, 0),
+           "Decoded bitmap is wrong");
+    expect(perceptual_hash(frame, screen) == reference, "Hash of the bitmap differs");
+
+    bool thrown = false;
+    try
+    {
+        perceptual_hash(frame, Rect{.x = 0, .y = 0, .width = 8, .height = 8});
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown, "Too small region is hashed");
+}
+
+auto test_index() -> void
+{
+    std::vector<uint8_t> pixels;
+    ScreenStateIndex index;
+    index.add("lobby", make_frame(pixels, lobby));
+    // The dialog is told by its box only, the dimmed background may change
+    index.add("dialog", make_frame(pixels, dialog), {Rect{.x = 60, .y = 200, .width = 240, .height = 240}});
+    expect(index.size() == 2, "References are not added");
+
+    auto const in_lobby = index.classify(make_frame(pixels, lobby));
+    expect(in_lobby && in_lobby->label == "lobby" && in_lobby->distance == 0 && in_lobby->confidence == 1.0,
+           "Lobby is not classified");
+
+    auto const in_dialog = index.classify(make_frame(pixels, [](uint32_t x, uint32_t y) {
+        bool const box = x >= 60 && x < 300 && y >= 200 && y < 440;
+        return box ? dialog(x, y) : static_cast<uint8_t>(y % 256);
+    }));
+    expect(in_dialog && in_dialog->label == "dialog" && in_dialog->confidence > 0.9, "Dialog is not classified");
+
+    auto const unknown =
+        index.classify(make_frame(pixels, [](uint32_t x, uint32_t y) { return static_cast<uint8_t>((x ^ y) * 7); }));
+    expect(!unknown || unknown->confidence < 0.7, "Unknown screen is classified");
+
+    // The reference with the region outside of the frame is rejected and the index keeps working
+    bool thrown = false;
+    try
+    {
+        index.add("broken", make_frame(pixels, lobby), {Rect{.x = 60, .y = 200, .width = 240, .height = 240},
+                                                         Rect{.x = width, .y = height, .width = 16, .height = 16}});
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    expect(thrown && index.size() == 2, "Reference with the bad region is added");
+    auto const after = index.classify(make_frame(pixels, lobby));
+    expect(after && after->label == "lobby" && after->distance == 0, "Index is broken by the failed reference");
+}
+
+auto test_wait() -> void
+{
+    ::setenv("MEMUC_STUB_STILL", "1", 1);
+
+    Memuc memuc(0, VMConfig::Default());
+    ScreenStateIndex index;
+    index.add("lobby", memuc.screen_cap());
+
+    std::vector<uint8_t> pixels;
+    index.add("dialog", make_frame(pixels, dialog));
+
+    auto const match = memuc.wait_state(index, "lobby", std::chrono::milliseconds(1000));
+    expect(match.label == "lobby" && match.distance == 0, "Screen state is not reached");
+
+    std::array<std::string_view, 2> const states{"dialog", "lobby"};
+    expect(memuc.wait_state(index, states, std::chrono::milliseconds(1000)).label == "lobby",
+           "Any of the screen states is not reached");
+
+    // The still screen is polled less and less often until the timeout
+    auto const start = std::chrono::steady_clock::now();
+    bool thrown = false;
+    try
+    {
+        memuc.wait_state(index, "dialog", std::chrono::milliseconds(300));
+    }
+    catch (error const&)
+    {
+        thrown = true;
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    expect(thrown && elapsed >= std::chrono::milliseconds(300) && elapsed < std::chrono::milliseconds(1500),
+           "Screen state wait does not time out");
+
+    ::unsetenv("MEMUC_STUB_STILL");
+}
+
+auto main(int32_t argc, char** argv) -> int32_t
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: state_test <memuc stub>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        memuc_path = argv[1];
+        test_hash();
+        test_index();
+        test_wait();
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}